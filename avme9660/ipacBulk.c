@@ -0,0 +1,92 @@
+/*******************************************************************************
+
+Project:
+    ipacUtils
+
+File:
+    ipacBulk.c
+
+Description:
+    Block moves of 16 bit IP registers with D32 accesses where the
+    carrier supports them. See ipacBulk.h.
+
+*******************************************************************************/
+
+#include <string.h>
+
+#include <epicsTypes.h>
+#include <devLib.h>
+#include <epicsExport.h>
+
+#include "ipacBulk.h"
+
+int IPAC_BULK_D32 = 1;
+epicsExportAddress(int, IPAC_BULK_D32);
+
+
+int ipacBulkProbeD32( volatile void *addr )
+{
+  epicsUInt32 word;
+  epicsUInt16 half[2];
+
+  if( !IPAC_BULK_D32 || ((unsigned long)addr & 3) )
+    return 0;
+
+  /* A carrier without D32 support gives a bus error here */
+  if( devReadProbe( 4, addr, &word ) )
+    return 0;
+  if( devReadProbe( 2, addr, &half[0] ) ||
+      devReadProbe( 2, (volatile char *)addr + 2, &half[1] ) )
+    return 0;
+
+  /* Same registers in the same order, whatever the byte order */
+  return ( 0 == memcmp( &word, half, sizeof(word) ) );
+}
+
+
+void ipacBulkRead16( volatile const unsigned short *src, unsigned short *dst,
+                     int n, int d32 )
+{
+  epicsUInt32 word;
+
+  if( d32 )
+  {
+    if( (n > 0) && ((unsigned long)src & 3) )
+    {
+      *dst++ = *src++;
+      n--;
+    }
+    for( ; n >= 2; n -= 2, src += 2, dst += 2 )
+    {
+      word = *(volatile const epicsUInt32 *)src;
+      memcpy( dst, &word, sizeof(word) );
+    }
+  }
+
+  for( ; n > 0; n-- )
+    *dst++ = *src++;
+}
+
+
+void ipacBulkWrite16( volatile unsigned short *dst, const unsigned short *src,
+                      int n, int d32 )
+{
+  epicsUInt32 word;
+
+  if( d32 )
+  {
+    if( (n > 0) && ((unsigned long)dst & 3) )
+    {
+      *dst++ = *src++;
+      n--;
+    }
+    for( ; n >= 2; n -= 2, src += 2, dst += 2 )
+    {
+      memcpy( &word, src, sizeof(word) );
+      *(volatile epicsUInt32 *)dst = word;
+    }
+  }
+
+  for( ; n > 0; n-- )
+    *dst++ = *src++;
+}
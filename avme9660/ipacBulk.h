@@ -0,0 +1,44 @@
+/*******************************************************************************
+
+Project:
+    ipacUtils
+
+File:
+    ipacBulk.h
+
+Description:
+    Block moves of 16 bit IP registers. Where the carrier passes D32
+    accesses to IP I/O space, two adjacent registers are moved per bus
+    access, otherwise it falls back to one D16 access per register.
+
+*******************************************************************************/
+
+#ifndef INCipacBulkH
+#define INCipacBulkH
+
+#ifdef __cplusplus
+extern "C" {
+#endif  /* __cplusplus */
+
+/* Set to 0 before the cards are created to always use D16 */
+extern int IPAC_BULK_D32;
+
+/*
+ * ipacBulkProbeD32 returns 1 when a D32 read of the two 16 bit registers
+ * at addr works and gives the same as two D16 reads. Those registers
+ * must not change while it runs. The copy routines take the result as
+ * d32 and move n registers, any alignment.
+ */
+
+/* Function Prototypes */
+int  ipacBulkProbeD32( volatile void *addr );
+void ipacBulkRead16( volatile const unsigned short *src, unsigned short *dst,
+                     int n, int d32 );
+void ipacBulkWrite16( volatile unsigned short *dst, const unsigned short *src,
+                      int n, int d32 );
+
+#ifdef __cplusplus
+}
+#endif  /* __cplusplus */
+
+#endif  /* INCipacBulkH */
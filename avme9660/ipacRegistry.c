@@ -0,0 +1,160 @@
+/*******************************************************************************
+
+Project:
+    ipacUtils
+
+File:
+    ipacRegistry.c
+
+Description:
+    Card registry shared by the ipacUtils drivers. See ipacRegistry.h.
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsMutex.h>
+#include <epicsThread.h>
+#include <epicsString.h>
+#include <gpHash.h>
+#include <errlog.h>
+
+#include "ipacRegistry.h"
+
+#define IPAC_REG_HASH_SIZE  256
+
+typedef struct
+{
+  const char *type;
+  void       *card;
+} ipacRegSlot_t;
+
+static struct gphPvt    *ipacRegHash;
+static epicsMutexId     ipacRegLock;
+static ipacRegSlot_t    ipacRegTable[IPAC_REG_MAX_CARRIERS][IPAC_REG_MAX_SLOTS];
+static epicsThreadOnceId ipacRegOnce = EPICS_THREAD_ONCE_INIT;
+
+/* Only used within this file */
+static void ipacRegInit( void *arg );
+
+
+static void ipacRegInit( void *arg )
+{
+  gphInitPvt( &ipacRegHash, IPAC_REG_HASH_SIZE );
+  ipacRegLock = epicsMutexMustCreate();
+}
+
+
+int ipacRegAdd( const char *type, const char *name,
+                unsigned short carrier, unsigned short slot, void *card )
+{
+  GPHENTRY *pentry;
+  char     *key;
+
+  if( !type || !name || !*name || !card ||
+      (carrier >= IPAC_REG_MAX_CARRIERS) || (slot >= IPAC_REG_MAX_SLOTS) )
+  {
+    errlogPrintf("ipacRegAdd: invalid parameters for card %s\n", name ? name : "(null)");
+    return S_ipacReg_badParam;
+  }
+
+  epicsThreadOnce( &ipacRegOnce, ipacRegInit, NULL );
+
+  epicsMutexMustLock( ipacRegLock );
+  if( ipacRegTable[carrier][slot].card )
+  {
+    epicsMutexUnlock( ipacRegLock );
+    errlogPrintf("ipacRegAdd: %s: carrier %d slot %d already used by a %s card\n",
+                 name, carrier, slot, ipacRegTable[carrier][slot].type);
+    return S_ipacReg_slotInUse;
+  }
+
+  /* gpHash keeps a pointer to the key, so it must outlive the entry */
+  key    = epicsStrDup( name );
+  pentry = gphAdd( ipacRegHash, key, (void *)type );
+  if( !pentry )
+  {
+    epicsMutexUnlock( ipacRegLock );
+    free( key );
+    errlogPrintf("ipacRegAdd: %s card %s already registered\n", type, name);
+    return S_ipacReg_nameInUse;
+  }
+  pentry->userPvt = card;
+
+  ipacRegTable[carrier][slot].type = type;
+  ipacRegTable[carrier][slot].card = card;
+  epicsMutexUnlock( ipacRegLock );
+
+  return 0;
+}
+
+
+int ipacRegRemove( const char *type, const char *name,
+                   unsigned short carrier, unsigned short slot )
+{
+  GPHENTRY *pentry;
+  char     *key;
+
+  if( !ipacRegHash || !type || !name ||
+      (carrier >= IPAC_REG_MAX_CARRIERS) || (slot >= IPAC_REG_MAX_SLOTS) )
+    return S_ipacReg_badParam;
+
+  epicsMutexMustLock( ipacRegLock );
+  pentry = gphFind( ipacRegHash, name, (void *)type );
+  if( !pentry || (ipacRegTable[carrier][slot].type != type) ||
+      (ipacRegTable[carrier][slot].card != pentry->userPvt) )
+  {
+    epicsMutexUnlock( ipacRegLock );
+    errlogPrintf("ipacRegRemove: %s card %s is not registered at carrier %d slot %d\n",
+                 type, name, carrier, slot);
+    return S_ipacReg_badParam;
+  }
+
+  /* The key was duplicated by ipacRegAdd */
+  key = (char *)pentry->name;
+  gphDelete( ipacRegHash, key, (void *)type );
+  free( key );
+
+  ipacRegTable[carrier][slot].type = NULL;
+  ipacRegTable[carrier][slot].card = NULL;
+  epicsMutexUnlock( ipacRegLock );
+
+  return 0;
+}
+
+
+void *ipacRegFindByName( const char *type, const char *name )
+{
+  GPHENTRY *pentry;
+
+  if( !ipacRegHash || !type || !name )
+    return NULL;
+
+  pentry = gphFind( ipacRegHash, name, (void *)type );
+  if( pentry )
+    return pentry->userPvt;
+  else
+    return NULL;
+}
+
+
+void *ipacRegFindByLocation( const char *type,
+                             unsigned short carrier, unsigned short slot )
+{
+  ipacRegSlot_t *pslot;
+
+  if( (carrier >= IPAC_REG_MAX_CARRIERS) || (slot >= IPAC_REG_MAX_SLOTS) )
+    return NULL;
+
+  /* Entries are written under the lock before they are used, and only */
+  /* removed again by a create that failed before anyone could use them */
+  pslot = &ipacRegTable[carrier][slot];
+  if( !pslot->card )
+    return NULL;
+  else if( type && (pslot->type != type) )
+    return NULL;
+  else
+    return pslot->card;
+}
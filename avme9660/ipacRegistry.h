@@ -0,0 +1,59 @@
+/*******************************************************************************
+
+Project:
+    ipacUtils
+
+File:
+    ipacRegistry.h
+
+Description:
+    Card registry shared by the ipacUtils drivers. Cards are found by
+    name through a hash table and by carrier/slot through a direct
+    lookup table, so neither lookup depends on the number of cards.
+
+*******************************************************************************/
+
+#ifndef INCipacRegistryH
+#define INCipacRegistryH
+
+#ifdef __cplusplus
+extern "C" {
+#endif  /* __cplusplus */
+
+/* Size of the location table, same limits as drvIpac */
+#define IPAC_REG_MAX_CARRIERS  21
+#define IPAC_REG_MAX_SLOTS     6
+
+/* Error Numbers */
+#ifndef M_ipacReg
+#define M_ipacReg  (604 <<16)
+#endif
+
+#define S_ipacReg_badParam    (M_ipacReg| 1) /*Invalid name, type or location*/
+#define S_ipacReg_nameInUse   (M_ipacReg| 2) /*Card name already registered*/
+#define S_ipacReg_slotInUse   (M_ipacReg| 3) /*Carrier/slot already registered*/
+
+/*
+ * ipacRegRemove is only for a create that fails after ipacRegAdd, before
+ * anything could have looked the card up.
+ *
+ * "type" identifies the driver and namespaces the card names. A driver
+ * must pass the same string (by address, normally a static array in its
+ * driver file) to every call. Passing NULL to ipacRegFindByLocation
+ * returns the card in that slot whichever driver owns it.
+ */
+
+/* Function Prototypes */
+int   ipacRegAdd( const char *type, const char *name,
+                  unsigned short carrier, unsigned short slot, void *card );
+int   ipacRegRemove( const char *type, const char *name,
+                     unsigned short carrier, unsigned short slot );
+void *ipacRegFindByName( const char *type, const char *name );
+void *ipacRegFindByLocation( const char *type,
+                             unsigned short carrier, unsigned short slot );
+
+#ifdef __cplusplus
+}
+#endif  /* __cplusplus */
+
+#endif  /* INCipacRegistryH */
@@ -53,6 +53,8 @@ typedef struct
   int           bit;
   int           channel;
   unsigned char intHandler;
+  void          *card;      /* Driver card handle, resolved once at init_record */
+  int           index;     /* Driver channel index, resolved once at init_record */
 } xipIo_t;
 
 /* Function Prototypes */
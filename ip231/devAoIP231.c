@@ -36,14 +36,20 @@
 /* define function flags */
 typedef enum {
         IP231_AO_DATA,
+        IP231_AO_RAMP,
+        IP231_AO_RATE,
+        IP231_AO_STEP,
 } IP231FUNC;
 
 static struct PARAM_MAP
 {
         char param[MAX_CA_STRING_SIZE];
         int  funcflag;
-} param_map[1] = {
-    {"DATA", IP231_AO_DATA}
+} param_map[4] = {
+    {"DATA", IP231_AO_DATA},
+    {"RAMP", IP231_AO_RAMP},	/* Ramp to the value, see ip231RampEnable */
+    {"RATE", IP231_AO_RATE},	/* VAL is the ramp rate in raw counts per second */
+    {"STEP", IP231_AO_STEP}	/* VAL is the seconds between two ramp steps */
 };
 #define N_PARAM_MAP (sizeof(param_map)/sizeof(struct PARAM_MAP))
 
@@ -52,8 +58,21 @@ typedef struct IP231_DEVDATA
     IP231_ID	pcard;
     UINT16	chnlnum;
     int		funcflag;
+    IP231_ASYNC_REQ	req;		/* Queued write, see ip231WriteAsync */
+    CALLBACK	callback;	/* Processes the record again once req is done */
+    int		status;		/* Of the queued write */
 } IP231_DEVDATA;
 
+/* Called from the queue thread, second phase of write_ao */
+static void IP231_Ao_Done(void * arg, int status)
+{
+    struct aoRecord * pao = (struct aoRecord *)arg;
+    IP231_DEVDATA * pdevdata = (IP231_DEVDATA *)(pao->dpvt);
+
+    pdevdata->status = status;
+    callbackRequestProcessCallback(&(pdevdata->callback), pao->prio, pao);
+}
+
 /* This function will be called by all device support */
 /* The memory for IP231_DEVDATA will be malloced inside */
 static int IP231_DevData_Init(dbCommon * precord, char * ioString)
@@ -148,6 +167,12 @@ static long init_ao( struct aoRecord * pao)
     }
 
     pdevdata = (IP231_DEVDATA *)(pao->dpvt);
+    pdevdata->req.func = IP231_Ao_Done;
+    pdevdata->req.arg = pao;
+
+    if(pdevdata->funcflag == IP231_AO_RATE || pdevdata->funcflag == IP231_AO_STEP)
+        return 2; /* no convert, VAL is used as is */
+
     if( 0 == ip231Read(pdevdata->pcard, pdevdata->chnlnum, &temp))
     {
         pao->rval = temp;
@@ -172,7 +197,32 @@ static long write_ao(struct aoRecord *pao)
     {
     case IP231_AO_DATA:
         tmp = pao->rval;
-        status = ip231Write(pdevdata->pcard, pdevdata->chnlnum, tmp);
+        if(!ip231IsAsync(pdevdata->pcard))
+        {
+            status = ip231Write(pdevdata->pcard, pdevdata->chnlnum, tmp);
+        }
+        else if(!pao->pact)
+        {/* First phase, the queue thread processes us again */
+            status = ip231WriteAsync(pdevdata->pcard, pdevdata->chnlnum, tmp, &(pdevdata->req));
+            if(status == 0)
+            {
+                pao->pact = TRUE;
+                return 0;
+            }
+        }
+        else
+        {
+            status = pdevdata->status;
+        }
+        break;
+    case IP231_AO_RAMP:
+        status = ip231RampStart(pdevdata->pcard, pdevdata->chnlnum, pao->rval);
+        break;
+    case IP231_AO_RATE:
+        status = ip231RampConfig(pdevdata->pcard, pdevdata->chnlnum, pao->val, -1.0);
+        break;
+    case IP231_AO_STEP:
+        status = ip231RampConfig(pdevdata->pcard, pdevdata->chnlnum, -1.0, pao->val);
         break;
     }
 
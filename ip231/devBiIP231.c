@@ -0,0 +1,208 @@
+/****************************************************************/
+/* This file implements BI record device support for IP231 DAC, */
+/* telling if a channel is ramping, see ip231RampEnable         */
+/****************************************************************/
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsVersion.h>
+
+#if (EPICS_VERSION>=7) || (EPICS_VERSION>=3 && EPICS_REVISION>=14)
+#include <epicsExport.h>
+#endif
+
+#include <devLib.h>
+#include <dbAccess.h>
+#include <dbScan.h>
+#include <callback.h>
+#include <cvtTable.h>
+#include <link.h>
+#include <recSup.h>
+#include <recGbl.h>
+#include <devSup.h>
+#include <drvSup.h>
+#include <dbCommon.h>
+#include <alarm.h>
+#include <cantProceed.h>
+#include <biRecord.h>
+#include <errlog.h>
+
+#include <ptypes.h>
+#include <drvIP231Lib.h>
+
+#define MAX_CA_STRING_SIZE (40)
+
+/* define function flags */
+typedef enum {
+        IP231_BI_RAMPING,
+} IP231FUNC;
+
+static struct PARAM_MAP
+{
+        char param[MAX_CA_STRING_SIZE];
+        int  funcflag;
+} param_map[1] = {
+    {"RAMPING", IP231_BI_RAMPING}	/* 1 until the ramp is done, use SCAN I/O Intr */
+};
+#define N_PARAM_MAP (sizeof(param_map)/sizeof(struct PARAM_MAP))
+
+typedef struct IP231_DEVDATA
+{
+    IP231_ID	pcard;
+    UINT16	chnlnum;
+    int		funcflag;
+} IP231_DEVDATA;
+
+/* This function will be called by all device support */
+/* The memory for IP231_DEVDATA will be malloced inside */
+static int IP231_DevData_Init(dbCommon * precord, char * ioString)
+{
+    int		count;
+    int		loop;
+
+    char	cardname[MAX_CA_STRING_SIZE];
+    IP231_ID	pcard;
+    int		chnlnum;
+    char	param[MAX_CA_STRING_SIZE];
+    int		funcflag = 0;
+
+    IP231_DEVDATA *   pdevdata;
+
+    /* param check */
+    if(precord == NULL || ioString == NULL)
+    {
+        if(!precord) errlogPrintf("No legal record pointer!\n");
+        if(!ioString) errlogPrintf("No INP/OUT field for record %s!\n", precord->name);
+        return -1;
+    }
+
+    /* analyze INP/OUT string */
+    count = sscanf(ioString, "%[^:]:%i:%[^:]", cardname, &chnlnum, param);
+    if (count != 3)
+    {
+        errlogPrintf("Record %s INP/OUT string %s format is illegal!\n", precord->name, ioString);
+        return -1;
+    }
+
+    pcard = ip231GetByName(cardname);
+    if( !pcard )
+    {
+        errlogPrintf("Record %s IP231 %s is not registered!\n", precord->name, cardname);
+        return -1;
+    }
+
+    if(chnlnum < 0 || chnlnum >= 16 )
+    {/* chnlnum is UINT16, more accurate check again start/end channel will be done in ip231Read/ip231Write */
+        errlogPrintf("Record %s channel number %d is out of range for IP231 %s!\n", precord->name, chnlnum, cardname);
+        return -1;
+    }
+
+    for(loop=0; loop<N_PARAM_MAP; loop++)
+    {
+        if( 0 == strcmp(param_map[loop].param, param) )
+        {
+            funcflag = param_map[loop].funcflag;
+            break;
+        }
+    }
+    if(loop >= N_PARAM_MAP)
+    {
+        errlogPrintf("Record %s param %s is illegal!\n", precord->name, param);
+        return -1;
+    }
+
+    pdevdata = (IP231_DEVDATA *)callocMustSucceed(1, sizeof(IP231_DEVDATA), "Init record for IP231");
+
+    pdevdata->pcard = pcard;
+    pdevdata->chnlnum = chnlnum;
+    pdevdata->funcflag = funcflag;
+
+    precord->dpvt = (void *)pdevdata;
+    return 0;
+}
+
+
+
+static long init_bi( struct biRecord * pbi)
+{
+    IP231_DEVDATA * pdevdata;
+
+    pbi->dpvt = NULL;
+
+    if (pbi->inp.type!=INST_IO)
+    {
+        recGblRecordError(S_db_badField, (void *)pbi, "devBiIP231 Init_record, Illegal INP");
+        pbi->pact=TRUE;
+        return (S_db_badField);
+    }
+
+    if(IP231_DevData_Init((dbCommon *) pbi, pbi->inp.value.instio.string) != 0)
+    {
+        errlogPrintf("Fail to init devdata for record %s!\n", pbi->name);
+        recGblRecordError(S_db_badField, (void *) pbi, "Init devdata Error");
+        pbi->pact = TRUE;
+        return (S_db_badField);
+    }
+
+    pdevdata = (IP231_DEVDATA *)(pbi->dpvt);
+    if(!ip231RampGetIoScanPVT(pdevdata->pcard))
+    {
+        errlogPrintf("Record %s needs ip231RampEnable first!\n", pbi->name);
+        recGblRecordError(S_db_badField, (void *) pbi, "Init devdata Error");
+        pbi->pact = TRUE;
+        return (S_db_badField);
+    }
+
+    return 0;
+}
+
+/** for sync scan records  **/
+static long bi_ioint_info(int cmd,biRecord *pbi,IOSCANPVT *iopvt)
+{
+    IP231_DEVDATA * pdevdata = (IP231_DEVDATA *)(pbi->dpvt);
+
+    *iopvt = *ip231RampGetIoScanPVT(pdevdata->pcard);
+    return 0;
+}
+
+static long read_bi(struct biRecord *pbi)
+{
+    IP231_DEVDATA * pdevdata = (IP231_DEVDATA *)(pbi->dpvt);
+
+    int status=-1;
+    int active = 0;
+
+    switch(pdevdata->funcflag)
+    {
+    case IP231_BI_RAMPING:
+        status = ip231RampGet(pdevdata->pcard, pdevdata->chnlnum, NULL, &active);
+        break;
+    }
+
+    if(status)
+    {
+        pbi->udf=TRUE;
+        recGblSetSevr(pbi, READ_ALARM, INVALID_ALARM);
+        return -1;
+    }
+    else
+    {
+        pbi->rval = active;
+        pbi->udf=FALSE;
+        return 0;/******** convert ****/
+    }
+}
+
+struct IP231_DEV_SUP_SET
+{
+    long            number;
+    DEVSUPFUN       report;
+    DEVSUPFUN       init;
+    DEVSUPFUN       init_record;
+    DEVSUPFUN       get_ioint_info;
+    DEVSUPFUN       read_bi;
+} devBiIP231 = {5, NULL, NULL, init_bi, bi_ioint_info, read_bi};
+
+#if (EPICS_VERSION>=7) || (EPICS_VERSION>=3 && EPICS_REVISION>=14)
+epicsExportAddress(dset, devBiIP231);
+#endif
@@ -0,0 +1,346 @@
+/****************************************************************/
+/* This file implements waveform and aao record device support  */
+/* writing adjacent channels of one or more IP231 DAC at once   */
+/****************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <epicsVersion.h>
+
+#if (EPICS_VERSION>=7) || (EPICS_VERSION>=3 && EPICS_REVISION>=14)
+#include <epicsExport.h>
+#endif
+
+#include <devLib.h>
+#include <dbAccess.h>
+#include <dbScan.h>
+#include <callback.h>
+#include <link.h>
+#include <recSup.h>
+#include <recGbl.h>
+#include <devSup.h>
+#include <drvSup.h>
+#include <dbCommon.h>
+#include <alarm.h>
+#include <cantProceed.h>
+#include <epicsString.h>
+#include <menuFtype.h>
+#include <waveformRecord.h>
+#include <aaoRecord.h>
+#include <errlog.h>
+
+#include <ptypes.h>
+#include <drvIP231Lib.h>
+
+#define MAX_CA_STRING_SIZE (40)
+
+/* Cards one record can write, the channels of all of them in one array */
+#define MAX_IP231_WF_CARDS	8
+#define MAX_IP231_WF_VALUES	(MAX_IP231_WF_CARDS*16)
+
+/* define function flags */
+typedef enum {
+        IP231_WF_ARRAY,
+} IP231FUNC;
+
+static struct PARAM_MAP
+{
+        char param[MAX_CA_STRING_SIZE];
+        int  funcflag;
+} param_map[1] = {
+    {"ARRAY", IP231_WF_ARRAY}	/* Raw DAC values from channel first on, then one simultaneous trigger */
+};
+#define N_PARAM_MAP (sizeof(param_map)/sizeof(struct PARAM_MAP))
+
+typedef struct IP231_DEVDATA
+{
+    int		ncards;
+    IP231_ARRAY_WRITE	writes[MAX_IP231_WF_CARDS];	/* n is how many channels the card takes at most */
+    int		funcflag;
+    IP231_ASYNC_REQ	req;		/* Queued write of a single card with a write queue */
+    CALLBACK	callback;	/* Processes the record again once req is done */
+    int		status;		/* Of the queued write */
+    signed int	values[MAX_IP231_WF_VALUES];
+} IP231_DEVDATA;
+
+/* Called from the queue thread, second phase of the write */
+static void IP231_Array_Done(void * arg, int status)
+{
+    dbCommon * precord = (dbCommon *)arg;
+    IP231_DEVDATA * pdevdata = (IP231_DEVDATA *)(precord->dpvt);
+
+    pdevdata->status = status;
+    callbackRequestProcessCallback(&(pdevdata->callback), precord->prio, precord);
+}
+
+/* This function will be called by all device support */
+/* The memory for IP231_DEVDATA will be malloced inside */
+/* "card:first:ARRAY" or "card1,card2,...:first:ARRAY", the values go to */
+/* the first card from channel first, then to all channels of the next. */
+static int IP231_DevData_Init(dbCommon * precord, char * ioString)
+{
+    int		count;
+    int		loop;
+
+    char	cardnames[MAX_CA_STRING_SIZE];
+    char	* cardname, * last;
+    IP231_ID	pcard;
+    int		chnlnum;
+    char	param[MAX_CA_STRING_SIZE];
+    int		funcflag = 0;
+
+    IP231_DEVDATA *   pdevdata;
+
+    /* param check */
+    if(precord == NULL || ioString == NULL)
+    {
+        if(!precord) errlogPrintf("No legal record pointer!\n");
+        if(!ioString) errlogPrintf("No INP/OUT field for record %s!\n", precord->name);
+        return -1;
+    }
+
+    /* analyze INP/OUT string */
+    count = sscanf(ioString, "%[^:]:%i:%[^:]", cardnames, &chnlnum, param);
+    if (count != 3)
+    {
+        errlogPrintf("Record %s INP/OUT string %s format is illegal!\n", precord->name, ioString);
+        return -1;
+    }
+
+    if(chnlnum < 0 || chnlnum >= 16 )
+    {/* more accurate check against the card is done below */
+        errlogPrintf("Record %s channel number %d is out of range for IP231 %s!\n", precord->name, chnlnum, cardnames);
+        return -1;
+    }
+
+    for(loop=0; loop<N_PARAM_MAP; loop++)
+    {
+        if( 0 == strcmp(param_map[loop].param, param) )
+        {
+            funcflag = param_map[loop].funcflag;
+            break;
+        }
+    }
+    if(loop >= N_PARAM_MAP)
+    {
+        errlogPrintf("Record %s param %s is illegal!\n", precord->name, param);
+        return -1;
+    }
+
+    pdevdata = (IP231_DEVDATA *)callocMustSucceed(1, sizeof(IP231_DEVDATA), "Init record for IP231");
+
+    for(cardname = epicsStrtok_r(cardnames, ",", &last); cardname; cardname = epicsStrtok_r(NULL, ",", &last))
+    {
+        pcard = ip231GetByName(cardname);
+        if( !pcard )
+        {
+            errlogPrintf("Record %s IP231 %s is not registered!\n", precord->name, cardname);
+            free(pdevdata);
+            return -1;
+        }
+        if(pdevdata->ncards >= MAX_IP231_WF_CARDS)
+        {
+            errlogPrintf("Record %s writes more than %d IP231!\n", precord->name, MAX_IP231_WF_CARDS);
+            free(pdevdata);
+            return -1;
+        }
+        if(pdevdata->ncards == 0 && chnlnum >= ip231NumChannels(pcard))
+        {
+            errlogPrintf("Record %s channel number %d is out of range for IP231 %s!\n", precord->name, chnlnum, cardname);
+            free(pdevdata);
+            return -1;
+        }
+        pdevdata->writes[pdevdata->ncards].pcard = pcard;
+        pdevdata->writes[pdevdata->ncards].first = pdevdata->ncards ? 0 : chnlnum;
+        pdevdata->writes[pdevdata->ncards].n = ip231NumChannels(pcard) - pdevdata->writes[pdevdata->ncards].first;
+        pdevdata->ncards++;
+    }
+
+    if(pdevdata->ncards == 0)
+    {
+        errlogPrintf("Record %s INP/OUT string %s has no card!\n", precord->name, ioString);
+        free(pdevdata);
+        return -1;
+    }
+
+    /* Several cards are committed together under their locks, see ip231WriteMulti */
+    for(loop = 0; pdevdata->ncards > 1 && loop < pdevdata->ncards; loop++)
+    {
+        if(ip231IsAsync(pdevdata->writes[loop].pcard))
+        {
+            errlogPrintf("Record %s writes several IP231, one of them has a write queue!\n", precord->name);
+            free(pdevdata);
+            return -1;
+        }
+    }
+
+    pdevdata->funcflag = funcflag;
+    pdevdata->req.func = IP231_Array_Done;
+    pdevdata->req.arg = precord;
+
+    precord->dpvt = (void *)pdevdata;
+    return 0;
+}
+
+/* Common part of waveform and aao, they have the same array fields */
+static long IP231_Array_Init(dbCommon * precord, struct link * plink, epicsEnum16 ftvl, char * dsetname)
+{
+    precord->dpvt = NULL;
+
+    if (plink->type!=INST_IO)
+    {
+        recGblRecordError(S_db_badField, (void *)precord, "devWfIP231 Init_record, Illegal OUT");
+        precord->pact=TRUE;
+        return (S_db_badField);
+    }
+
+    switch(ftvl)
+    {
+    case menuFtypeSHORT:
+    case menuFtypeUSHORT:
+    case menuFtypeLONG:
+    case menuFtypeULONG:
+    case menuFtypeFLOAT:
+    case menuFtypeDOUBLE:
+        break;
+    default:
+        errlogPrintf("Record %s FTVL must be SHORT, USHORT, LONG, ULONG, FLOAT or DOUBLE for %s!\n", precord->name, dsetname);
+        recGblRecordError(S_db_badField, (void *)precord, "devWfIP231 Init_record, Illegal FTVL");
+        precord->pact=TRUE;
+        return (S_db_badField);
+    }
+
+    if(IP231_DevData_Init(precord, plink->value.instio.string) != 0)
+    {
+        errlogPrintf("Fail to init devdata for record %s!\n", precord->name);
+        recGblRecordError(S_db_badField, (void *) precord, "Init devdata Error");
+        precord->pact = TRUE;
+        return (S_db_badField);
+    }
+
+    return 0;
+}
+
+/* Nearest raw value in the DAC range, converting NaN or a value out */
+/* of the range of int would be undefined                            */
+static signed int IP231_Round(double value)
+{
+    if(!(value > 0.0)) return 0;
+    if(value >= 65535.0) return 65535;
+    return (signed int)(value + 0.5);
+}
+
+/* Raw DAC values like the RVAL of an ao record, 0x8000 is 0V */
+static long IP231_Array_Write(dbCommon * precord, void * bptr, epicsEnum16 ftvl, epicsUInt32 nord)
+{
+    IP231_DEVDATA * pdevdata = (IP231_DEVDATA *)(precord->dpvt);
+    int status = -1;
+    int loop, nwrites, n, offset;
+    IP231_ARRAY_WRITE writes[MAX_IP231_WF_CARDS];
+
+    if(precord->pact)
+    {/* Second phase, the queue thread has written the values */
+        status = pdevdata->status;
+    }
+    else
+    {
+        n = 0;
+        for(loop = 0; loop < pdevdata->ncards; loop++) n += pdevdata->writes[loop].n;
+        if(nord < (epicsUInt32)n) n = nord;
+
+        switch(ftvl)
+        {
+        case menuFtypeSHORT:
+            for(loop = 0; loop < n; loop++) pdevdata->values[loop] = ((epicsInt16 *)bptr)[loop];
+            break;
+        case menuFtypeUSHORT:
+            for(loop = 0; loop < n; loop++) pdevdata->values[loop] = ((epicsUInt16 *)bptr)[loop];
+            break;
+        case menuFtypeLONG:
+            for(loop = 0; loop < n; loop++) pdevdata->values[loop] = ((epicsInt32 *)bptr)[loop];
+            break;
+        case menuFtypeULONG:
+            for(loop = 0; loop < n; loop++) pdevdata->values[loop] = (((epicsUInt32 *)bptr)[loop] > 0xFFFF) ? 0xFFFF : ((epicsUInt32 *)bptr)[loop];
+            break;
+        case menuFtypeFLOAT:
+            for(loop = 0; loop < n; loop++) pdevdata->values[loop] = IP231_Round(((epicsFloat32 *)bptr)[loop]);
+            break;
+        case menuFtypeDOUBLE:
+            for(loop = 0; loop < n; loop++) pdevdata->values[loop] = IP231_Round(((epicsFloat64 *)bptr)[loop]);
+            break;
+        }
+
+        /* Cut the writes down to the values we have */
+        offset = 0;
+        for(nwrites = 0; nwrites < pdevdata->ncards && n > 0; nwrites++)
+        {
+            writes[nwrites] = pdevdata->writes[nwrites];
+            writes[nwrites].pvalues = pdevdata->values + offset;
+            if(writes[nwrites].n > n) writes[nwrites].n = n;
+            n -= writes[nwrites].n;
+            offset += writes[nwrites].n;
+        }
+
+        if(nwrites == 0)
+            status = 0;
+        else if(pdevdata->ncards > 1)
+            status = ip231WriteMulti(writes, nwrites, 1);
+        else if(!ip231IsAsync(writes[0].pcard))
+            status = ip231WriteArray(writes[0].pcard, writes[0].first, writes[0].n, writes[0].pvalues, 1);
+        else
+        {/* First phase, the queue thread processes us again */
+            status = ip231WriteArrayAsync(writes[0].pcard, writes[0].first, writes[0].n, writes[0].pvalues, 1, &(pdevdata->req));
+            if(status == 0)
+            {
+                precord->pact = TRUE;
+                return 0;
+            }
+        }
+    }
+
+    if(status)
+    {
+        recGblSetSevr(precord, WRITE_ALARM, INVALID_ALARM);
+        return -1;
+    }
+
+    precord->udf = FALSE;
+    return 0;
+}
+
+static long init_wf(struct waveformRecord * pwf)
+{
+    return IP231_Array_Init((dbCommon *)pwf, &(pwf->inp), pwf->ftvl, "devWfIP231");
+}
+
+static long init_aao(struct aaoRecord * paao)
+{
+    return IP231_Array_Init((dbCommon *)paao, &(paao->out), paao->ftvl, "devAaoIP231");
+}
+
+static long write_wf(struct waveformRecord * pwf)
+{
+    return IP231_Array_Write((dbCommon *)pwf, pwf->bptr, pwf->ftvl, pwf->nord);
+}
+
+static long write_aao(struct aaoRecord * paao)
+{
+    return IP231_Array_Write((dbCommon *)paao, paao->bptr, paao->ftvl, paao->nord);
+}
+
+struct IP231_DEV_SUP_SET
+{
+    long            number;
+    DEVSUPFUN       report;
+    DEVSUPFUN       init;
+    DEVSUPFUN       init_record;
+    DEVSUPFUN       get_ioint_info;
+    DEVSUPFUN       write;
+} devWfIP231 = {5, NULL, NULL, init_wf, NULL, write_wf},
+  devAaoIP231 = {5, NULL, NULL, init_aao, NULL, write_aao};
+
+#if (EPICS_VERSION>=7) || (EPICS_VERSION>=3 && EPICS_REVISION>=14)
+epicsExportAddress(dset, devWfIP231);
+epicsExportAddress(dset, devAaoIP231);
+#endif
@@ -6,44 +6,38 @@
 
 #include "drvIP231Lib.h"
 #include "drvIP231Private.h"
+#include "ipacRegistry.h"
+#include "ipacBulk.h"
+#include <iocsh.h>
 
 int    IP231_DRV_DEBUG = 0;
 
 static IP231_CARD_LIST	ip231_card_list;
 static int		card_list_inited=0;
+static const char	ip231RegType[] = "IP231";
 
 /*****************************************************************/
-/* Find IP231_CARD which matches the cardname from link list     */
+/* Find IP231_CARD which matches the cardname from the registry  */
 /*****************************************************************/
 IP231_ID ip231GetByName(char * cardname)
 {
-    IP231_ID pcard = NULL;
-
-    if(!card_list_inited)   return NULL;
-
-    for(pcard=(IP231_ID)ellFirst((ELLLIST *)&ip231_card_list); pcard; pcard = (IP231_ID)ellNext((ELLNODE *)pcard))
-    {
-        if ( 0 == strcmp(cardname, pcard->cardname) )   break;
-    }
+    return (IP231_ID)ipacRegFindByName(ip231RegType, cardname);
+}
 
-    return pcard;
+/*****************************************************************/
+/* Number of channels, 16 or 8 depend on model                   */
+/*****************************************************************/
+int ip231NumChannels(IP231_ID pcard)
+{
+    return pcard ? (int)pcard->num_chnl : 0;
 }
 
 /*****************************************************************/
-/* Find IP231_CARD which matches the carrier/slot from link list */
+/* Find IP231_CARD which matches the carrier/slot from registry  */
 /*****************************************************************/
 IP231_ID ip231GetByLocation(UINT16 carrier, UINT16 slot)
 {
-    IP231_ID pcard = NULL;
-
-    if(!card_list_inited)   return NULL;
-
-    for(pcard=(IP231_ID)ellFirst((ELLLIST *)&ip231_card_list); pcard; pcard = (IP231_ID)ellNext((ELLNODE *)pcard))
-    {
-        if ( (carrier == pcard->carrier) && (slot == pcard->slot) )   break;
-    }
-
-    return pcard;
+    return (IP231_ID)ipacRegFindByLocation(ip231RegType, carrier, slot);
 }
 
 /***************************************************************************************************************************/
@@ -79,6 +73,7 @@ int ip231Create (char *cardname, UINT16 carrier, UINT16 slot, char *dacmode)
     }
 
     pcard->lock = epicsMutexMustCreate();
+    pcard->timeout_ns = IP231_WRITE_TIMEOUT_NS;
 
     /************************************ Parameters check ************************************/
 
@@ -112,9 +107,9 @@ int ip231Create (char *cardname, UINT16 carrier, UINT16 slot, char *dacmode)
         status = -1;
         goto FAIL;
     }
-    if( ip231GetByLocation(carrier, slot) )
+    if( ipacRegFindByLocation(NULL, carrier, slot) )
     {
-        errlogPrintf ("ip231Create: IP231 on carrier %d slot %d is already registered!\n", carrier, slot);
+        errlogPrintf ("ip231Create: carrier %d slot %d is already registered!\n", carrier, slot);
         status = -1;
         goto FAIL;
     }
@@ -141,6 +136,9 @@ int ip231Create (char *cardname, UINT16 carrier, UINT16 slot, char *dacmode)
     /* Hardware pointer */
     pcard->pHardware   = (IP231_HW_MAP *) ipmBaseAddr(carrier, slot, ipac_addrIO);
 
+    /* DAC data registers read back what was written, so probing them is harmless */
+    pcard->d32 = ipacBulkProbeD32(pcard->pHardware->data);
+
     /* Read EEPROM to get calibration data */
     for(loop = 0; loop < pcard->num_chnl; loop++)
     {
@@ -161,6 +159,9 @@ int ip231Create (char *cardname, UINT16 carrier, UINT16 slot, char *dacmode)
         gain_val = (SINT16)gain;
         pcard->adj_slope[loop] = 1.0 + (double)gain_val/262144.0;
         pcard->adj_offset[loop] = (double)offset_val/4.0 - (double)gain_val/8.0;
+        /* Same in fixed point for the write path, no floating point there */
+        pcard->cal_slope[loop] = (1 << IP231_CAL_SHIFT) + gain_val;
+        pcard->cal_offset[loop] = (epicsInt64)offset_val * (1 << (IP231_CAL_SHIFT - 2)) - (epicsInt64)gain_val * (1 << (IP231_CAL_SHIFT - 3));
         if(IP231_DRV_DEBUG) printf("Card %s, Channel %d, adj_slope %g, adj_offset %g\n", cardname, loop, pcard->adj_slope[loop], pcard->adj_offset[loop]);
 
     }
@@ -168,9 +169,19 @@ int ip231Create (char *cardname, UINT16 carrier, UINT16 slot, char *dacmode)
     /* We don't want to reset, but even soft reboot reset bus and reset IP231, so we just reset again */
     pcard->pHardware->controlReg = CTRL_REG_RESET;
     epicsThreadSleep(0.1);
-    for(loop = 0; loop < pcard->num_chnl; loop++)
     {
-        ip231Write(pcard, loop, 0x8000);
+        UINT16 dac_arr[MAX_IP231_16_CHANNELS];
+        signed int raw_arr[MAX_IP231_16_CHANNELS];
+
+        for(loop = 0; loop < pcard->num_chnl; loop++)
+        {
+            raw_arr[loop] = 0x8000;
+            dac_arr[loop] = ip231Correct(pcard, loop, 0x8000);
+        }
+        epicsMutexLock(pcard->lock);
+        if(ip231LoadData(pcard, 0, pcard->num_chnl, dac_arr, raw_arr) != 0)
+            errlogPrintf ("ip231Create: DAC of device %s stays busy after reset\n", cardname);
+        epicsMutexUnlock(pcard->lock);
     }
     epicsThreadSleep(0.1);
 
@@ -184,6 +195,12 @@ int ip231Create (char *cardname, UINT16 carrier, UINT16 slot, char *dacmode)
     }
 
     /* We successfully allocate all resource */
+    if( ipacRegAdd(ip231RegType, pcard->cardname, carrier, slot, pcard) )
+    {
+        errlogPrintf ("ip231Create: failed to register device %s\n", cardname);
+        status = -1;
+        goto FAIL;
+    }
     ellAdd( (ELLLIST *)&ip231_card_list, (ELLNODE *)pcard);
 
     return 0;
@@ -196,14 +213,77 @@ FAIL:
 }
 
 /****************************************************************/
-/* Write data to paticular channel, do correction first         */
+/* Correct a raw value with the EEPROM calibration of channel   */
 /****************************************************************/
-int ip231Write(IP231_ID pcard, UINT16 channel, signed int value)
+UINT16 ip231Correct(IP231_ID pcard, UINT16 channel, signed int value)
 {
     /* The raw value from AO record is 0 ~ 65535 */
     /* But after aslo/aoff, it might be a little bit wider range */
 
     signed int tmp;
+
+    IP231_CORRECT(pcard, channel, value, tmp);
+    return tmp;
+}
+
+/****************************************************************/
+/* Spin until all channels in mask are ready for a new value,   */
+/* at most timeout_ns. Returns 0 if ready, -1 on timeout.       */
+/* Caller holds pcard->lock, which also protects the statistics */
+/****************************************************************/
+int ip231WaitReady(IP231_ID pcard, UINT32 mask)
+{
+    epicsUInt64 start, now;
+
+    if( (mask & (pcard->pHardware->writeStatus)) == mask ) return 0;
+
+    pcard->waits++;
+    start = epicsMonotonicGet();
+    do
+    {
+        now = epicsMonotonicGet();
+        if(now - start >= pcard->timeout_ns)
+        {
+            pcard->timeouts++;
+            pcard->wait_ns_total += now - start;
+            if(now - start > pcard->wait_ns_max) pcard->wait_ns_max = now - start;
+            return -1;
+        }
+    } while( (mask & (pcard->pHardware->writeStatus)) != mask );
+
+    pcard->wait_ns_total += now - start;
+    if(now - start > pcard->wait_ns_max) pcard->wait_ns_max = now - start;
+    return 0;
+}
+
+/****************************************************************/
+/* Load corrected values into n adjacent channels from first,   */
+/* two channels per bus access if the carrier does D32, and     */
+/* keep them with the values before correction, clamped to the  */
+/* DAC range, in the shadow.                                    */
+/* pdac and praw start at channel first. Caller holds lock      */
+/****************************************************************/
+int ip231LoadData(IP231_ID pcard, int first, int n, const UINT16 * pdac, const signed int * praw)
+{
+    UINT32 mask = ((0x1 << n) - 1) << first;
+    int loop;
+
+    if(ip231WaitReady(pcard, mask) != 0) return -1;
+
+    ipacBulkWrite16(&(pcard->pHardware->data[first]), pdac, n, pcard->d32);
+
+    memcpy(&(pcard->shadow_dac[first]), pdac, n * sizeof(UINT16));
+    for(loop = 0; loop < n; loop++)
+        pcard->shadow_raw[first + loop] = IP231_CLAMP_RAW(praw[loop]);
+    pcard->shadow_valid |= mask;
+    return 0;
+}
+
+/****************************************************************/
+/* Write data to paticular channel, do correction first         */
+/****************************************************************/
+int ip231Write(IP231_ID pcard, UINT16 channel, signed int value)
+{
     UINT16 dac_val;
     UINT32 mask;
 
@@ -221,31 +301,197 @@ int ip231Write(IP231_ID pcard, UINT16 channel, signed int value)
 
     if(IP231_DRV_DEBUG) printf("Write %d to card %s channel %d\n", value, pcard->cardname, channel);
 
-    tmp = value * pcard->adj_slope[channel] + pcard->adj_offset[channel];
-    if(tmp > 65535)
-        dac_val = 65535;
-    else if(tmp < 0)
-        dac_val = 0;
-    else
-        dac_val = tmp;
+    dac_val = ip231Correct(pcard, channel, value);
 
     epicsMutexLock(pcard->lock);
 
     mask = (0x1 << channel);
 
-    while( !(mask & (pcard->pHardware->writeStatus)) );
+    if(ip231WaitReady(pcard, mask) != 0)
+    {
+        epicsMutexUnlock(pcard->lock);
+        errlogPrintf("ip231Write: channel %d of card %s stays busy\n", channel, pcard->cardname);
+        return -1;
+    }
 
     if(IP231_DRV_DEBUG) printf("Write corrected %d (%#04x) to card %s channel %d@%p\n", dac_val, dac_val, pcard->cardname, channel, &(pcard->pHardware->data[channel]));
 
     pcard->pHardware->data[channel] = dac_val;
 
+    pcard->shadow_dac[channel] = dac_val;
+    pcard->shadow_raw[channel] = IP231_CLAMP_RAW(value);
+    pcard->shadow_valid |= mask;
+
     epicsMutexUnlock(pcard->lock);
 
     return 0;
 }
 
 /****************************************************************/
-/* Read data from paticular channel, do reverse-correction first*/
+/* Check first/n of an array write and correct its values into  */
+/* pdac, which is indexed by channel. caller names the function */
+/* in the error message. Returns 0 if all is fine.              */
+/****************************************************************/
+int ip231CorrectArray(IP231_ID pcard, UINT16 first, int n, const signed int * pvalues, UINT16 * pdac, const char * caller)
+{
+    int loop;
+
+    if(!pcard || !pvalues)
+    {
+        errlogPrintf("%s called with NULL pointer!\n", caller);
+        return -1;
+    }
+
+    if(n < 1 || first + n > pcard->num_chnl)
+    {
+        errlogPrintf("Bad channels %d to %d in %s card %s\n", first, first + n - 1, caller, pcard->cardname);
+        return -1;
+    }
+
+    for(loop = 0; loop < n; loop++)
+    {
+        signed int tmp;
+
+        IP231_CORRECT(pcard, first + loop, pvalues[loop], tmp);
+        pdac[first + loop] = tmp;
+    }
+
+    return 0;
+}
+
+/****************************************************************/
+/* Write n adjacent channels from first with one lock and one   */
+/* busy wait, then one simultaneous trigger if trigger is set   */
+/* and the card is in simultaneous mode. With a write queue the */
+/* values and the trigger are queued together instead.          */
+/****************************************************************/
+int ip231WriteArray(IP231_ID pcard, UINT16 first, int n, const signed int * pvalues, int trigger)
+{
+    UINT16 dac_arr[MAX_IP231_16_CHANNELS];
+    int status;
+
+    if(ip231CorrectArray(pcard, first, n, pvalues, dac_arr, "ip231WriteArray") != 0) return -1;
+
+    if(pcard->queue_thread) return ip231AsyncQueue(pcard, first, n, &(dac_arr[first]), pvalues, trigger, NULL);
+
+    epicsMutexLock(pcard->lock);
+    status = ip231LoadData(pcard, first, n, &(dac_arr[first]), pvalues);
+    if(status == 0 && trigger && pcard->dac_mode == DAC_MODE_SIMUL)
+        pcard->pHardware->simulTrig = 0xFFFF;
+    epicsMutexUnlock(pcard->lock);
+
+    if(status != 0) errlogPrintf("ip231WriteArray: channels %d to %d of card %s stay busy\n", first, first + n - 1, pcard->cardname);
+    return status;
+}
+
+/****************************************************************/
+/* Array writes to several cards as one commit. All cards are   */
+/* locked, all are loaded, and only if every load succeeded     */
+/* the simultaneous mode cards are triggered back to back. If a */
+/* load fails, the cards already loaded get their previous      */
+/* values back, so a later trigger outputs none of the commit.  */
+/* Transparent mode cards output on load, they show the new     */
+/* values until they are restored. Cards with a write queue can */
+/* not take part, they write from their thread.                 */
+/****************************************************************/
+int ip231WriteMulti(IP231_ARRAY_WRITE * pwrites, int nwrites, int trigger)
+{
+    UINT16 dac_arr[MAX_IP231_MULTI_CARDS][MAX_IP231_16_CHANNELS];
+    UINT16 prev_dac[MAX_IP231_MULTI_CARDS][MAX_IP231_16_CHANNELS];
+    signed int prev_raw[MAX_IP231_MULTI_CARDS][MAX_IP231_16_CHANNELS];
+    UINT32 prev_valid[MAX_IP231_MULTI_CARDS];
+    int order[MAX_IP231_MULTI_CARDS];
+    int status = 0, loop, index, tmp, chnl;
+    IP231_ID pcard;
+
+    if(!pwrites || nwrites < 1 || nwrites > MAX_IP231_MULTI_CARDS)
+    {
+        errlogPrintf("ip231WriteMulti: %d cards is illegal!\n", nwrites);
+        return -1;
+    }
+
+    for(loop = 0; loop < nwrites; loop++)
+    {
+        if(ip231CorrectArray(pwrites[loop].pcard, pwrites[loop].first, pwrites[loop].n, pwrites[loop].pvalues, dac_arr[loop], "ip231WriteMulti") != 0) return -1;
+        if(pwrites[loop].pcard->queue_thread)
+        {
+            errlogPrintf("ip231WriteMulti: card %s has a write queue!\n", pwrites[loop].pcard->cardname);
+            return -1;
+        }
+        /* Lock in address order, so two commits never wait on each other */
+        for(index = loop; index > 0 && (size_t)pwrites[order[index - 1]].pcard > (size_t)pwrites[loop].pcard; index--)
+            order[index] = order[index - 1];
+        order[index] = loop;
+    }
+
+    for(loop = 0; loop < nwrites; loop++)
+    {
+        if(loop > 0 && pwrites[order[loop]].pcard == pwrites[order[loop - 1]].pcard)
+        {
+            errlogPrintf("ip231WriteMulti: card %s is written twice!\n", pwrites[order[loop]].pcard->cardname);
+            return -1;
+        }
+    }
+
+    for(loop = 0; loop < nwrites; loop++)
+        epicsMutexLock(pwrites[order[loop]].pcard->lock);
+
+    for(loop = 0; loop < nwrites; loop++)
+    {
+        index = order[loop];
+        pcard = pwrites[index].pcard;
+
+        /* What the registers hold now, a channel never written is read back */
+        prev_valid[index] = pcard->shadow_valid;
+        for(chnl = pwrites[index].first; chnl < pwrites[index].first + pwrites[index].n; chnl++)
+        {
+            prev_dac[index][chnl] = (prev_valid[index] & (0x1 << chnl)) ? pcard->shadow_dac[chnl] : pcard->pHardware->data[chnl];
+            prev_raw[index][chnl] = pcard->shadow_raw[chnl];
+        }
+
+        status = ip231LoadData(pcard, pwrites[index].first, pwrites[index].n, &(dac_arr[index][pwrites[index].first]), pwrites[index].pvalues);
+        if(status != 0)
+        {
+            errlogPrintf("ip231WriteMulti: card %s stays busy, nothing triggered\n", pcard->cardname);
+            break;
+        }
+    }
+
+    if(status != 0)
+    {/* Undo the loads before the failed one */
+        for(loop--; loop >= 0; loop--)
+        {
+            index = order[loop];
+            pcard = pwrites[index].pcard;
+            if(ip231LoadData(pcard, pwrites[index].first, pwrites[index].n, &(prev_dac[index][pwrites[index].first]), &(prev_raw[index][pwrites[index].first])) != 0)
+                errlogPrintf("ip231WriteMulti: card %s stays busy, it keeps the new values\n", pcard->cardname);
+            else
+                pcard->shadow_valid = prev_valid[index];
+        }
+    }
+
+    if(status == 0 && trigger)
+    {
+        for(loop = 0; loop < nwrites; loop++)
+        {
+            if(pwrites[loop].pcard->dac_mode == DAC_MODE_SIMUL)
+                pwrites[loop].pcard->pHardware->simulTrig = 0xFFFF;
+        }
+    }
+
+    for(loop = nwrites - 1; loop >= 0; loop--)
+    {
+        tmp = order[loop];
+        epicsMutexUnlock(pwrites[tmp].pcard->lock);
+    }
+
+    return status;
+}
+
+/****************************************************************/
+/* Value last written to paticular channel, from the shadow. If */
+/* the channel was never written, read it and reverse-correct.  */
+/* Use ip231Verify to compare the shadow with the hardware.     */
 /****************************************************************/
 int ip231Read(IP231_ID pcard, UINT16 channel, signed int * pvalue)
 {
@@ -267,11 +513,22 @@ int ip231Read(IP231_ID pcard, UINT16 channel, signed int * pvalue)
         return -1;
     }
 
-    epicsMutexLock(pcard->lock);
-
     mask = (0x1 << channel);
 
-    while( !(mask & (pcard->pHardware->writeStatus)) );
+    if(pcard->shadow_valid & mask)
+    {/* Never changes without the lock, a torn int is impossible */
+        *pvalue = pcard->shadow_raw[channel];
+        return 0;
+    }
+
+    epicsMutexLock(pcard->lock);
+
+    if(ip231WaitReady(pcard, mask) != 0)
+    {
+        epicsMutexUnlock(pcard->lock);
+        errlogPrintf("ip231Read: channel %d of card %s stays busy\n", channel, pcard->cardname);
+        return -1;
+    }
     dac_val = pcard->pHardware->data[channel];
 
     epicsMutexUnlock(pcard->lock);
@@ -286,7 +543,11 @@ int ip231Read(IP231_ID pcard, UINT16 channel, signed int * pvalue)
 /***********************************************************************/
 void ip231SimulTrigger(IP231_ID pcard)
 {
-    if(pcard)
+    if(pcard && pcard->queue_thread)
+    {/* Must not overtake the values still queued */
+        ip231AsyncTrigger(pcard);
+    }
+    else if(pcard)
     {
         epicsMutexLock(pcard->lock);
         if(pcard->dac_mode == DAC_MODE_SIMUL)
@@ -334,7 +595,12 @@ static long IP231_EPICS_Report(int level)
             if(level > 1)
             {
                 printf("\tIn total %d channels, DAC mode is %s\n", pcard->num_chnl, (pcard->dac_mode)==DAC_MODE_SIMUL?"Simultaneous":"Transparent");
-                printf("\tIO space is at %p\nn", pcard->pHardware);
+                printf("\tIO space is at %p, data written with %s\nn", pcard->pHardware, pcard->d32 ? "D32" : "D16");
+                printf("\tBusy waits %lu, %lu timed out after %gus, longest %gus, average %gus\n", (unsigned long)pcard->waits, (unsigned long)pcard->timeouts,
+                       pcard->timeout_ns/1000.0, pcard->wait_ns_max/1000.0, pcard->waits ? pcard->wait_ns_total/1000.0/pcard->waits : 0.0);
+                if(pcard->queue_thread) ip231AsyncReport(pcard);
+                ip231VerifyReport(pcard);
+                if(pcard->ramp_thread) ip231RampReport(pcard);
             }
         }
     }
@@ -342,3 +608,41 @@ static long IP231_EPICS_Report(int level)
     return 0;
 }
 
+
+/**************************************************************************************************/
+/* Here we supply the iocsh commands of IP231                                                      */
+/**************************************************************************************************/
+static const iocshArg ip231AsyncEnableArg0 = {"cardname", iocshArgString};
+static const iocshArg ip231AsyncEnableArg1 = {"timeout_us", iocshArgInt};
+static const iocshArg * const ip231AsyncEnableArgs[2] = {&ip231AsyncEnableArg0, &ip231AsyncEnableArg1};
+static const iocshFuncDef ip231AsyncEnableFuncDef = {"ip231AsyncEnable", 2, ip231AsyncEnableArgs};
+static void ip231AsyncEnableCallFunc(const iocshArgBuf *args)
+{
+    ip231AsyncEnable(args[0].sval, args[1].ival);
+}
+
+static const iocshArg ip231VerifyEnableArg0 = {"cardname", iocshArgString};
+static const iocshArg ip231VerifyEnableArg1 = {"period", iocshArgDouble};
+static const iocshArg * const ip231VerifyEnableArgs[2] = {&ip231VerifyEnableArg0, &ip231VerifyEnableArg1};
+static const iocshFuncDef ip231VerifyEnableFuncDef = {"ip231VerifyEnable", 2, ip231VerifyEnableArgs};
+static void ip231VerifyEnableCallFunc(const iocshArgBuf *args)
+{
+    ip231VerifyEnable(args[0].sval, args[1].dval);
+}
+
+static const iocshArg ip231RampEnableArg0 = {"cardname", iocshArgString};
+static const iocshArg ip231RampEnableArg1 = {"tick", iocshArgDouble};
+static const iocshArg * const ip231RampEnableArgs[2] = {&ip231RampEnableArg0, &ip231RampEnableArg1};
+static const iocshFuncDef ip231RampEnableFuncDef = {"ip231RampEnable", 2, ip231RampEnableArgs};
+static void ip231RampEnableCallFunc(const iocshArgBuf *args)
+{
+    ip231RampEnable(args[0].sval, args[1].dval);
+}
+
+static void drvIP231Registrar(void)
+{
+    iocshRegister(&ip231AsyncEnableFuncDef, ip231AsyncEnableCallFunc);
+    iocshRegister(&ip231VerifyEnableFuncDef, ip231VerifyEnableCallFunc);
+    iocshRegister(&ip231RampEnableFuncDef, ip231RampEnableCallFunc);
+}
+epicsExportRegistrar(drvIP231Registrar);
@@ -0,0 +1,236 @@
+/****************************************************************/
+/* This file implements the IP231 write queue: records leave    */
+/* the latest value of a channel and a thread waits on the DAC  */
+/****************************************************************/
+#include "drvIP231Lib.h"
+#include "drvIP231Private.h"
+
+static void ip231AsyncThread(void * arg);
+
+/****************************************************************************************************/
+/*  Routine: ip231AsyncEnable                                                                       */
+/*                                                                                                  */
+/*  Purpose: Write an IP-231 from its own thread, so records never wait on a busy DAC               */
+/*                                                                                                  */
+/*  SYNOPSIS: int ip231AsyncEnable(                                                                 */
+/*                  char *cardname,       Name given to ip231Create                                 */
+/*                  int timeout_us)       A channel busy longer fails the write, 0 keeps 1000us     */
+/*  Example:                                                                                        */
+/*            ip231AsyncEnable("ip231_1", 0)                                                        */
+/*                                                                                                  */
+/*  ao records then complete in two phases. A value not written yet is replaced by a newer one of  */
+/*  the same channel, the records of both complete when the newer one is written.                 */
+/****************************************************************************************************/
+int ip231AsyncEnable(char * cardname, int timeout_us)
+{
+    IP231_ID pcard;
+    epicsThreadId thread;
+    int loop;
+
+    pcard = ip231GetByName(cardname);
+    if(!pcard)
+    {
+        errlogPrintf("ip231AsyncEnable: %s is not registered!\n", cardname);
+        return -1;
+    }
+
+    if(pcard->queue_thread)
+    {
+        errlogPrintf("ip231AsyncEnable: write queue of %s is already enabled!\n", cardname);
+        return -1;
+    }
+
+    if(timeout_us < 0)
+    {
+        errlogPrintf("ip231AsyncEnable: timeout %dus is illegal for device %s\n", timeout_us, cardname);
+        return -1;
+    }
+
+    if(timeout_us)
+    {
+        epicsMutexLock(pcard->lock);
+        pcard->timeout_ns = (epicsUInt64)timeout_us * 1000;
+        epicsMutexUnlock(pcard->lock);
+    }
+
+    pcard->queue_lock = epicsMutexMustCreate();
+    pcard->queue_event = epicsEventMustCreate(epicsEventEmpty);
+    for(loop = 0; loop < MAX_IP231_16_CHANNELS; loop++)
+        ellInit(&(pcard->queue_req[loop]));
+
+    thread = epicsThreadCreate(cardname, IP231_ASYNC_PRIORITY, epicsThreadGetStackSize(epicsThreadStackSmall), ip231AsyncThread, pcard);
+    if(!thread)
+    {
+        errlogPrintf("ip231AsyncEnable: thread creation failed for device %s\n", cardname);
+        epicsEventDestroy(pcard->queue_event);
+        epicsMutexDestroy(pcard->queue_lock);
+        return -1;
+    }
+    pcard->queue_thread = thread;
+
+    return 0;
+}
+
+int ip231IsAsync(IP231_ID pcard)
+{
+    return pcard && pcard->queue_thread;
+}
+
+/****************************************************************/
+/* Queue a value for channel. preq may be NULL, else its func   */
+/* is called once the value, or a newer one, is written. Never  */
+/* waits on the DAC. Returns 0 if queued.                       */
+/****************************************************************/
+int ip231WriteAsync(IP231_ID pcard, UINT16 channel, signed int value, IP231_ASYNC_REQ * preq)
+{
+    UINT16 dac_val;
+
+    if(!pcard || !pcard->queue_thread)
+    {
+        errlogPrintf("ip231WriteAsync: write queue is not enabled!\n");
+        return -1;
+    }
+
+    if(channel >= pcard->num_chnl)
+    {
+        errlogPrintf("Bad channel number %d in ip231WriteAsync card %s\n", channel, pcard->cardname);
+        return -1;
+    }
+
+    dac_val = ip231Correct(pcard, channel, value);
+
+    return ip231AsyncQueue(pcard, channel, 1, &dac_val, &value, 0, preq);
+}
+
+/****************************************************************/
+/* Same as ip231WriteArray, but preq is done once all values,   */
+/* or newer ones, are written                                   */
+/****************************************************************/
+int ip231WriteArrayAsync(IP231_ID pcard, UINT16 first, int n, const signed int * pvalues, int trigger, IP231_ASYNC_REQ * preq)
+{
+    UINT16 dac_arr[MAX_IP231_16_CHANNELS];
+
+    if(!pcard || !pcard->queue_thread)
+    {
+        errlogPrintf("ip231WriteArrayAsync: write queue is not enabled!\n");
+        return -1;
+    }
+
+    if(ip231CorrectArray(pcard, first, n, pvalues, dac_arr, "ip231WriteArrayAsync") != 0) return -1;
+
+    return ip231AsyncQueue(pcard, first, n, &(dac_arr[first]), pvalues, trigger, preq);
+}
+
+/****************************************************************/
+/* Queue n corrected values from channel first at once, so the  */
+/* thread writes them in the same pass. praw are the values     */
+/* before correction, for the shadow. preq waits on first.      */
+/****************************************************************/
+int ip231AsyncQueue(IP231_ID pcard, UINT16 first, int n, const UINT16 * pdac, const signed int * praw, int trigger, IP231_ASYNC_REQ * preq)
+{
+    int loop;
+
+    epicsMutexLock(pcard->queue_lock);
+    for(loop = 0; loop < n; loop++)
+    {
+        if(pcard->queue_mask & (0x1 << (first + loop))) pcard->queue_coalesced++;
+        pcard->queue_dac[first + loop] = pdac[loop];
+        pcard->queue_raw[first + loop] = praw[loop];
+        pcard->queue_mask |= (0x1 << (first + loop));
+    }
+    if(preq) ellAdd(&(pcard->queue_req[first]), &(preq->node));
+    if(trigger) pcard->queue_trig = 1;
+    epicsMutexUnlock(pcard->queue_lock);
+
+    epicsEventSignal(pcard->queue_event);
+    return 0;
+}
+
+/****************************************************************/
+/* Simultaneous trigger once the values queued so far are in    */
+/****************************************************************/
+void ip231AsyncTrigger(IP231_ID pcard)
+{
+    epicsMutexLock(pcard->queue_lock);
+    pcard->queue_trig = 1;
+    epicsMutexUnlock(pcard->queue_lock);
+
+    epicsEventSignal(pcard->queue_event);
+}
+
+/****************************************************************/
+/* Take everything queued, write adjacent channels together,    */
+/* then tell the requests how it went                           */
+/****************************************************************/
+static void ip231AsyncThread(void * arg)
+{
+    IP231_ID pcard = (IP231_ID)arg;
+    ELLLIST done[MAX_IP231_16_CHANNELS];
+    UINT16 dac_arr[MAX_IP231_16_CHANNELS];
+    signed int raw_arr[MAX_IP231_16_CHANNELS];
+    int status[MAX_IP231_16_CHANNELS];
+    IP231_ASYNC_REQ * preq;
+    UINT32 mask;
+    int trig, first, last, loop;
+
+    for(loop = 0; loop < MAX_IP231_16_CHANNELS; loop++)
+        ellInit(&(done[loop]));
+
+    while(TRUE)
+    {
+        epicsEventMustWait(pcard->queue_event);
+
+        epicsMutexLock(pcard->queue_lock);
+        mask = pcard->queue_mask;
+        trig = pcard->queue_trig;
+        for(loop = 0; loop < pcard->num_chnl; loop++)
+        {
+            if(!(mask & (0x1 << loop))) continue;
+            dac_arr[loop] = pcard->queue_dac[loop];
+            raw_arr[loop] = pcard->queue_raw[loop];
+            ellConcat(&(done[loop]), &(pcard->queue_req[loop]));
+        }
+        pcard->queue_mask = 0;
+        pcard->queue_trig = 0;
+        epicsMutexUnlock(pcard->queue_lock);
+
+        if(!mask && !trig) continue;
+
+        epicsMutexLock(pcard->lock);
+        for(first = 0; first < pcard->num_chnl; first = last)
+        {
+            if(!(mask & (0x1 << first)))
+            {
+                last = first + 1;
+                continue;
+            }
+            for(last = first + 1; last < pcard->num_chnl && (mask & (0x1 << last)); last++);
+
+            status[first] = ip231LoadData(pcard, first, last - first, &(dac_arr[first]), &(raw_arr[first]));
+            for(loop = first + 1; loop < last; loop++) status[loop] = status[first];
+            pcard->queue_writes += last - first;
+        }
+        if(trig && pcard->dac_mode == DAC_MODE_SIMUL)
+            pcard->pHardware->simulTrig = 0xFFFF;
+        pcard->queue_batches++;
+        epicsMutexUnlock(pcard->lock);
+
+        for(loop = 0; loop < pcard->num_chnl; loop++)
+        {
+            if(!(mask & (0x1 << loop))) continue;
+            if(status[loop] != 0) errlogPrintf("IP231 %s: channel %d stays busy, queued value dropped\n", pcard->cardname, loop);
+            /* The request is the caller's again once it is off the list */
+            while( (preq = (IP231_ASYNC_REQ *)ellGet(&(done[loop]))) )
+                preq->func(preq->arg, status[loop]);
+        }
+    }
+}
+
+/****************************************************************/
+/* One line for ip231 report                                    */
+/****************************************************************/
+void ip231AsyncReport(IP231_ID pcard)
+{
+    printf("\tWrite queue wrote %lu values in %lu batches, %lu replaced before written\n",
+           (unsigned long)pcard->queue_writes, (unsigned long)pcard->queue_batches, (unsigned long)pcard->queue_coalesced);
+}
@@ -11,19 +11,64 @@
 extern "C" {
 #endif  /* __cplusplus */
 
+#include <ellLib.h>
+#include <dbScan.h>
+
 #include "ptypes.h"
 
 typedef struct IP231_CARD * IP231_ID;
 
+/* One pending asynchronous write, owned by the caller until func is called */
+/* from the queue thread with status 0, or -1 if the DAC stayed busy.      */
+typedef void (*IP231_DONE_FUNC)(void * arg, int status);
+typedef struct IP231_ASYNC_REQ
+{
+    ELLNODE		node;
+    IP231_DONE_FUNC	func;
+    void		* arg;
+} IP231_ASYNC_REQ;
+
 int ip231Create (char *cardname, UINT16 carrier, UINT16 slot, char *dacmode);
 
 
 IP231_ID ip231GetByName(char * cardname);
 IP231_ID ip231GetByLocation(UINT16 carrier, UINT16 slot);
+int ip231NumChannels(IP231_ID pcard);
 
 int ip231Write(IP231_ID pcard, UINT16 channel, signed int value);
 int ip231Read(IP231_ID pcard, UINT16 channel, signed int * pvalue);
 
+/* Writes go through a queue thread, see ip231AsyncEnable */
+int ip231AsyncEnable(char * cardname, int timeout_us);
+int ip231IsAsync(IP231_ID pcard);
+int ip231WriteAsync(IP231_ID pcard, UINT16 channel, signed int value, IP231_ASYNC_REQ * preq);
+
+/* n adjacent channels from first with one lock, then one simultaneous trigger if trigger is set */
+int ip231WriteArray(IP231_ID pcard, UINT16 first, int n, const signed int * pvalues, int trigger);
+int ip231WriteArrayAsync(IP231_ID pcard, UINT16 first, int n, const signed int * pvalues, int trigger, IP231_ASYNC_REQ * preq);
+
+/* Array writes to several cards committed together, see ip231WriteMulti */
+typedef struct IP231_ARRAY_WRITE
+{
+    IP231_ID		pcard;
+    UINT16		first;
+    int			n;
+    const signed int	* pvalues;
+} IP231_ARRAY_WRITE;
+int ip231WriteMulti(IP231_ARRAY_WRITE * pwrites, int nwrites, int trigger);
+
+/* Compare what ip231Read returns with the hardware, see ip231VerifyEnable */
+int ip231Verify(IP231_ID pcard);
+int ip231VerifyEnable(char * cardname, double period);
+
+/* Channels slewed to a target by a driver thread, see ip231RampEnable */
+int ip231RampEnable(char * cardname, double tick);
+int ip231RampConfig(IP231_ID pcard, UINT16 channel, double rate, double period);
+int ip231RampStart(IP231_ID pcard, UINT16 channel, signed int target);
+int ip231RampStop(IP231_ID pcard, UINT16 channel);
+int ip231RampGet(IP231_ID pcard, UINT16 channel, signed int * pvalue, int * pactive);
+IOSCANPVT * ip231RampGetIoScanPVT(IP231_ID pcard);
+
 void ip231SimulTrigger(IP231_ID pcard);
 void ip231SimulTriggerByName(char * cardname);
 
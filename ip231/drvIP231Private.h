@@ -23,6 +23,8 @@ extern "C" {
 #include <epicsThread.h>
 #include <epicsString.h>
 #include <epicsInterrupt.h>
+#include <epicsEvent.h>
+#include <epicsTime.h>
 #include <cantProceed.h>
 #include <epicsExport.h>
 #include <drvSup.h>
@@ -55,6 +57,37 @@ extern "C" {
 
 #define DEBUG_MSG_SIZE 256
 
+/* A DAC takes about 10us to accept a value, one still busy after this is dead */
+#define IP231_WRITE_TIMEOUT_NS		1000000
+
+#define IP231_ASYNC_PRIORITY		epicsThreadPriorityHigh
+#define IP231_VERIFY_PRIORITY		epicsThreadPriorityLow
+#define IP231_RAMP_PRIORITY		(epicsThreadPriorityHigh + 5)
+
+/* Ramp positions carry this many bits below one DAC count, so slow ramps still move */
+#define IP231_RAMP_FRAC_BITS		8
+/* Seconds between two progress posts to I/O Intr records while ramping */
+#define IP231_RAMP_POST_PERIOD		0.1
+
+/* Calibration in fixed point: dac = (value * cal_slope + cal_offset) >> IP231_CAL_SHIFT */
+/* The EEPROM gain error is in units of 2^-18, so this is exact, see ip231Create          */
+#define IP231_CAL_SHIFT			18
+
+/* Clamp in 64 bits, a value far out of range would not fit in tmp */
+#define IP231_CORRECT(pcard, channel, value, tmp)									\
+do {																\
+    epicsInt64 corr64 = ((epicsInt64)(value) * (pcard)->cal_slope[channel] + (pcard)->cal_offset[channel]) >> IP231_CAL_SHIFT;	\
+    if(corr64 > 65535) corr64 = 65535;												\
+    else if(corr64 < 0) corr64 = 0;												\
+    tmp = (signed int)corr64;													\
+} while(0)
+
+/* The shadow keeps raw values in the DAC range, what was asked beyond it is not output */
+#define IP231_CLAMP_RAW(value)	((value) < 0 ? 0 : ((value) > 65535 ? 65535 : (value)))
+
+/* Most cards ip231WriteMulti commits at once */
+#define MAX_IP231_MULTI_CARDS		16
+
 /* Hardware registers for DAC channels */
 typedef struct IP231_HW_MAP
 {
@@ -79,6 +112,19 @@ typedef struct IP231_HW_MAP
 
 typedef ELLLIST IP231_CARD_LIST;
 
+/* Ramp of one channel, see drvIP231Ramp.c */
+typedef struct IP231_RAMP
+{
+    int                         active;		/* Moving toward target */
+    epicsInt32                  pos;		/* Present value << IP231_RAMP_FRAC_BITS */
+    epicsInt32                  target;		/* Same scale as pos */
+    epicsInt32                  step;		/* Move per step, same scale as pos, 0 jumps to target */
+    double                      rate;		/* Raw counts per second, 0 jumps to target */
+    double                      period;		/* Seconds between steps, 0 steps every tick */
+    int                         ticks;		/* Ticks per step */
+    int                         countdown;	/* Ticks to the next step */
+} IP231_RAMP;
+
 typedef struct IP231_CARD
 {
     ELLNODE                     node;		/* Link List Node */
@@ -94,13 +140,75 @@ typedef struct IP231_CARD
     UINT32                      dac_mode;	/* transparent mode or simultaneous mode */
 
     volatile IP231_HW_MAP       *pHardware;	/* controller registers */
+    int                         d32;		/* Carrier passes D32 to the data registers, see ipacBulk.h */
 
     double                      adj_offset[MAX_IP231_16_CHANNELS];
     double                      adj_slope[MAX_IP231_16_CHANNELS];
+    epicsInt32                  cal_slope[MAX_IP231_16_CHANNELS];	/* adj_slope << IP231_CAL_SHIFT */
+    epicsInt64                  cal_offset[MAX_IP231_16_CHANNELS];	/* adj_offset << IP231_CAL_SHIFT */
+
+    /* What the driver last wrote to the data registers, written with lock held, see ip231Read */
+    signed int                  shadow_raw[MAX_IP231_16_CHANNELS];	/* Value before correction */
+    UINT16                      shadow_dac[MAX_IP231_16_CHANNELS];	/* Corrected value in the register */
+    volatile UINT32             shadow_valid;	/* Channels written since ip231Create */
+
+    /* Bus reads comparing the shadow with the hardware, see drvIP231Verify.c */
+    epicsThreadId               verify_thread;	/* NULL unless ip231VerifyEnable was called */
+    double                      verify_period;	/* Seconds between two passes */
+    size_t                      verify_passes;
+    size_t                      verify_mismatches;	/* Channels found different from the shadow */
+    int                         verify_last_chnl;	/* Of the last mismatch */
+    UINT16                      verify_last_hw;
+    UINT16                      verify_last_shadow;
+    epicsTimeStamp              verify_last_time;
+
+    epicsUInt64                 timeout_ns;	/* Longest wait for writeStatus, see ip231WaitReady */
+    size_t                      waits;		/* Waits which found a channel busy, with lock held */
+    size_t                      timeouts;	/* Waits given up */
+    epicsUInt64                 wait_ns_total;
+    epicsUInt64                 wait_ns_max;
+
+    /* Write queue, NULL queue_thread unless ip231AsyncEnable was called, see drvIP231Async.c */
+    epicsThreadId               queue_thread;
+    epicsEventId                queue_event;	/* Wakes queue_thread */
+    epicsMutexId                queue_lock;	/* Protects the queue_ fields below, never held with lock */
+    UINT32                      queue_mask;	/* Channels with a value queued */
+    UINT16                      queue_dac[MAX_IP231_16_CHANNELS];	/* Latest corrected value of each channel */
+    signed int                  queue_raw[MAX_IP231_16_CHANNELS];	/* Same before correction */
+    ELLLIST                     queue_req[MAX_IP231_16_CHANNELS];	/* IP231_ASYNC_REQ done once the channel is written */
+    int                         queue_trig;	/* Simultaneous trigger after the queued values */
+    size_t                      queue_writes;	/* Values written by queue_thread */
+    size_t                      queue_coalesced;	/* Values replaced by a newer one before they were written */
+    size_t                      queue_batches;	/* Wake ups of queue_thread */
+
+    /* Ramp engine, NULL ramp_thread unless ip231RampEnable was called, protected by lock */
+    epicsThreadId               ramp_thread;
+    double                      ramp_tick;	/* Seconds between two wake ups of ramp_thread */
+    IP231_RAMP                  ramp[MAX_IP231_16_CHANNELS];
+    IOSCANPVT                   ramp_ioscan;	/* Progress and completion of ramps */
+    size_t                      ramp_steps;	/* Wake ups which wrote the DAC */
+    size_t                      ramp_late;	/* Wake ups after the next tick was due */
 
     char                        debug_msg[DEBUG_MSG_SIZE];
 } IP231_CARD;
 
+/* drvIP231.c */
+UINT16 ip231Correct(IP231_ID pcard, UINT16 channel, signed int value);
+int ip231WaitReady(IP231_ID pcard, UINT32 mask);
+int ip231LoadData(IP231_ID pcard, int first, int n, const UINT16 * pdac, const signed int * praw);
+int ip231CorrectArray(IP231_ID pcard, UINT16 first, int n, const signed int * pvalues, UINT16 * pdac, const char * caller);
+
+/* drvIP231Async.c */
+int ip231AsyncQueue(IP231_ID pcard, UINT16 first, int n, const UINT16 * pdac, const signed int * praw, int trigger, IP231_ASYNC_REQ * preq);
+void ip231AsyncTrigger(IP231_ID pcard);
+void ip231AsyncReport(IP231_ID pcard);
+
+/* drvIP231Verify.c */
+void ip231VerifyReport(IP231_ID pcard);
+
+/* drvIP231Ramp.c */
+void ip231RampReport(IP231_ID pcard);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,340 @@
+/****************************************************************/
+/* This file implements the IP231 ramp engine: one thread per   */
+/* card slews channels to their targets at a given rate         */
+/****************************************************************/
+#include "drvIP231Lib.h"
+#include "drvIP231Private.h"
+#include <epicsStdio.h>
+
+static void ip231RampThread(void * arg);
+
+/****************************************************************/
+/* Ticks per step and move per step from rate and period        */
+/* Caller holds pcard->lock                                     */
+/****************************************************************/
+static void ip231RampSetStep(IP231_ID pcard, IP231_RAMP * pramp)
+{
+    double step;
+
+    pramp->ticks = (int)(pramp->period / pcard->ramp_tick + 0.5);
+    if(pramp->ticks < 1) pramp->ticks = 1;
+
+    step = pramp->rate * pramp->ticks * pcard->ramp_tick * (1 << IP231_RAMP_FRAC_BITS);
+    if(pramp->rate <= 0.0 || step >= (double)(0x10000 << IP231_RAMP_FRAC_BITS))
+        pramp->step = 0;	/* Crosses the whole range in one step anyway */
+    else if(step < 1.0)
+        pramp->step = 1;
+    else
+        pramp->step = (epicsInt32)(step + 0.5);
+}
+
+/****************************************************************************************************/
+/*  Routine: ip231RampEnable                                                                        */
+/*                                                                                                  */
+/*  Purpose: Start the ramp engine of an IP-231, channels then move to a target at a set rate       */
+/*                                                                                                  */
+/*  SYNOPSIS: int ip231RampEnable(                                                                  */
+/*                  char *cardname,       Name given to ip231Create                                 */
+/*                  double tick)          Seconds between two updates of the DAC, e.g. 0.001        */
+/*  Example:                                                                                        */
+/*            ip231RampEnable("ip231_1", 0.001)                                                     */
+/*                                                                                                  */
+/*  One high priority thread wakes up every tick and steps the channels which are due, all of them  */
+/*  with one simultaneous trigger in simultaneous mode. A channel steps every period rounded to     */
+/*  ticks, see ip231RampConfig. A value written to a ramping channel lasts until its next step.     */
+/*  The tick can not be shorter than the clock tick of the OS. A late wake up moves the channels    */
+/*  by all the steps they missed, so the rate holds.                                                */
+/*  In simultaneous mode a step triggers the whole card, so values other records loaded to wait for */
+/*  ip231SimulTrigger are output with it. Do not ramp a card written that way.                      */
+/****************************************************************************************************/
+int ip231RampEnable(char * cardname, double tick)
+{
+    IP231_ID pcard;
+    epicsThreadId thread;
+    char name[32];
+    int loop;
+
+    pcard = ip231GetByName(cardname);
+    if(!pcard)
+    {
+        errlogPrintf("ip231RampEnable: %s is not registered!\n", cardname);
+        return -1;
+    }
+
+    if(pcard->ramp_thread)
+    {
+        errlogPrintf("ip231RampEnable: ramp engine of %s is already enabled!\n", cardname);
+        return -1;
+    }
+
+    if(tick <= 0.0 || tick < epicsThreadSleepQuantum())
+    {
+        errlogPrintf("ip231RampEnable: tick %g is illegal for device %s, the OS sleeps at least %gs\n", tick, cardname, epicsThreadSleepQuantum());
+        return -1;
+    }
+
+    epicsMutexLock(pcard->lock);
+    pcard->ramp_tick = tick;
+    for(loop = 0; loop < MAX_IP231_16_CHANNELS; loop++)
+        ip231RampSetStep(pcard, &(pcard->ramp[loop]));
+    epicsMutexUnlock(pcard->lock);
+
+    scanIoInit( &(pcard->ramp_ioscan) );
+
+    epicsSnprintf(name, sizeof(name), "%sRmp", cardname);
+    thread = epicsThreadCreate(name, IP231_RAMP_PRIORITY, epicsThreadGetStackSize(epicsThreadStackSmall), ip231RampThread, pcard);
+    if(!thread)
+    {
+        errlogPrintf("ip231RampEnable: thread creation failed for device %s\n", cardname);
+        return -1;
+    }
+    pcard->ramp_thread = thread;
+
+    return 0;
+}
+
+/****************************************************************/
+/* Rate in raw counts per second and period in seconds between  */
+/* two steps of channel. A negative one keeps its present value */
+/* Rate 0 jumps to the target, period 0 steps every tick.       */
+/****************************************************************/
+int ip231RampConfig(IP231_ID pcard, UINT16 channel, double rate, double period)
+{
+    if(!pcard || !pcard->ramp_thread)
+    {
+        errlogPrintf("ip231RampConfig: ramp engine is not enabled!\n");
+        return -1;
+    }
+
+    if(channel >= pcard->num_chnl)
+    {
+        errlogPrintf("Bad channel number %d in ip231RampConfig card %s\n", channel, pcard->cardname);
+        return -1;
+    }
+
+    epicsMutexLock(pcard->lock);
+    if(rate >= 0.0) pcard->ramp[channel].rate = rate;
+    if(period >= 0.0) pcard->ramp[channel].period = period;
+    ip231RampSetStep(pcard, &(pcard->ramp[channel]));
+    epicsMutexUnlock(pcard->lock);
+
+    return 0;
+}
+
+/****************************************************************/
+/* Ramp channel to target from where it is, a ramp in progress  */
+/* turns toward the new target                                  */
+/****************************************************************/
+int ip231RampStart(IP231_ID pcard, UINT16 channel, signed int target)
+{
+    IP231_RAMP * pramp;
+    signed int start;
+
+    if(!pcard || !pcard->ramp_thread)
+    {
+        errlogPrintf("ip231RampStart: ramp engine is not enabled!\n");
+        return -1;
+    }
+
+    if(channel >= pcard->num_chnl)
+    {
+        errlogPrintf("Bad channel number %d in ip231RampStart card %s\n", channel, pcard->cardname);
+        return -1;
+    }
+
+    if(ip231Read(pcard, channel, &start) != 0) return -1;
+
+    /* In the DAC range, positions and their differences then fit in epicsInt32 */
+    start = IP231_CLAMP_RAW(start);
+    target = IP231_CLAMP_RAW(target);
+
+    epicsMutexLock(pcard->lock);
+    pramp = &(pcard->ramp[channel]);
+    if(!pramp->active)
+    {
+        pramp->pos = start * (1 << IP231_RAMP_FRAC_BITS);
+        pramp->countdown = 1;
+        pramp->active = 1;
+    }
+    pramp->target = target * (1 << IP231_RAMP_FRAC_BITS);
+    epicsMutexUnlock(pcard->lock);
+
+    scanIoRequest(pcard->ramp_ioscan);
+    return 0;
+}
+
+/****************************************************************/
+/* Leave channel where the ramp got to                          */
+/****************************************************************/
+int ip231RampStop(IP231_ID pcard, UINT16 channel)
+{
+    if(!pcard || !pcard->ramp_thread || channel >= pcard->num_chnl)
+    {
+        errlogPrintf("ip231RampStop: ramp engine is not enabled or bad channel!\n");
+        return -1;
+    }
+
+    epicsMutexLock(pcard->lock);
+    pcard->ramp[channel].active = 0;
+    epicsMutexUnlock(pcard->lock);
+
+    scanIoRequest(pcard->ramp_ioscan);
+    return 0;
+}
+
+/****************************************************************/
+/* Where the ramp of channel is, and if it is still moving      */
+/****************************************************************/
+int ip231RampGet(IP231_ID pcard, UINT16 channel, signed int * pvalue, int * pactive)
+{
+    int active;
+
+    if(!pcard || !pcard->ramp_thread || channel >= pcard->num_chnl) return -1;
+
+    epicsMutexLock(pcard->lock);
+    active = pcard->ramp[channel].active;
+    if(active && pvalue) *pvalue = pcard->ramp[channel].pos >> IP231_RAMP_FRAC_BITS;
+    epicsMutexUnlock(pcard->lock);
+
+    if(pactive) *pactive = active;
+
+    /* Not moving, so it is what the DAC has */
+    if(!active && pvalue) return ip231Read(pcard, channel, pvalue);
+    return 0;
+}
+
+IOSCANPVT * ip231RampGetIoScanPVT(IP231_ID pcard)
+{
+    if(!pcard || !pcard->ramp_thread) return NULL;
+    return &(pcard->ramp_ioscan);
+}
+
+/****************************************************************/
+/* Every tick, step the channels which are due and write them   */
+/* with one trigger. Records hear of progress every             */
+/* IP231_RAMP_POST_PERIOD and right away when a ramp is done.   */
+/****************************************************************/
+static void ip231RampThread(void * arg)
+{
+    IP231_ID pcard = (IP231_ID)arg;
+    IP231_RAMP * pramp;
+    UINT16 dac_arr[MAX_IP231_16_CHANNELS];
+    signed int raw_arr[MAX_IP231_16_CHANNELS];
+    epicsInt32 prev_pos[MAX_IP231_16_CHANNELS];
+    epicsUInt64 tick_ns, next, now;
+    epicsInt64 move;
+    epicsInt32 dist;
+    UINT32 mask, done;
+    int late, moving, failed, post_ticks, post_count = 0;
+    int first, last, loop, tmp, ticks, nsteps;
+
+    tick_ns = (epicsUInt64)(pcard->ramp_tick * 1e9);
+    post_ticks = (int)(IP231_RAMP_POST_PERIOD / pcard->ramp_tick);
+    if(post_ticks < 1) post_ticks = 1;
+
+    next = epicsMonotonicGet();
+    while(TRUE)
+    {
+        /* Sleep to a deadline rather than for a tick, so steps do not drift */
+        next += tick_ns;
+        now = epicsMonotonicGet();
+        late = (now >= next);
+        ticks = 1;
+        if(!late)
+            epicsThreadSleep((next - now)/1e9);
+        else if(now - next > tick_ns)
+        {/* Too far behind, make up for the missed ticks in this one rather than in a burst */
+            ticks += (int)((now - next) / tick_ns);
+            next += (epicsUInt64)(ticks - 1) * tick_ns;
+        }
+
+        mask = 0;
+        done = moving = failed = 0;
+
+        epicsMutexLock(pcard->lock);
+        if(late) pcard->ramp_late++;
+        for(loop = 0; loop < pcard->num_chnl; loop++)
+        {
+            pramp = &(pcard->ramp[loop]);
+            if(!pramp->active) continue;
+            moving = 1;
+            pramp->countdown -= ticks;
+            if(pramp->countdown > 0) continue;
+            nsteps = 1 + (-pramp->countdown) / pramp->ticks;
+            pramp->countdown += nsteps * pramp->ticks;
+
+            prev_pos[loop] = pramp->pos;
+            dist = pramp->target - pramp->pos;
+            move = (epicsInt64)pramp->step * nsteps;
+            if(pramp->step == 0 || move >= abs(dist))
+            {
+                pramp->pos = pramp->target;
+                pramp->active = 0;
+                done |= (0x1 << loop);
+            }
+            else if(dist > 0)
+                pramp->pos += (epicsInt32)move;
+            else
+                pramp->pos -= (epicsInt32)move;
+
+            raw_arr[loop] = pramp->pos >> IP231_RAMP_FRAC_BITS;
+            IP231_CORRECT(pcard, loop, raw_arr[loop], tmp);
+            dac_arr[loop] = tmp;
+            mask |= (0x1 << loop);
+        }
+
+        for(first = 0; first < pcard->num_chnl; first = last)
+        {
+            if(!(mask & (0x1 << first)))
+            {
+                last = first + 1;
+                continue;
+            }
+            for(last = first + 1; last < pcard->num_chnl && (mask & (0x1 << last)); last++);
+
+            if(ip231LoadData(pcard, first, last - first, &(dac_arr[first]), &(raw_arr[first])) != 0)
+            {
+                failed = 1;
+                break;
+            }
+        }
+
+        if(failed)
+        {/* Busy DAC, no trigger, all channels of this tick step again from where they were next tick */
+            for(loop = 0; loop < pcard->num_chnl; loop++)
+            {
+                if(!(mask & (0x1 << loop))) continue;
+                pcard->ramp[loop].pos = prev_pos[loop];
+                pcard->ramp[loop].active = 1;
+                pcard->ramp[loop].countdown = 1;
+            }
+            done = 0;
+        }
+        else if(mask)
+        {
+            if(pcard->dac_mode == DAC_MODE_SIMUL) pcard->pHardware->simulTrig = 0xFFFF;
+            pcard->ramp_steps++;
+        }
+        epicsMutexUnlock(pcard->lock);
+
+        if(done || (moving && ++post_count >= post_ticks))
+        {
+            post_count = 0;
+            scanIoRequest(pcard->ramp_ioscan);
+        }
+    }
+}
+
+/****************************************************************/
+/* One line for ip231 report                                    */
+/****************************************************************/
+void ip231RampReport(IP231_ID pcard)
+{
+    int loop, active = 0;
+
+    for(loop = 0; loop < pcard->num_chnl; loop++)
+        if(pcard->ramp[loop].active) active++;
+
+    printf("\tRamp engine ticks every %gs, %lu steps written, %lu ticks late, %d channels ramping\n",
+           pcard->ramp_tick, (unsigned long)pcard->ramp_steps, (unsigned long)pcard->ramp_late, active);
+}
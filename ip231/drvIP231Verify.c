@@ -0,0 +1,142 @@
+/****************************************************************/
+/* This file implements the check of the IP231 shadow: records  */
+/* read back from memory, the bus is read only from here        */
+/****************************************************************/
+#include "drvIP231Lib.h"
+#include "drvIP231Private.h"
+#include "ipacBulk.h"
+#include <epicsStdio.h>
+
+static void ip231VerifyThread(void * arg);
+
+/****************************************************************/
+/* Read the data registers of all channels written so far and   */
+/* compare them with the shadow. Returns number of mismatches,  */
+/* or -1 if the card stays busy.                                */
+/****************************************************************/
+int ip231Verify(IP231_ID pcard)
+{
+    UINT16 hw_arr[MAX_IP231_16_CHANNELS];
+    UINT32 valid;
+    int loop, mismatches = 0;
+
+    if(!pcard) return -1;
+
+    epicsMutexLock(pcard->lock);
+
+    valid = pcard->shadow_valid;
+    if(ip231WaitReady(pcard, valid) != 0)
+    {
+        epicsMutexUnlock(pcard->lock);
+        return -1;
+    }
+
+    ipacBulkRead16(&(pcard->pHardware->data[0]), hw_arr, pcard->num_chnl, pcard->d32);
+
+    for(loop = 0; loop < pcard->num_chnl; loop++)
+    {
+        if(!(valid & (0x1 << loop))) continue;
+        if(hw_arr[loop] == pcard->shadow_dac[loop]) continue;
+
+        if(!mismatches)
+        {
+            errlogPrintf("IP231 %s: channel %d reads 0x%04X, driver wrote 0x%04X\n",
+                         pcard->cardname, loop, hw_arr[loop], pcard->shadow_dac[loop]);
+        }
+        mismatches++;
+        pcard->verify_last_chnl = loop;
+        pcard->verify_last_hw = hw_arr[loop];
+        pcard->verify_last_shadow = pcard->shadow_dac[loop];
+        epicsTimeGetCurrent(&(pcard->verify_last_time));
+    }
+    pcard->verify_mismatches += mismatches;
+    pcard->verify_passes++;
+
+    epicsMutexUnlock(pcard->lock);
+
+    return mismatches;
+}
+
+/****************************************************************************************************/
+/*  Routine: ip231VerifyEnable                                                                      */
+/*                                                                                                  */
+/*  Purpose: Periodically compare the IP-231 data registers with what the driver wrote              */
+/*                                                                                                  */
+/*  SYNOPSIS: int ip231VerifyEnable(                                                                */
+/*                  char *cardname,       Name given to ip231Create                                 */
+/*                  double period)        Seconds between two checks                                */
+/*  Example:                                                                                        */
+/*            ip231VerifyEnable("ip231_1", 10.0)                                                    */
+/*                                                                                                  */
+/*  Readbacks come from the shadow kept by the driver, so a DAC upset by something else is only     */
+/*  seen here. Mismatches are counted and shown by the ip231 report.                                */
+/****************************************************************************************************/
+int ip231VerifyEnable(char * cardname, double period)
+{
+    IP231_ID pcard;
+    epicsThreadId thread;
+    char name[32];
+
+    pcard = ip231GetByName(cardname);
+    if(!pcard)
+    {
+        errlogPrintf("ip231VerifyEnable: %s is not registered!\n", cardname);
+        return -1;
+    }
+
+    if(pcard->verify_thread)
+    {
+        errlogPrintf("ip231VerifyEnable: verify of %s is already enabled!\n", cardname);
+        return -1;
+    }
+
+    if(period <= 0.0)
+    {
+        errlogPrintf("ip231VerifyEnable: period %g is illegal for device %s\n", period, cardname);
+        return -1;
+    }
+
+    pcard->verify_period = period;
+
+    epicsSnprintf(name, sizeof(name), "%sVfy", cardname);
+    thread = epicsThreadCreate(name, IP231_VERIFY_PRIORITY, epicsThreadGetStackSize(epicsThreadStackSmall), ip231VerifyThread, pcard);
+    if(!thread)
+    {
+        errlogPrintf("ip231VerifyEnable: thread creation failed for device %s\n", cardname);
+        return -1;
+    }
+    pcard->verify_thread = thread;
+
+    return 0;
+}
+
+static void ip231VerifyThread(void * arg)
+{
+    IP231_ID pcard = (IP231_ID)arg;
+
+    while(TRUE)
+    {
+        epicsThreadSleep(pcard->verify_period);
+        if(ip231Verify(pcard) < 0)
+            errlogPrintf("IP231 %s: verify skipped, card stays busy\n", pcard->cardname);
+    }
+}
+
+/****************************************************************/
+/* One line for ip231 report                                    */
+/****************************************************************/
+void ip231VerifyReport(IP231_ID pcard)
+{
+    char timeStr[64];
+
+    if(!pcard->verify_passes) return;
+
+    printf("\tVerify: %lu passes, %lu mismatches", (unsigned long)pcard->verify_passes, (unsigned long)pcard->verify_mismatches);
+    if(pcard->verify_mismatches)
+    {
+        epicsTimeToStrftime(timeStr, sizeof(timeStr), "%Y/%m/%d %H:%M:%S", &(pcard->verify_last_time));
+        printf(", last on channel %d at %s read 0x%04X wrote 0x%04X",
+               pcard->verify_last_chnl, timeStr, pcard->verify_last_hw, pcard->verify_last_shadow);
+    }
+    printf("\n");
+}
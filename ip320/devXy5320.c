@@ -106,6 +106,7 @@ static long init_ai( struct aiRecord *pai )
           ptr = xy5320FindCard(pxip->name);
           if( ptr )
           {
+            pxip->card = ptr;
             status = xy5320FindChannel(ptr, pxip->channel, &chanIndex);
             if( status )
             {
@@ -114,8 +115,9 @@ static long init_ai( struct aiRecord *pai )
             }
             else
             {
-              pai->dpvt = pxip;
-              status    = xy5320ReadChannel( pxip->name, pxip->channel, TYPE_DOUBLE, &value );
+              pai->dpvt   = pxip;
+              pxip->index = chanIndex;
+              status      = xy5320ReadChannelIndex( pxip->card, pxip->index, TYPE_DOUBLE, &value );
               if( status )
               {
                 handleError(pai, &status, S_xy5320_readError,
@@ -174,6 +176,7 @@ static long init_wf( struct waveformRecord *pwf )
           ptr = xy5320FindCard(pxip->name);
           if( ptr )
           {
+            pxip->card   = ptr;
             maxChanIndex = xy5320GetNumChan(ptr) - 1;
             if( (pxip->channel < 0) || (pxip->channel > maxChanIndex) )
             {
@@ -191,7 +194,7 @@ static long init_wf( struct waveformRecord *pwf )
                   fieldType = TYPE_LONG;
                 else
                   fieldType = TYPE_DOUBLE;
-                status = xy5320ReadArray( pxip->name, pxip->channel, pwf->nelm, fieldType, pwf->bptr );
+                status = xy5320ReadArrayCard( pxip->card, pxip->channel, pwf->nelm, fieldType, pwf->bptr );
                 if( status )
                 {
                   handleError(pwf, &status, S_xy5320_readError, 
@@ -232,7 +235,7 @@ static long read_ai( struct aiRecord *pai )
   int      status;
 	
   pxip   = (xipIo_t *)pai->dpvt;
-  status = xy5320ReadChannel( pxip->name, pxip->channel, TYPE_DOUBLE, &value );
+  status = xy5320ReadChannelIndex( pxip->card, pxip->index, TYPE_DOUBLE, &value );
   if( status )
   {
     handleError(pai, &status, S_xy5320_readError, "devAiXy5320 (read_ai) read error", FALSE);
@@ -263,7 +266,7 @@ static long read_wf( struct waveformRecord *pwf )
       fieldType = TYPE_LONG;
     else
       fieldType = TYPE_DOUBLE;
-    status = xy5320ReadArray( pxip->name, pxip->channel, pwf->nelm, fieldType, pwf->bptr );
+    status = xy5320ReadArrayCard( pxip->card, pxip->channel, pwf->nelm, fieldType, pwf->bptr );
     if( status )
     {
       handleError(pwf, &status, S_xy5320_readError, "devWfXy5320 (read_wf) read error", FALSE);
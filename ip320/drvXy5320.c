@@ -44,6 +44,7 @@ Copyright (c) 2002 Andy Foster
 
 #include "drvIpac.h"
 #include "drvXy5320.h"
+#include "ipacRegistry.h"
 
 #define DEBUG 0
 
@@ -52,6 +53,7 @@ Copyright (c) 2002 Andy Foster
 #define IP_MODEL_XYCOM_5320   0x32
 
 LOCAL struct config5320 *ptrXy5320First = NULL;
+LOCAL const char xy5320RegType[] = "IP320";
 
 #define XY5320_CAL_NAME   "xy5320Cal"
 #define XY5320_CAL_PRI    170
@@ -299,6 +301,12 @@ int xy5320Create( char *pName, ushort_t card, ushort_t slot, char *voltRangeName
     return S_xy5320_notValidated;
   }
 
+  if( xy5320FindCard( pName ) || ipacRegFindByLocation( NULL, card, slot ) )
+  {
+    printf("xy5320Create: Duplicate device (%s, %d, %d)\n", pName, card, slot);
+    return S_xy5320_duplicateDevice;
+  }
+
   if( !ptrXy5320First )
   {
     ptrXy5320First = malloc(sizeof(struct config5320));
@@ -315,16 +323,11 @@ int xy5320Create( char *pName, ushort_t card, ushort_t slot, char *voltRangeName
   }
   else
   {
-    /* Check for unique card */
+    /* Find the end of the list */
 
     plist = ptrXy5320First;
     while( TRUE )
     {
-      if( !strcmp(plist->pName, pName) || ((plist->card == card) && (plist->slot == slot)) )
-      {
-        printf("xy5320Create: Duplicate device (%s, %d, %d)\n", pName, card, slot);
-        return S_xy5320_duplicateDevice;
-      }
       if( plist->pnext == NULL )
         break;
       else
@@ -497,6 +500,17 @@ long xy5320SetConfig( char *pName, ushort_t card, ushort_t slot,
     status = S_xy5320_fileOpenFailed;
   }
 
+  if( !status )
+  {
+    /* Register for constant-time lookup by name and location */
+    if( ipacRegAdd( xy5320RegType, pName, card, slot, pconfig ) )
+    {
+      printf("Error! xy5320SetConfig: Failed to register device (%s, %d, %d)\n", pName, card, slot);
+      semDelete( pconfig->semId );
+      status = S_xy5320_duplicateDevice;
+    }
+  }
+
   if( status )
   {
     pconfig->pnext      = NULL;
@@ -892,91 +906,123 @@ long xy5320ReadChannel( char *name, int channel, unsigned long ftvl, void *prval
       return S_xy5320_invalidChannel;
     }
     else
-    {
-      semTake(plist->semId, WAIT_FOREVER);
-      if( ftvl == TYPE_LONG )
-        *(long *)prval = plist->cor_data[chanIndex];
-      else if( ftvl == TYPE_DOUBLE )
-        *(double *)prval = plist->analogData[chanIndex];
-      else
-      {
-        printf("xy5320ReadChannel: Invalid field type %ld\n", ftvl);
-        semGive(plist->semId);
-        return S_xy5320_invalidFieldType;
-      }
-      semGive(plist->semId);
-    }
+      return xy5320ReadChannelIndex( plist, chanIndex, ftvl, prval );
   }
   else
   {
     printf("xy5320ReadChannel: Card %s not found\n", name);
     return S_xy5320_cardNotFound;
   }
+}
+
+
+/* Same as xy5320ReadChannel, but takes the card handle from xy5320FindCard */
+/* and the channel index from xy5320FindChannel, so no lookups at run time  */
+long xy5320ReadChannelIndex( void *ptr, int chanIndex, unsigned long ftvl, void *prval )
+{
+  struct config5320 *plist;
+
+  plist = (struct config5320 *)ptr;
+  if( !plist )
+  {
+    printf("xy5320ReadChannelIndex: NULL card handle\n");
+    return S_xy5320_cardNotFound;
+  }
+  else if( (chanIndex < 0) || (chanIndex > plist->numChannels - 1) )
+  {
+    printf("xy5320ReadChannelIndex: Card %s, invalid channel index (%d)\n", plist->pName, chanIndex);
+    return S_xy5320_invalidChannelIndex;
+  }
+
+  semTake(plist->semId, WAIT_FOREVER);
+  if( ftvl == TYPE_LONG )
+    *(long *)prval = plist->cor_data[chanIndex];
+  else if( ftvl == TYPE_DOUBLE )
+    *(double *)prval = plist->analogData[chanIndex];
+  else
+  {
+    printf("xy5320ReadChannelIndex: Invalid field type %ld\n", ftvl);
+    semGive(plist->semId);
+    return S_xy5320_invalidFieldType;
+  }
+  semGive(plist->semId);
   return(OK);
 }
 
 
 long xy5320ReadArray( char *name, int startIndex, int space, unsigned long ftvl, void *prval )
+{
+  struct config5320 *plist;
+
+  plist = xy5320FindCard( name );
+  if( !plist )
+  {
+    printf("xy5320ReadArray: Card %s not found\n", name);
+    return S_xy5320_cardNotFound;
+  }
+  return xy5320ReadArrayCard( plist, startIndex, space, ftvl, prval );
+}
+
+
+long xy5320ReadArrayCard( void *ptr, int startIndex, int space, unsigned long ftvl, void *prval )
 {
   struct config5320 *plist;
   int               i;
   int               numRead;
   int               numChan;
 
-  plist = xy5320FindCard( name );
-  if( plist )
+  plist = (struct config5320 *)ptr;
+  if( !plist )
   {
-    if( (startIndex < 0) || (startIndex > plist->numChannels - 1) )
-    {
-      printf("xy5320ReadArray: Card %s, invalid channel index (%d)\n", name, startIndex);
-      return S_xy5320_invalidChannelIndex;
-    }
-    else if( space <= 0 )
-    {
-      printf("xy5320ReadArray: Insufficient space for array values (%s)\n", name);
-      return S_xy5320_noSpace;
-    }
+    printf("xy5320ReadArrayCard: NULL card handle\n");
+    return S_xy5320_cardNotFound;
+  }
+
+  if( (startIndex < 0) || (startIndex > plist->numChannels - 1) )
+  {
+    printf("xy5320ReadArray: Card %s, invalid channel index (%d)\n", plist->pName, startIndex);
+    return S_xy5320_invalidChannelIndex;
+  }
+  else if( space <= 0 )
+  {
+    printf("xy5320ReadArray: Insufficient space for array values (%s)\n", plist->pName);
+    return S_xy5320_noSpace;
+  }
+  else
+  {
+    numChan = (space - 1)/2;
+    if( startIndex+numChan <= plist->numChannels )
+      numRead = numChan;
     else
-    {
-      numChan = (space - 1)/2;
-      if( startIndex+numChan <= plist->numChannels )
-        numRead = numChan;
-      else
-        numRead = plist->numChannels - startIndex;
+      numRead = plist->numChannels - startIndex;
 
-      semTake(plist->semId, WAIT_FOREVER);
-        
-      if( ftvl == TYPE_LONG )
-      {
-        *((long *)prval) = numRead;
-        for( i=0; i<numRead; i++ )
-        {
-          *((long *)prval+i+1)         = plist->s_array[startIndex+i].chan;
-          *((long *)prval+i+1+numRead) = plist->cor_data[startIndex+i];
-        }
-      }
-      else if( ftvl == TYPE_DOUBLE )
+    semTake(plist->semId, WAIT_FOREVER);
+      
+    if( ftvl == TYPE_LONG )
+    {
+      *((long *)prval) = numRead;
+      for( i=0; i<numRead; i++ )
       {
-        *((double *)prval) = numRead;
-        for( i=0; i<numRead; i++ )
-        {
-          *((double *)prval+i+1)         = plist->s_array[startIndex+i].chan;
-          *((double *)prval+i+1+numRead) = plist->analogData[startIndex+i];
-        }
+        *((long *)prval+i+1)         = plist->s_array[startIndex+i].chan;
+        *((long *)prval+i+1+numRead) = plist->cor_data[startIndex+i];
       }
-      else
+    }
+    else if( ftvl == TYPE_DOUBLE )
+    {
+      *((double *)prval) = numRead;
+      for( i=0; i<numRead; i++ )
       {
-        printf("xy5320ReadArray: Invalid field type %ld\n", ftvl);
-        semGive(plist->semId);
-        return S_xy5320_invalidFieldType;
+        *((double *)prval+i+1)         = plist->s_array[startIndex+i].chan;
+        *((double *)prval+i+1+numRead) = plist->analogData[startIndex+i];
       }
+    }
+    else
+    {
+      printf("xy5320ReadArray: Invalid field type %ld\n", ftvl);
       semGive(plist->semId);
+      return S_xy5320_invalidFieldType;
     }
-  }
-  else
-  {
-    printf("xy5320ReadArray: Card %s not found\n", name);
-    return S_xy5320_cardNotFound;
+    semGive(plist->semId);
   }
   return(OK);
 }
@@ -1021,24 +1067,7 @@ int xy5320GetNumChan( void *ptr )
 
 void *xy5320FindCard( char *name )
 {
-  struct config5320 *plist;
-  int               foundCard = 0;
-
-  plist = ptrXy5320First;
-  while( plist )
-  {
-    if( !strcmp(plist->pName, name) )
-    {
-      foundCard = 1;
-      break;
-    }
-    plist = plist->pnext;
-  }
-
-  if( !foundCard )
-    return NULL;
-  else
-    return plist;
+  return ipacRegFindByName( xy5320RegType, name );
 }
 
 
@@ -201,8 +201,11 @@ void           xy5320ReadInputs( struct config5320 *pconfig );
 unsigned short xy5320BuildControl( struct config5320 *pconfig, int index );
 void           xy5320CorrectInputs( struct config5320 *pconfig );
 long           xy5320ReadChannel( char *name, int channel, unsigned long ftvl, void *prval );
+long           xy5320ReadChannelIndex( void *ptr, int chanIndex, unsigned long ftvl, void *prval );
 long           xy5320ReadArray( char *name, int startIndex, int numChan, unsigned long ftvl,
                                 void *prval );
+long           xy5320ReadArrayCard( void *ptr, int startIndex, int space, unsigned long ftvl,
+                                    void *prval );
 int            xy5320GetNumChan( void *ptr );
 void          *xy5320FindCard( char *name );
 int            xy5320FindChannel( void *ptr, int channel, int *chanIndex );
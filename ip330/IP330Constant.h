@@ -66,9 +66,14 @@ static const char * scanModeName[N_SCANMODES] = {"disable","uniformCont","unifor
 #define TRG_DIR_OUTPUT			1
 static const char * trgDirName[N_TRGDIRS] = {"Input","Output"};
 
-#define MAX_AVG_TIMES			256
+/* Boxcar averages up to MAX_AVG_TIMES samples, 64-bit sums keep the fixed point read exact */
+#define MAX_AVG_TIMES			0x100000
 static const char * avgFormat = "Avg%d";
 
+/* Exponential moving average, alpha is 1/2^shift, published every N samples: "Ema<shift>x<N>" */
+#define MAX_EMA_SHIFT			16
+static const char * emaFormat = "Ema%dx%d";
+
 #define MIN_TIMER_PRESCALER		0x40
 #define MAX_TIMER_PRESCALER		0xFF
 #define MIN_CONVERSION_TIMER		0x1
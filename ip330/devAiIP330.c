@@ -36,20 +36,23 @@
 /* define function flags */
 typedef enum {
         IP330_AI_DATA,
+        IP330_AI_WIDE,
 } IP330FUNC;
 
 static struct PARAM_MAP
 {
         char param[MAX_CA_STRING_SIZE];
         int  funcflag;
-} param_map[1] = {
-    {"DATA", IP330_AI_DATA}
+} param_map[2] = {
+    {"DATA", IP330_AI_DATA},
+    {"WIDE", IP330_AI_WIDE}	/* RVAL carries IP330_WIDE_FRAC_BITS more bits */
 };
 #define N_PARAM_MAP (sizeof(param_map)/sizeof(struct PARAM_MAP))
 
 typedef struct IP330_DEVDATA
 {
     IP330_ID	pcard;
+    IP330_GROUP_ID	pgroup;		/* Group of ip330Create unless INP names another one */
     UINT16	chnlnum;
     int		funcflag;
 } IP330_DEVDATA;
@@ -65,6 +68,8 @@ static int IP330_DevData_Init(dbCommon * precord, char * ioString)
     IP330_ID	pcard;
     int		chnlnum;
     char	param[MAX_CA_STRING_SIZE];
+    char	groupname[MAX_CA_STRING_SIZE] = "";
+    IP330_GROUP_ID	pgroup;
     int		funcflag = 0;
 
     IP330_DEVDATA *   pdevdata;
@@ -78,8 +83,9 @@ static int IP330_DevData_Init(dbCommon * precord, char * ioString)
     }
 
     /* analyze INP/OUT string */
-    count = sscanf(ioString, "%[^:]:%i:%[^:]", cardname, &chnlnum, param);
-    if (count != 3)
+    /* "card:channel:param" or "card:channel:param:group" */
+    count = sscanf(ioString, "%[^:]:%i:%[^:]:%[^:]", cardname, &chnlnum, param, groupname);
+    if (count != 3 && count != 4)
     {
         errlogPrintf("Record %s INP/OUT string %s format is illegal!\n", precord->name, ioString);
         return -1;
@@ -92,12 +98,6 @@ static int IP330_DevData_Init(dbCommon * precord, char * ioString)
         return -1;
     }
 
-    if(chnlnum < 0 || chnlnum > 32 )
-    {/* chnlnum is UINT16, more accurate check again start/end channel will be done in ip330Read */
-        errlogPrintf("Record %s channel number %d is out of range for IP330 %s!\n", precord->name, chnlnum, cardname);
-        return -1;
-    }
-
     for(loop=0; loop<N_PARAM_MAP; loop++)
     {
         if( 0 == strcmp(param_map[loop].param, param) )
@@ -112,10 +112,26 @@ static int IP330_DevData_Init(dbCommon * precord, char * ioString)
         return -1;
     }
 
+    pgroup = ip330GetGroup(pcard, groupname);
+    if( !pgroup )
+    {
+        errlogPrintf("Record %s IP330 %s has no group %s!\n", precord->name, cardname, groupname);
+        return -1;
+    }
+
+    /* The reads would only fail at every scan */
+    if( !ip330GroupHasChannel(pgroup, chnlnum) )
+    {
+        errlogPrintf("Record %s channel number %d is out of range for IP330 %s group %s!\n", precord->name, chnlnum, cardname, groupname[0] ? groupname : "of ip330Create");
+        return -1;
+    }
+
     pdevdata = (IP330_DEVDATA *)callocMustSucceed(1, sizeof(IP330_DEVDATA), "Init record for IP330");
 
     pdevdata->pcard = pcard;
+    pdevdata->pgroup = pgroup;
     pdevdata->chnlnum = chnlnum;
+    ip330UseChannel(pcard, chnlnum);
     pdevdata->funcflag = funcflag;
 
     precord->dpvt = (void *)pdevdata;
@@ -123,6 +139,8 @@ static int IP330_DevData_Init(dbCommon * precord, char * ioString)
 }
 
 
+static long ai_lincvt(struct aiRecord   *pai, int after);
+
 static long init_ai( struct aiRecord * pai)
 {
     pai->dpvt = NULL;
@@ -133,9 +151,6 @@ static long init_ai( struct aiRecord * pai)
         pai->pact=TRUE;
         return (S_db_badField);
     }
-    pai->eslo = (pai->eguf - pai->egul)/(float)0x10000;
-    pai->roff = 0x0;
-
     if(IP330_DevData_Init((dbCommon *) pai, pai->inp.value.instio.string) != 0)
     {
         errlogPrintf("Fail to init devdata for record %s!\n", pai->name);
@@ -144,6 +159,8 @@ static long init_ai( struct aiRecord * pai)
         return (S_db_badField);
     }
 
+    ai_lincvt(pai, TRUE);
+
     return 0;
 }
 
@@ -153,7 +170,7 @@ static long ai_ioint_info(int cmd,aiRecord *pai,IOSCANPVT *iopvt)
 {
     IP330_DEVDATA * pdevdata = (IP330_DEVDATA *)(pai->dpvt);
 
-    *iopvt = *ip330GetIoScanPVT(pdevdata->pcard);
+    *iopvt = *ip330GroupGetIoScanPVT(pdevdata->pgroup);
     return 0;
 }
 
@@ -167,7 +184,10 @@ static long read_ai(struct aiRecord *pai)
     switch(pdevdata->funcflag)
     {
     case IP330_AI_DATA:
-        status = ip330Read(pdevdata->pcard, pdevdata->chnlnum, &tmp);
+        status = ip330GroupReadSeq(pdevdata->pgroup, pdevdata->chnlnum, &tmp, NULL);
+        break;
+    case IP330_AI_WIDE:
+        status = ip330GroupReadWide(pdevdata->pgroup, pdevdata->chnlnum, &tmp, NULL);
         break;
     }
 
@@ -187,10 +207,14 @@ static long read_ai(struct aiRecord *pai)
 
 static long ai_lincvt(struct aiRecord   *pai, int after)
 {
+        IP330_DEVDATA * pdevdata = (IP330_DEVDATA *)(pai->dpvt);
 
         if(!after) return(0);
         /* set linear conversion slope*/
-        pai->eslo = (pai->eguf - pai->egul)/(float)0x10000;
+        if(pdevdata && pdevdata->funcflag == IP330_AI_WIDE)
+            pai->eslo = (pai->eguf - pai->egul)/((float)0x10000 * (1 << IP330_WIDE_FRAC_BITS));
+        else
+            pai->eslo = (pai->eguf - pai->egul)/(float)0x10000;
         pai->roff = 0x0;
         return(0);
 }
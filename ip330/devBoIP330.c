@@ -36,14 +36,18 @@
 /* define function flags */
 typedef enum {
         IP330_START_CONVERT,
+        IP330_HISTORY_FREEZE,
+        IP330_INTERLOCK_RESET,
 } IP330FUNC;
 
 static struct PARAM_MAP
 {
         char param[MAX_CA_STRING_SIZE];
         int  funcflag;
-} param_map[1] = {
-    {"START", IP330_START_CONVERT}
+} param_map[3] = {
+    {"START", IP330_START_CONVERT},
+    {"FREEZE", IP330_HISTORY_FREEZE},	/* 1 freezes the post-mortem history, 0 rearms it */
+    {"ILK_RESET", IP330_INTERLOCK_RESET}	/* 1 releases the interlock output */
 };
 #define N_PARAM_MAP (sizeof(param_map)/sizeof(struct PARAM_MAP))
 
@@ -64,6 +68,7 @@ static int IP330_DevData_Init(dbCommon * precord, char * ioString)
     char	cardname[MAX_CA_STRING_SIZE];
     IP330_ID	pcard;
     char	param[MAX_CA_STRING_SIZE];
+    char	chnlparam[MAX_CA_STRING_SIZE];
     int		funcflag = 0;
 
     IP330_DEVDATA *   pdevdata;
@@ -77,8 +82,10 @@ static int IP330_DevData_Init(dbCommon * precord, char * ioString)
     }
 
     /* analyze INP/OUT string */
-    count = sscanf(ioString, "%[^:]:%[^:]", cardname, param);
-    if (count != 2)
+    /* "card:param", or "card:channel:param" like the other records, channel is ignored */
+    count = sscanf(ioString, "%[^:]:%[^:]:%[^:]", cardname, param, chnlparam);
+    if (count == 3) strcpy(param, chnlparam);
+    if (count != 2 && count != 3)
     {
         errlogPrintf("Record %s INP/OUT string %s format is illegal!\n", precord->name, ioString);
         return -1;
@@ -153,6 +160,16 @@ static long write_bo(struct boRecord *pbo)
         if (pbo->val) ip330StartConvert(pdevdata->pcard);
         status = 0;
         break;
+    case IP330_HISTORY_FREEZE:
+        if (pbo->val)
+            status = ip330HistoryFreeze(pdevdata->pcard);
+        else
+            status = ip330HistoryRearm(pdevdata->pcard);
+        break;
+    case IP330_INTERLOCK_RESET:
+        if (pbo->val) status = ip330InterlockReset(pdevdata->pcard);
+        else status = 0;
+        break;
     }
 
     if(status)
@@ -0,0 +1,215 @@
+/****************************************************************/
+/* This file implements longin and int64in record device        */
+/* support for the IP330 error counters, see ip330GetCounter    */
+/****************************************************************/
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsVersion.h>
+
+#if (EPICS_VERSION>=7) || (EPICS_VERSION>=3 && EPICS_REVISION>=14)
+#include <epicsExport.h>
+#endif
+
+#include <devLib.h>
+#include <dbAccess.h>
+#include <dbScan.h>
+#include <callback.h>
+#include <link.h>
+#include <recSup.h>
+#include <recGbl.h>
+#include <devSup.h>
+#include <drvSup.h>
+#include <dbCommon.h>
+#include <alarm.h>
+#include <cantProceed.h>
+#include <longinRecord.h>
+#include <int64inRecord.h>
+#include <errlog.h>
+
+#include <ptypes.h>
+#include <drvIP330Lib.h>
+
+#define MAX_CA_STRING_SIZE (40)
+
+static struct PARAM_MAP
+{
+        char param[MAX_CA_STRING_SIZE];
+        int  counter;
+        int  per_channel;
+} param_map[7] = {
+    {"MISSED", IP330_CNT_MISSED, 0},
+    {"PARTIAL", IP330_CNT_PARTIAL, 0},
+    {"UNEXPECTED", IP330_CNT_UNEXPECTED, 0},
+    {"SCAN_DROPPED", IP330_CNT_SCAN_DROPPED, 0},
+    {"OVERFLOW", IP330_CNT_OVERFLOW, 0},
+    {"CH_MISSED", IP330_CNT_MISSED, 1},
+    {"CH_PARTIAL", IP330_CNT_PARTIAL, 1}
+};
+#define N_PARAM_MAP (sizeof(param_map)/sizeof(struct PARAM_MAP))
+
+typedef struct IP330_DEVDATA
+{
+    IP330_ID	pcard;
+    int		chnlnum;	/* -1 for the card total */
+    int		counter;
+} IP330_DEVDATA;
+
+/* This function will be called by all device support */
+/* The memory for IP330_DEVDATA will be malloced inside */
+static int IP330_DevData_Init(dbCommon * precord, char * ioString)
+{
+    int		count;
+    int		loop;
+
+    char	cardname[MAX_CA_STRING_SIZE];
+    IP330_ID	pcard;
+    int		chnlnum;
+    char	param[MAX_CA_STRING_SIZE];
+
+    IP330_DEVDATA *   pdevdata;
+
+    /* param check */
+    if(precord == NULL || ioString == NULL)
+    {
+        if(!precord) errlogPrintf("No legal record pointer!\n");
+        if(!ioString) errlogPrintf("No INP/OUT field for record %s!\n", precord->name);
+        return -1;
+    }
+
+    /* analyze INP/OUT string */
+    count = sscanf(ioString, "%[^:]:%i:%[^:]", cardname, &chnlnum, param);
+    if (count != 3)
+    {
+        errlogPrintf("Record %s INP/OUT string %s format is illegal!\n", precord->name, ioString);
+        return -1;
+    }
+
+    pcard = ip330GetByName(cardname);
+    if( !pcard )
+    {
+        errlogPrintf("Record %s IP330 %s is not registered!\n", precord->name, cardname);
+        return -1;
+    }
+
+    for(loop=0; loop<N_PARAM_MAP; loop++)
+    {
+        if( 0 == strcmp(param_map[loop].param, param) ) break;
+    }
+    if(loop >= N_PARAM_MAP)
+    {
+        errlogPrintf("Record %s param %s is illegal!\n", precord->name, param);
+        return -1;
+    }
+
+    if(!param_map[loop].per_channel)
+    {/* Card total, channel number is ignored */
+        chnlnum = -1;
+    }
+    else if(chnlnum < 0 || chnlnum >= 32 )
+    {
+        errlogPrintf("Record %s channel number %d is out of range for IP330 %s!\n", precord->name, chnlnum, cardname);
+        return -1;
+    }
+
+    pdevdata = (IP330_DEVDATA *)callocMustSucceed(1, sizeof(IP330_DEVDATA), "Init record for IP330");
+
+    pdevdata->pcard = pcard;
+    pdevdata->chnlnum = chnlnum;
+    pdevdata->counter = param_map[loop].counter;
+
+    precord->dpvt = (void *)pdevdata;
+    return 0;
+}
+
+static long IP330_Counter_Init(dbCommon * precord, struct link * plink)
+{
+    precord->dpvt = NULL;
+
+    if (plink->type!=INST_IO)
+    {
+        recGblRecordError(S_db_badField, (void *)precord, "devLiIP330 Init_record, Illegal INP");
+        precord->pact=TRUE;
+        return (S_db_badField);
+    }
+
+    if(IP330_DevData_Init(precord, plink->value.instio.string) != 0)
+    {
+        errlogPrintf("Fail to init devdata for record %s!\n", precord->name);
+        recGblRecordError(S_db_badField, (void *) precord, "Init devdata Error");
+        precord->pact = TRUE;
+        return (S_db_badField);
+    }
+
+    return 0;
+}
+
+static long IP330_Counter_Read(dbCommon * precord, epicsUInt64 * pvalue)
+{
+    IP330_DEVDATA * pdevdata = (IP330_DEVDATA *)(precord->dpvt);
+
+    if(ip330GetCounter(pdevdata->pcard, pdevdata->counter, pdevdata->chnlnum, pvalue) != 0)
+    {
+        precord->udf=TRUE;
+        recGblSetSevr(precord, READ_ALARM, INVALID_ALARM);
+        return -1;
+    }
+
+    precord->udf = FALSE;
+    return 0;
+}
+
+static long init_li(struct longinRecord * pli)
+{
+    return IP330_Counter_Init((dbCommon *)pli, &(pli->inp));
+}
+
+static long init_i64in(struct int64inRecord * pi64in)
+{
+    return IP330_Counter_Init((dbCommon *)pi64in, &(pi64in->inp));
+}
+
+/** for sync scan records  **/
+static long li_ioint_info(int cmd, dbCommon * precord, IOSCANPVT * iopvt)
+{
+    IP330_DEVDATA * pdevdata = (IP330_DEVDATA *)(precord->dpvt);
+
+    *iopvt = *ip330GetIoScanPVT(pdevdata->pcard);
+    return 0;
+}
+
+/* longin wraps around like the counter does on a 32 bits target */
+static long read_li(struct longinRecord * pli)
+{
+    epicsUInt64 value;
+
+    if(IP330_Counter_Read((dbCommon *)pli, &value) != 0) return -1;
+    pli->val = (epicsInt32)value;
+    return 0;
+}
+
+static long read_i64in(struct int64inRecord * pi64in)
+{
+    epicsUInt64 value;
+
+    if(IP330_Counter_Read((dbCommon *)pi64in, &value) != 0) return -1;
+    pi64in->val = (epicsInt64)value;
+    return 0;
+}
+
+struct IP330_DEV_SUP_SET
+{
+    long            number;
+    DEVSUPFUN       report;
+    DEVSUPFUN       init;
+    DEVSUPFUN       init_record;
+    DEVSUPFUN       get_ioint_info;
+    DEVSUPFUN       read;
+} devLiIP330 = {5, NULL, NULL, init_li, li_ioint_info, read_li},
+  devI64inIP330 = {5, NULL, NULL, init_i64in, li_ioint_info, read_i64in};
+
+#if (EPICS_VERSION>=7) || (EPICS_VERSION>=3 && EPICS_REVISION>=14)
+epicsExportAddress(dset, devLiIP330);
+epicsExportAddress(dset, devI64inIP330);
+#endif
+
@@ -0,0 +1,376 @@
+/****************************************************************/
+/* This file implements waveform and aai record device support  */
+/* for whole IP330 frames and the raw sample stream             */
+/****************************************************************/
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsVersion.h>
+
+#if (EPICS_VERSION>=7) || (EPICS_VERSION>=3 && EPICS_REVISION>=14)
+#include <epicsExport.h>
+#endif
+
+#include <devLib.h>
+#include <dbAccess.h>
+#include <dbScan.h>
+#include <callback.h>
+#include <link.h>
+#include <recSup.h>
+#include <recGbl.h>
+#include <devSup.h>
+#include <drvSup.h>
+#include <dbCommon.h>
+#include <alarm.h>
+#include <cantProceed.h>
+#include <menuFtype.h>
+#include <waveformRecord.h>
+#include <aaiRecord.h>
+#include <errlog.h>
+
+#include <ptypes.h>
+#include <drvIP330Lib.h>
+
+#define MAX_CA_STRING_SIZE (40)
+
+/* define function flags */
+typedef enum {
+        IP330_WF_STREAM,
+        IP330_WF_FRAME,
+        IP330_WF_FRAME_RAW,
+        IP330_WF_SAMPLES,
+        IP330_WF_HISTORY,
+        IP330_WF_SYNC,
+} IP330FUNC;
+
+static struct PARAM_MAP
+{
+        char param[MAX_CA_STRING_SIZE];
+        int  funcflag;
+} param_map[6] = {
+    {"STREAM", IP330_WF_STREAM},	/* One channel of the raw stream */
+    {"FRAME", IP330_WF_FRAME},		/* Calibrated average of all channels, one frame */
+    {"FRAME_RAW", IP330_WF_FRAME_RAW},	/* Same without calibration */
+    {"SAMPLES", IP330_WF_SAMPLES},	/* All channels of the raw stream, frame after frame */
+    {"HISTORY", IP330_WF_HISTORY},	/* One channel of the frozen post-mortem history */
+    {"SYNC", IP330_WF_SYNC}		/* All channels of all cards of ip330SyncCreate, one combined frame */
+};
+#define N_PARAM_MAP (sizeof(param_map)/sizeof(struct PARAM_MAP))
+
+typedef struct IP330_DEVDATA
+{
+    IP330_ID	pcard;
+    IP330_GROUP_ID	pgroup;		/* Group of ip330Create unless INP names another one */
+    IP330_SYNC_ID	psync;		/* Only for SYNC */
+    UINT16	chnlnum;
+    int		funcflag;
+    UINT32	cursor;		/* Next stream frame this record reads */
+    UINT32	lost;		/* Frames overwritten before this record read them */
+} IP330_DEVDATA;
+
+/* This function will be called by all device support */
+/* The memory for IP330_DEVDATA will be malloced inside */
+static int IP330_DevData_Init(dbCommon * precord, char * ioString)
+{
+    int		count;
+    int		loop;
+
+    char	cardname[MAX_CA_STRING_SIZE];
+    IP330_ID	pcard;
+    int		chnlnum;
+    char	param[MAX_CA_STRING_SIZE];
+    char	groupname[MAX_CA_STRING_SIZE] = "";
+    IP330_GROUP_ID	pgroup;
+    IP330_SYNC_ID	psync = NULL;
+    int		funcflag = 0;
+    UINT32	cursor;
+
+    IP330_DEVDATA *   pdevdata;
+
+    /* param check */
+    if(precord == NULL || ioString == NULL)
+    {
+        if(!precord) errlogPrintf("No legal record pointer!\n");
+        if(!ioString) errlogPrintf("No INP/OUT field for record %s!\n", precord->name);
+        return -1;
+    }
+
+    /* analyze INP/OUT string */
+    /* "card:channel:param" or "card:channel:param:group" */
+    count = sscanf(ioString, "%[^:]:%i:%[^:]:%[^:]", cardname, &chnlnum, param, groupname);
+    if (count != 3 && count != 4)
+    {
+        errlogPrintf("Record %s INP/OUT string %s format is illegal!\n", precord->name, ioString);
+        return -1;
+    }
+
+    pcard = ip330GetByName(cardname);
+    if( !pcard )
+    {
+        errlogPrintf("Record %s IP330 %s is not registered!\n", precord->name, cardname);
+        return -1;
+    }
+
+    if(chnlnum < 0 || chnlnum > 32 )
+    {/* chnlnum is UINT16, stream and history channels are checked against the card range below, others ignore it */
+        errlogPrintf("Record %s channel number %d is out of range for IP330 %s!\n", precord->name, chnlnum, cardname);
+        return -1;
+    }
+
+    for(loop=0; loop<N_PARAM_MAP; loop++)
+    {
+        if( 0 == strcmp(param_map[loop].param, param) )
+        {
+            funcflag = param_map[loop].funcflag;
+            break;
+        }
+    }
+    if(loop >= N_PARAM_MAP)
+    {
+        errlogPrintf("Record %s param %s is illegal!\n", precord->name, param);
+        return -1;
+    }
+
+    if(funcflag == IP330_WF_FRAME || funcflag == IP330_WF_FRAME_RAW)
+    {/* Frames come from the averaging, no stream needed */
+        cursor = 0;
+    }
+    else if(funcflag == IP330_WF_HISTORY)
+    {
+        if(!ip330HistoryGetIoScanPVT(pcard))
+        {
+            errlogPrintf("Record %s IP330 %s has no history, call ip330HistoryCreate first!\n", precord->name, cardname);
+            return -1;
+        }
+        cursor = 0;
+    }
+    else if(funcflag == IP330_WF_SYNC)
+    {
+        psync = ip330SyncGet(pcard);
+        if(!psync)
+        {
+            errlogPrintf("Record %s IP330 %s is not synchronized, call ip330SyncCreate first!\n", precord->name, cardname);
+            return -1;
+        }
+        cursor = 0;
+    }
+    else if(ip330StreamOpen(pcard, &cursor) != 0)
+    {
+        errlogPrintf("Record %s IP330 %s has no raw stream, call ip330StreamEnable first!\n", precord->name, cardname);
+        return -1;
+    }
+
+    pgroup = ip330GetGroup(pcard, groupname);
+    if( !pgroup )
+    {
+        errlogPrintf("Record %s IP330 %s has no group %s!\n", precord->name, cardname, groupname);
+        return -1;
+    }
+
+    if( (funcflag == IP330_WF_STREAM || funcflag == IP330_WF_HISTORY) && !ip330GroupHasChannel(ip330GetGroup(pcard, NULL), chnlnum) )
+    {
+        errlogPrintf("Record %s channel number %d is not scanned by IP330 %s!\n", precord->name, chnlnum, cardname);
+        return -1;
+    }
+
+    pdevdata = (IP330_DEVDATA *)callocMustSucceed(1, sizeof(IP330_DEVDATA), "Init record for IP330");
+
+    pdevdata->pcard = pcard;
+    pdevdata->pgroup = pgroup;
+    pdevdata->psync = psync;
+    pdevdata->chnlnum = chnlnum;
+    pdevdata->funcflag = funcflag;
+    pdevdata->cursor = cursor;
+    if(psync)
+        ip330SyncUseChannels(psync);
+    else
+        ip330UseChannel(pcard, (funcflag == IP330_WF_STREAM || funcflag == IP330_WF_HISTORY) ? chnlnum : -1);
+
+    precord->dpvt = (void *)pdevdata;
+    return 0;
+}
+
+/* Common part of waveform and aai, they have the same array fields */
+static long IP330_Array_Init(dbCommon * precord, struct link * plink, epicsEnum16 ftvl, char * dsetname)
+{
+    precord->dpvt = NULL;
+
+    if (plink->type!=INST_IO)
+    {
+        recGblRecordError(S_db_badField, (void *)precord, "devWfIP330 Init_record, Illegal INP");
+        precord->pact=TRUE;
+        return (S_db_badField);
+    }
+
+    switch(ftvl)
+    {
+    case menuFtypeUSHORT:
+    case menuFtypeLONG:
+    case menuFtypeULONG:
+    case menuFtypeFLOAT:
+    case menuFtypeDOUBLE:
+        break;
+    default:
+        errlogPrintf("Record %s FTVL must be USHORT, LONG, ULONG, FLOAT or DOUBLE for %s!\n", precord->name, dsetname);
+        recGblRecordError(S_db_badField, (void *)precord, "devWfIP330 Init_record, Illegal FTVL");
+        precord->pact=TRUE;
+        return (S_db_badField);
+    }
+
+    if(IP330_DevData_Init(precord, plink->value.instio.string) != 0)
+    {
+        errlogPrintf("Fail to init devdata for record %s!\n", precord->name);
+        recGblRecordError(S_db_badField, (void *) precord, "Init devdata Error");
+        precord->pact = TRUE;
+        return (S_db_badField);
+    }
+
+    return 0;
+}
+
+/* A frame is at most 32 values, it is converted from a local copy into bptr */
+static void IP330_Frame_Copy(void * bptr, epicsEnum16 ftvl, signed int * pframe, int n)
+{
+    int loop;
+
+    switch(ftvl)
+    {
+    case menuFtypeUSHORT:
+        for(loop = 0; loop < n; loop++) ((epicsUInt16 *)bptr)[loop] = (pframe[loop] < 0) ? 0 : ((pframe[loop] > 0xFFFF) ? 0xFFFF : pframe[loop]);
+        break;
+    case menuFtypeLONG:
+        for(loop = 0; loop < n; loop++) ((epicsInt32 *)bptr)[loop] = pframe[loop];
+        break;
+    case menuFtypeULONG:
+        for(loop = 0; loop < n; loop++) ((epicsUInt32 *)bptr)[loop] = (pframe[loop] < 0) ? 0 : pframe[loop];
+        break;
+    case menuFtypeFLOAT:
+        for(loop = 0; loop < n; loop++) ((epicsFloat32 *)bptr)[loop] = pframe[loop];
+        break;
+    case menuFtypeDOUBLE:
+        for(loop = 0; loop < n; loop++) ((epicsFloat64 *)bptr)[loop] = pframe[loop];
+        break;
+    }
+}
+
+/* Raw samples land at the start of bptr as UINT16, then they are widened in */
+/* place from the last one backward, so there is no intermediate buffer.     */
+static long IP330_Array_Read(dbCommon * precord, void * bptr, epicsEnum16 ftvl, epicsUInt32 nelm, epicsUInt32 * pnord)
+{
+    IP330_DEVDATA * pdevdata = (IP330_DEVDATA *)(precord->dpvt);
+    UINT16 * praw = (UINT16 *)bptr;
+    signed int frame[IP330_STREAM_CHANNELS];
+    epicsTimeStamp time;
+    int n = -1;
+    int loop;
+
+    switch(pdevdata->funcflag)
+    {
+    case IP330_WF_STREAM:
+        n = ip330StreamReadChannel(pdevdata->pcard, pdevdata->chnlnum, &(pdevdata->cursor), praw, nelm, &time, &(pdevdata->lost));
+        break;
+    case IP330_WF_HISTORY:
+        n = ip330HistoryReadChannel(pdevdata->pcard, pdevdata->chnlnum, praw, nelm, &time);
+        break;
+    case IP330_WF_SYNC:
+        n = ip330SyncReadFrame(pdevdata->psync, praw, nelm, NULL, &time);
+        break;
+    case IP330_WF_SAMPLES:
+        n = ip330StreamReadFrames(pdevdata->pcard, &(pdevdata->cursor), praw, nelm, &time, &(pdevdata->lost));
+        break;
+    case IP330_WF_FRAME:
+    case IP330_WF_FRAME_RAW:
+        n = ip330GroupReadFrame(pdevdata->pgroup, pdevdata->funcflag == IP330_WF_FRAME_RAW, frame, (nelm < IP330_STREAM_CHANNELS) ? nelm : IP330_STREAM_CHANNELS, NULL, &time);
+        if(n > 0) IP330_Frame_Copy(bptr, ftvl, frame, n);
+        break;
+    }
+
+    if(n < 0)
+    {
+        precord->udf=TRUE;
+        recGblSetSevr(precord, READ_ALARM, INVALID_ALARM);
+        return -1;
+    }
+
+    /* Frames are already converted, stream samples are still UINT16 */
+    if(pdevdata->funcflag == IP330_WF_STREAM || pdevdata->funcflag == IP330_WF_SAMPLES || pdevdata->funcflag == IP330_WF_HISTORY || pdevdata->funcflag == IP330_WF_SYNC)
+    {
+        switch(ftvl)
+        {
+        case menuFtypeLONG:
+            for(loop = n - 1; loop >= 0; loop--) ((epicsInt32 *)bptr)[loop] = praw[loop];
+            break;
+        case menuFtypeULONG:
+            for(loop = n - 1; loop >= 0; loop--) ((epicsUInt32 *)bptr)[loop] = praw[loop];
+            break;
+        case menuFtypeFLOAT:
+            for(loop = n - 1; loop >= 0; loop--) ((epicsFloat32 *)bptr)[loop] = praw[loop];
+            break;
+        case menuFtypeDOUBLE:
+            for(loop = n - 1; loop >= 0; loop--) ((epicsFloat64 *)bptr)[loop] = praw[loop];
+            break;
+        }
+    }
+
+    *pnord = n;
+    if(n > 0)
+    {
+        precord->udf = FALSE;
+        if(precord->tse == epicsTimeEventDeviceTime) precord->time = time;
+    }
+
+    return 0;
+}
+
+static long init_wf(struct waveformRecord * pwf)
+{
+    return IP330_Array_Init((dbCommon *)pwf, &(pwf->inp), pwf->ftvl, "devWfIP330");
+}
+
+static long init_aai(struct aaiRecord * paai)
+{
+    return IP330_Array_Init((dbCommon *)paai, &(paai->inp), paai->ftvl, "devAaiIP330");
+}
+
+/** for sync scan records  **/
+static long wf_ioint_info(int cmd, dbCommon * precord, IOSCANPVT * iopvt)
+{
+    IP330_DEVDATA * pdevdata = (IP330_DEVDATA *)(precord->dpvt);
+
+    if(pdevdata->funcflag == IP330_WF_FRAME || pdevdata->funcflag == IP330_WF_FRAME_RAW)
+        *iopvt = *ip330GroupGetIoScanPVT(pdevdata->pgroup);
+    else if(pdevdata->funcflag == IP330_WF_HISTORY)
+        *iopvt = *ip330HistoryGetIoScanPVT(pdevdata->pcard);
+    else if(pdevdata->funcflag == IP330_WF_SYNC)
+        *iopvt = *ip330SyncGetIoScanPVT(pdevdata->psync);
+    else
+        *iopvt = *ip330StreamGetIoScanPVT(pdevdata->pcard);
+    return 0;
+}
+
+static long read_wf(struct waveformRecord * pwf)
+{
+    return IP330_Array_Read((dbCommon *)pwf, pwf->bptr, pwf->ftvl, pwf->nelm, &(pwf->nord));
+}
+
+static long read_aai(struct aaiRecord * paai)
+{
+    return IP330_Array_Read((dbCommon *)paai, paai->bptr, paai->ftvl, paai->nelm, &(paai->nord));
+}
+
+struct IP330_DEV_SUP_SET
+{
+    long            number;
+    DEVSUPFUN       report;
+    DEVSUPFUN       init;
+    DEVSUPFUN       init_record;
+    DEVSUPFUN       get_ioint_info;
+    DEVSUPFUN       read;
+} devWfIP330 = {5, NULL, NULL, init_wf, wf_ioint_info, read_wf},
+  devAaiIP330 = {5, NULL, NULL, init_aai, wf_ioint_info, read_aai};
+
+#if (EPICS_VERSION>=7) || (EPICS_VERSION>=3 && EPICS_REVISION>=14)
+epicsExportAddress(dset, devWfIP330);
+epicsExportAddress(dset, devAaiIP330);
+#endif
+
@@ -9,44 +9,48 @@
 
 #include "drvIP330Lib.h"
 #include "drvIP330Private.h"
+#include "ipacRegistry.h"
+#include "ipacBulk.h"
+#include <iocsh.h>
+#include <initHooks.h>
 
 int     IP330_DRV_DEBUG = 0;
+/* Shrink the scan range to the channels records use, see ip330InitHook */
+int     IP330_AUTO_TRIM = 1;
+epicsExportAddress(int, IP330_AUTO_TRIM);
 
 static IP330_CARD_LIST	ip330_card_list;
 static int		card_list_inited=0;
+static int		ioc_initialized=0;	/* Cards created after iocInit calibrate right away */
+static const char	ip330RegType[] = "IP330";
 
 /*****************************************************************/
-/* Find IP330_CARD which matches the cardname from link list     */
+/* Find IP330_CARD which matches the cardname from the registry  */
 /*****************************************************************/
 IP330_ID ip330GetByName(char * cardname)
 {
-    IP330_ID pcard = NULL;
-
-    if(!card_list_inited)   return NULL;
-
-    for(pcard=(IP330_ID)ellFirst((ELLLIST *)&ip330_card_list); pcard; pcard = (IP330_ID)ellNext((ELLNODE *)pcard))
-    {
-        if ( 0 == strcmp(cardname, pcard->cardname) )   break;
-    }
-
-    return pcard;
+    return (IP330_ID)ipacRegFindByName(ip330RegType, cardname);
 }
 
 /*****************************************************************/
-/* Find IP330_CARD which matches the carrier/slot from link list */
+/* Find IP330_CARD which matches the carrier/slot from registry  */
 /*****************************************************************/
 IP330_ID ip330GetByLocation(UINT16 carrier, UINT16 slot)
 {
-    IP330_ID pcard = NULL;
-
-    if(!card_list_inited)   return NULL;
+    return (IP330_ID)ipacRegFindByLocation(ip330RegType, carrier, slot);
+}
 
-    for(pcard=(IP330_ID)ellFirst((ELLLIST *)&ip330_card_list); pcard; pcard = (IP330_ID)ellNext((ELLNODE *)pcard))
-    {
-        if ( (carrier == pcard->carrier) && (slot == pcard->slot) )   break;
-    }
+/*****************************************************************/
+/* Bit n set for channel n, start_channel to end_channel         */
+/*****************************************************************/
+static UINT32 ip330ChannelMask(int start_channel, int end_channel)
+{
+    UINT32 mask;
 
-    return pcard;
+    mask = 0xFFFFFFFF >> start_channel;
+    mask <<= (32 - (end_channel - start_channel + 1));
+    mask >>= (32 - end_channel - 1);
+    return mask;
 }
 
 /**************************************************************************************************************************************************************/
@@ -70,6 +74,7 @@ IP330_ID ip330GetByLocation(UINT16 carrier, UINT16 slot)
 /*                                        mode could be "uniformCont", "uniformSingle", "burstCont", "burstSingle", "cvtOnExt"                                */
 /*                                        trgdir could be "Input", "Output" except for "cvtOnExt" which must come with "Input"                                */
 /*                                        AvgxN could be Avg10 means average 10 times, R means reset after average and only applicable to Continuous mode     */
+/*                                        or EmaKxN, exponential moving average with alpha 1/2^K (K 1~16), published every N samples, e.g. Ema6x100           */
 /*                  char *timer,          "x*y@8MHz", x must be [64,255], y must be [1,65535]                                                                 */
 /*                  UINT8  vector)                                                                                                                            */
 /*  Example:                                                                                                                                                  */
@@ -77,12 +82,17 @@ IP330_ID ip330GetByLocation(UINT16 carrier, UINT16 slot)
 /**************************************************************************************************************************************************************/
 
 static void ip330ISR(int arg);
+static void ip330SelectRead(IP330_ID pcard);
+static void ip330Worker(void * arg);
+static void ip330InitHook(initHookState state);
+static void ip330ScanComplete(void *arg, IOSCANPVT ioscan, int prio);
 int ip330Create (char *cardname, UINT16 carrier, UINT16 slot, char *adcrange, char * channels, UINT32 gainL, UINT32 gainH, char *scanmode, char * timer, UINT8 vector)
 {
     int status, loop;
+    int registered = 0;
     int start_channel, end_channel;
     char tmp_smode[64], tmp_trgdir[64], tmp_avg[64];
-    int avg_times;
+    int avg_times, ema_shift;
     int timer_prescaler, conversion_timer;
 
     /* calloc will put everything zero */
@@ -92,6 +102,7 @@ int ip330Create (char *cardname, UINT16 carrier, UINT16 slot, char *adcrange, ch
     {/* Initialize the IP330 link list */
         ellInit( (ELLLIST *) &ip330_card_list);
         card_list_inited = 1;
+        initHookRegister(ip330InitHook);
     }
 
     pcard->lock = epicsMutexMustCreate();
@@ -102,12 +113,9 @@ int ip330Create (char *cardname, UINT16 carrier, UINT16 slot, char *adcrange, ch
         pcard->adj_offset[loop] = 0.0;
     }
 
-    for(loop = 0; loop < MAX_IP330_CHANNELS; loop++)
-    {
-        pcard->sum_data[loop] = 0xFFFFFFFF;	/* Mark data is not available */
-    }
-
-    scanIoInit( &(pcard->ioscan) );
+    pcard->group.pcard = pcard;
+    scanIoInit( &(pcard->group.ioscan) );
+    scanIoSetComplete(pcard->group.ioscan, ip330ScanComplete, &(pcard->group));
 
     /************************************ Parameters check ************************************/
 
@@ -133,9 +141,9 @@ int ip330Create (char *cardname, UINT16 carrier, UINT16 slot, char *adcrange, ch
         errlogPrintf ("ip330Create: Carrier %d Slot %d has no IP330\n", carrier, slot);
         goto FAIL;
     }
-    if( ip330GetByLocation(carrier, slot) )
+    if( ipacRegFindByLocation(NULL, carrier, slot) )
     {
-        errlogPrintf ("ip330Create: IP330 on carrier %d slot %d is already registered!\n", carrier, slot);
+        errlogPrintf ("ip330Create: carrier %d slot %d is already registered!\n", carrier, slot);
         status = -1;
         goto FAIL;
     }
@@ -176,9 +184,9 @@ int ip330Create (char *cardname, UINT16 carrier, UINT16 slot, char *adcrange, ch
     }
     pcard->start_channel = start_channel;
     pcard->end_channel = end_channel;
-    pcard->chnl_mask = 0xFFFFFFFF >> (pcard->start_channel);
-    pcard->chnl_mask <<= (32 - (pcard->end_channel - pcard->start_channel + 1));
-    pcard->chnl_mask >>= (32 - pcard->end_channel - 1);
+    pcard->chnl_mask = ip330ChannelMask(start_channel, end_channel);
+    pcard->group.start_channel = start_channel;
+    pcard->group.end_channel = end_channel;
 
     /* Get gain for each channel */
     for(loop=0; loop<(MAX_IP330_CHANNELS/2); loop++)
@@ -227,7 +235,14 @@ int ip330Create (char *cardname, UINT16 carrier, UINT16 slot, char *adcrange, ch
         goto FAIL;
     }
 
-    if( 1 != sscanf(tmp_avg, avgFormat, &avg_times) )
+    if( 1 == sscanf(tmp_avg, avgFormat, &avg_times) )
+    {/* Boxcar average */
+        ema_shift = 0;
+    }
+    else if( 2 == sscanf(tmp_avg, emaFormat, &ema_shift, &avg_times) && ema_shift >= 1 && ema_shift <= MAX_EMA_SHIFT )
+    {/* Exponential moving average, published every avg_times samples */
+    }
+    else
     {
         errlogPrintf ("ip330Create: scan mode %s is illegal for device %s\n", scanmode, cardname);
         status = -1;
@@ -235,7 +250,8 @@ int ip330Create (char *cardname, UINT16 carrier, UINT16 slot, char *adcrange, ch
     }
     if(avg_times >= 1 && avg_times <= MAX_AVG_TIMES)
     {
-        pcard->avg_times = avg_times;
+        pcard->group.avg_times = avg_times;
+        pcard->group.ema_shift = ema_shift;
     }
     else
     {
@@ -243,7 +259,7 @@ int ip330Create (char *cardname, UINT16 carrier, UINT16 slot, char *adcrange, ch
         status = -1;
         goto FAIL;
     }
-    if(strchr(tmp_avg, 'R'))
+    if(strchr(tmp_avg, 'R') && !ema_shift)
         pcard->avg_rst = 1;
     else
         pcard->avg_rst = 0;
@@ -274,10 +290,37 @@ int ip330Create (char *cardname, UINT16 carrier, UINT16 slot, char *adcrange, ch
     /* Hardware pointer */
     pcard->pHardware   = (IP330_HW_MAP *) ipmBaseAddr(carrier, slot, ipac_addrIO);
 
+    /* Probe the 16 bit data registers the ISR moves, they hold still once the scan */
+    /* stops. The newData flags this clears mean nothing before ip330Configure.     */
+    pcard->pHardware->controlReg = 0x0000;
+    pcard->d32 = ipacBulkProbeD32(&(pcard->pHardware->data[0]));
+
     /* We successfully allocate all resource */
+    if( ipacRegAdd(ip330RegType, pcard->cardname, carrier, slot, pcard) )
+    {
+        errlogPrintf ("ip330Create: failed to register device %s\n", cardname);
+        status = -1;
+        goto FAIL;
+    }
     ellAdd( (ELLLIST *)&ip330_card_list, (ELLNODE *)pcard);
+    registered = 1;
+
+    /* Start the bottom half before any interrupt can queue data for it */
+    pcard->raw_event = epicsEventMustCreate(epicsEventEmpty);
+    pcard->worker_ack = epicsEventMustCreate(epicsEventEmpty);
+    pcard->worker_resume = epicsEventMustCreate(epicsEventEmpty);
+    pcard->worker_pause_lock = epicsMutexMustCreate();
+    pcard->cnt_start_mono = pcard->cnt_logged_mono = epicsMonotonicGet();
+    pcard->worker = epicsThreadCreate(cardname, IP330_WORKER_PRIORITY, epicsThreadGetStackSize(epicsThreadStackMedium), ip330Worker, pcard);
+    if(!pcard->worker)
+    {
+        errlogPrintf ("ip330Create: worker thread creation failed for device %s\n", cardname);
+        status = -1;
+        goto FAIL;
+    }
 
     /* Install ISR */
+    ip330SelectRead(pcard);
     if(ipmIntConnect(carrier, slot, vector, ip330ISR, (int)pcard))
     {
         errlogPrintf ("ip330Create: intConnect failed for device %s\n", cardname);
@@ -287,26 +330,122 @@ int ip330Create (char *cardname, UINT16 carrier, UINT16 slot, char *adcrange, ch
 
     ipmIrqCmd(carrier, slot, 0, ipac_irqEnable);
 
-    ip330Calibrate(pcard);
+    /* Coefficients come from the cache, or ip330InitHook calibrates all cards in parallel */
+    ip330WorkerPause(pcard);
+    if(ip330CalCacheLoad(pcard) != 0 && ioc_initialized)
+    {
+        if(ip330Calibrate(pcard) == 0)
+        {
+            epicsTimeGetCurrent(&(pcard->cal_time));
+            pcard->cal_state = IP330_CAL_DONE;
+        }
+    }
     ip330Configure(pcard);
+    ip330WorkerResume(pcard);
+    if(pcard->cal_state == IP330_CAL_DONE) ip330CalCacheSave(pcard);
 
     return 0;
 
 FAIL:
+    if(pcard->worker)
+    {/* Nothing may still run on pcard once it is freed */
+        pcard->worker_cmd = IP330_WORKER_STOP;
+        epicsEventSignal(pcard->raw_event);
+        epicsEventMustWait(pcard->worker_ack);
+    }
+    if(registered)
+    {
+        ellDelete( (ELLLIST *)&ip330_card_list, (ELLNODE *)pcard);
+        ipacRegRemove(ip330RegType, pcard->cardname, carrier, slot);
+    }
     if(pcard->lock) epicsMutexDestroy(pcard->lock);
+    if(pcard->raw_event) epicsEventDestroy(pcard->raw_event);
+    if(pcard->worker_ack) epicsEventDestroy(pcard->worker_ack);
+    if(pcard->worker_resume) epicsEventDestroy(pcard->worker_resume);
+    if(pcard->worker_pause_lock) epicsMutexDestroy(pcard->worker_pause_lock);
     if(pcard->cardname) free(pcard->cardname);
     free(pcard);
     return status;
 }
 
+/****************************************************************/
+/* Convert adj_slope/adj_offset of each channel gain into the   */
+/* fixed point table used by ip330ReadSeq. The new table is     */
+/* built aside and switched in. Two rebuilds back to back would */
+/* write the table a slow reader still uses, so cal_seq changes */
+/* around each rebuild and readers retry when it did. This      */
+/* function can be only called from task level.                 */
+/****************************************************************/
+static epicsInt64 ip330CalRound(double value)
+{
+    return (epicsInt64)((value >= 0.0) ? (value + 0.5) : (value - 0.5));
+}
+
+static void ip330BuildGroupCal(IP330_ID pcard, IP330_GROUP * pgroup)
+{
+    int loop, next;
+    double slope;
+    IP330_CAL_TABLE * pcal;
+
+    next = !pgroup->cal_active;
+    pcal = &(pgroup->cal[next]);
+
+    pgroup->cal_seq++;
+    epicsAtomicWriteMemoryBarrier();
+
+    /* Published frames hold avg_times samples, or one EMA value scaled by IP330_EMA_ONE */
+    pcal->divisor = pgroup->ema_shift ? IP330_EMA_ONE : pgroup->avg_times;
+    for(pcal->shift = 0; ((UINT32)1 << pcal->shift) < pcal->divisor; pcal->shift++);
+
+    for(loop = 0; loop < MAX_IP330_CHANNELS; loop++)
+    {
+        slope = pcard->adj_slope[pcard->gain[loop]] * (double)(1 << IP330_CAL_QBITS);
+        pcal->slope[loop] = (epicsInt32)ip330CalRound(slope);
+        /* Keeps about IP330_CAL_QBITS significant bits however deep the average is */
+        pcal->scale[loop] = ip330CalRound(slope * (double)((epicsInt64)1 << pcal->shift) / (double)pcal->divisor);
+        pcal->offset[loop] = ip330CalRound(slope * pcard->adj_offset[pcard->gain[loop]]);
+    }
+
+    epicsAtomicWriteMemoryBarrier();
+    pgroup->cal_active = next;
+    epicsAtomicWriteMemoryBarrier();
+    pgroup->cal_seq++;
+}
+
+void ip330BuildCalTable(IP330_ID pcard)
+{
+    int loop;
+
+    epicsMutexLock(pcard->lock);
+
+    ip330BuildGroupCal(pcard, &(pcard->group));
+    for(loop = 0; loop < pcard->ngroups; loop++)
+        ip330BuildGroupCal(pcard, pcard->groups[loop]);
+
+    epicsMutexUnlock(pcard->lock);
+}
+
+/****************************************************************/
+/* Slope and offset of one gain from the mean counts read with  */
+/* the low and high calibration voltages, according to manual   */
+/****************************************************************/
+void ip330CalFit(IP330_ID pcard, int gain, double count_callo, double count_calhi, double * pslope, double * poffset)
+{
+    double m;
+
+    m = pgaGain[gain] * (calSettings[pcard->inp_range][gain].volt_calhi - calSettings[pcard->inp_range][gain].volt_callo) / (count_calhi - count_callo);
+    *pslope = (65536.0 * m) / calSettings[pcard->inp_range][gain].ideal_span;
+    *poffset = ( (calSettings[pcard->inp_range][gain].volt_callo * pgaGain[gain]) - calSettings[pcard->inp_range][gain].ideal_zero )/m - count_callo;
+}
+
 /*****************************************************************************************************************/
 /* Since there is only one ADC and one Programmalbe Gain, we don't have to calibrate each channel.               */
 /* We just calibrate ADC with different gain under certain input range.                                          */
 /* Since calibration will interrupt normal scanning, so usually calibration should only happen in initialization.*/
 /* Since calibration will change to setting, so make sure to run ip330Configure after calibration.               */
-/* This function cab be only called from task level.                                                             */
+/* This function cab be only called from task level. Returns 0 once all gains are calibrated.                    */
 /*****************************************************************************************************************/
-void ip330Calibrate(IP330_ID pcard)
+int ip330Calibrate(IP330_ID pcard)
 {
     int loopgain, loopchnl;
     int ntimes=0;
@@ -315,12 +454,12 @@ void ip330Calibrate(IP330_ID pcard)
     double count_callo;
     double count_calhi;
 
-    double m;
+    double slope, offset;
 
     if(!pcard)
     {
         errlogPrintf("ip330Calibrate called with NULL pointer!\n");
-        return;
+        return -1;
     }
 
     for(loopgain=0; loopgain < N_GAINS; loopgain++)
@@ -349,7 +488,7 @@ void ip330Calibrate(IP330_ID pcard)
             errlogPrintf("Somehow the data for %s is not ready on time for calibration!\n", pcard->cardname);
             /* Disable Scan and Interrupt */ 
             pcard->pHardware->controlReg = 0x0;
-            return;
+            return -1;
         }
         sum = 0;
         for (loopchnl = 0; loopchnl < MAX_IP330_CHANNELS; loopchnl++)
@@ -371,7 +510,7 @@ void ip330Calibrate(IP330_ID pcard)
             errlogPrintf("Somehow the data for %s is not ready on time for calibration!\n", pcard->cardname);
             /* Disable Scan and Interrupt */ 
             pcard->pHardware->controlReg = 0x0;
-            return;
+            return -1;
         }
         sum = 0;
         for (loopchnl = 0; loopchnl < MAX_IP330_CHANNELS; loopchnl++)
@@ -379,31 +518,47 @@ void ip330Calibrate(IP330_ID pcard)
 
         count_calhi = ((double)sum)/(double)MAX_IP330_CHANNELS;
 
-        /* Calculate slope and offset according manual */
-        m = pgaGain[loopgain] * (calSettings[pcard->inp_range][loopgain].volt_calhi - calSettings[pcard->inp_range][loopgain].volt_callo) / (count_calhi - count_callo);
+        ip330CalFit(pcard, loopgain, count_callo, count_calhi, &slope, &offset);
         epicsMutexLock(pcard->lock);
-        pcard->adj_slope[loopgain] = (65536.0 * m) / calSettings[pcard->inp_range][loopgain].ideal_span;
-        pcard->adj_offset[loopgain] = ( (calSettings[pcard->inp_range][loopgain].volt_callo * pgaGain[loopgain]) - calSettings[pcard->inp_range][loopgain].ideal_zero )/m - count_callo;
+        pcard->adj_slope[loopgain] = slope;
+        pcard->adj_offset[loopgain] = offset;
         epicsMutexUnlock(pcard->lock);
 
         if(IP330_DRV_DEBUG)
             printf("IP330 %s: realdata = %g * (rawdata + %g)\n", pcard->cardname, pcard->adj_slope[loopgain], pcard->adj_offset[loopgain]);
     }
 
+    ip330BuildCalTable(pcard);
+
     /* Disable Scan and Interrupt */ 
     pcard->pHardware->controlReg = 0x0;
-    return;
+    return 0;
+}
+
+/****************************************************************/
+/* Mark data of all channels of the group as not available      */
+/****************************************************************/
+static void ip330GroupReset(IP330_GROUP * pgroup)
+{
+    int loop;
+
+    for (loop = 0; loop < MAX_IP330_CHANNELS; loop++)
+    {
+        pgroup->acc_sum[loop] = 0;
+        pgroup->acc_count[loop] = 0;
+    }
+    pgroup->ema_seeded = 0;
 }
 
 /****************************************************************/
 /* We don't allow change configuration during running so far.   */
 /* If we do, the nornal procedure to call ip330Configure is:    */
-/* 1. Get mutex semaphore                                       */
+/* 1. Pause the worker with ip330WorkerPause                    */
 /* 2. Disable IP330 interrupt                                   */
 /* 3. Delay a while to make sure no pending IRQ from this IP330 */
 /* 4. Change whatever in IP330_CARD                             */
 /* 5. Call ip330Configure                                       */
-/* 6. Release mutex semaphore                                   */
+/* 6. Enable interrupt and ip330WorkerResume                    */
 /* This function cab be only called from task level             */
 /* Since these procedure takes time, so the mutex semaphore here*/
 /* must NOT be the one we are using in synchronous data read.   */
@@ -430,10 +585,11 @@ void ip330Configure(IP330_ID pcard)
 
     /* Clear newdata and misseddata register and data */
     for (loop = 0; loop < MAX_IP330_CHANNELS; loop++)
-    {
         dummy = pcard->pHardware->data[loop];
-        pcard->sum_data[loop] = 0xFFFFFFFF;	/* Mark data is not available */
-    }
+
+    ip330GroupReset(&(pcard->group));
+    for (loop = 0; loop < pcard->ngroups; loop++)
+        ip330GroupReset(pcard->groups[loop]);
 
     tmp_ctrl = CTRL_REG_STRGHT_BINARY | (pcard->trg_dir<<CTRL_REG_TRGDIR_SHFT) | (pcard->inp_typ<<CTRL_REG_INPTYP_SHFT) | (pcard->scan_mode<<CTRL_REG_SCANMODE_SHFT) | CTRL_REG_INTR_CTRL;
 
@@ -457,6 +613,23 @@ void ip330Configure(IP330_ID pcard)
     for (loop = 0; loop < MAX_IP330_CHANNELS; loop++)
         pcard->pHardware->gain[loop] = pcard->gain[loop];
 
+    /* Burst modes interrupt once per timer period, uniform modes once per channel scanned */
+    if(pcard->scan_mode == SCAN_MODE_BURSTCONT)
+        pcard->period_ns = (epicsUInt64)pcard->timer_prescaler * pcard->conversion_timer * 125;
+    else if(pcard->scan_mode == SCAN_MODE_UNIFORMCONT)
+        pcard->period_ns = (epicsUInt64)pcard->timer_prescaler * pcard->conversion_timer * 125 * (pcard->end_channel - pcard->start_channel + 1);
+    else
+        pcard->period_ns = 0;
+    pcard->isr_last = 0;
+    pcard->isr_period = 0;
+
+    /* gain, avg_times and ema_shift are folded into the calibration table */
+    ip330BuildCalTable(pcard);
+
+    /* Channel range may have changed, see ip330Trim */
+    ip330SelectRead(pcard);
+
+    pcard->ctrl_reg = tmp_ctrl;
     pcard->pHardware->controlReg = tmp_ctrl;
 
     /* Delay at least 5us */
@@ -469,255 +642,1590 @@ void ip330Configure(IP330_ID pcard)
 }
 
 /****************************************************************/
-/* Read data for paticular channel, do average and correction   */
+/* Device support tells which channels its records read, -1 for */
+/* the whole range. Called before ip330Trim at iocInit, from    */
+/* init_record and from features read without a record.        */
 /****************************************************************/
-int ip330Read(IP330_ID pcard, UINT16 channel, signed int * pvalue)
+void ip330UseChannel(IP330_ID pcard, int channel)
 {
-    /* The raw value we read from hardware is UINT16 */
-    /* But after calibration, it might be a little bit wider range */
+    if(!pcard) return;
+
+    if(channel < 0)
+        pcard->used_mask |= pcard->chnl_mask;
+    else if(channel < MAX_IP330_CHANNELS)
+        pcard->used_mask |= (1 << channel);
+}
 
-    UINT32 tmp;
-    double tmp_sum, tmp_avgtimes;
+/**************************************************************************************************************/
+/*  Routine: ip330GroupCreate                                                                                 */
+/*                                                                                                            */
+/*  Purpose: Average some channels of an IP-330 at another rate, with their own I/O Intr scan                 */
+/*                                                                                                            */
+/*  SYNOPSIS: int ip330GroupCreate(                                                                           */
+/*                  char *cardname,       Name given to ip330Create                                           */
+/*                  char *groupname,      Unique within the card, records use it as 4th field of INP          */
+/*                  char *channels,       "chX-chY", within the channel range of ip330Create                  */
+/*                  char *average)        "AvgN" or "EmaKxN" as in the scan mode of ip330Create, no reset     */
+/*  Example:                                                                                                  */
+/*            ip330GroupCreate("ip330_1", "slow", "ch8-ch10", "Avg1000")                                      */
+/*            record(ai, "TEMP1") { field(DTYP, "IP330") field(SCAN, "I/O Intr") field(INP, "#C0 S0 @ip330_1:8:DATA:slow") } */
+/**************************************************************************************************************/
+int ip330GroupCreate(char * cardname, char * groupname, char * channels, char * average)
+{
+    IP330_ID pcard;
+    IP330_GROUP * pgroup;
+    int start_channel, end_channel, avg_times, ema_shift, loop;
 
+    pcard = ip330GetByName(cardname);
     if(!pcard)
     {
-        errlogPrintf("ip330Read called with NULL pointer!\n");
+        errlogPrintf("ip330GroupCreate: %s is not registered!\n", cardname);
         return -1;
     }
 
-    epicsMutexLock(pcard->lock);
-
-    if(channel < pcard->start_channel || channel > pcard->end_channel)
+    if(!groupname || !*groupname || ip330GetGroup(pcard, groupname))
     {
-        errlogPrintf("Bad channel number %d in ip330Read card %s\n", channel, pcard->cardname);
-        epicsMutexUnlock(pcard->lock);
+        errlogPrintf("ip330GroupCreate: group name %s is empty or already used on %s!\n", groupname ? groupname : "", cardname);
         return -1;
     }
 
-    tmp = pcard->sum_data[channel];
+    if(pcard->ngroups >= MAX_IP330_GROUPS)
+    {
+        errlogPrintf("ip330GroupCreate: %s already has %d groups!\n", cardname, MAX_IP330_GROUPS);
+        return -1;
+    }
 
-    if(tmp == 0xFFFFFFFF)
+    if( !channels || 2 != sscanf(channels, channelsFormat, &start_channel, &end_channel) ||
+        start_channel < pcard->start_channel || end_channel > pcard->end_channel || start_channel > end_channel )
     {
-        errlogPrintf("No data for channel number %d in ip330Read card %s\n", channel, pcard->cardname);
-        epicsMutexUnlock(pcard->lock);
+        errlogPrintf("ip330GroupCreate: channel range %s is illegal for device %s\n", channels ? channels : "", cardname);
         return -1;
     }
 
-    tmp_sum = tmp & 0x00FFFFFF;
-    tmp_avgtimes = ( (tmp & 0xFF000000) >> 24 ) + 1;
+    if( average && 1 == sscanf(average, avgFormat, &avg_times) )
+    {/* Boxcar average */
+        ema_shift = 0;
+    }
+    else if( !average || 2 != sscanf(average, emaFormat, &ema_shift, &avg_times) || ema_shift < 1 || ema_shift > MAX_EMA_SHIFT )
+    {
+        errlogPrintf("ip330GroupCreate: average %s is illegal for device %s\n", average ? average : "", cardname);
+        return -1;
+    }
+    if(avg_times < 1 || avg_times > MAX_AVG_TIMES)
+    {
+        errlogPrintf("ip330GroupCreate: average %s is illegal for device %s\n", average, cardname);
+        return -1;
+    }
 
-    *pvalue = pcard->adj_slope[pcard->gain[channel]] * (tmp_sum/tmp_avgtimes + pcard->adj_offset[pcard->gain[channel]]);
+    pgroup = callocMustSucceed(1, sizeof(IP330_GROUP), "ip330GroupCreate");
+    pgroup->pcard = pcard;
+    pgroup->name = epicsStrDup(groupname);
+    pgroup->start_channel = start_channel;
+    pgroup->end_channel = end_channel;
+    pgroup->avg_times = avg_times;
+    pgroup->ema_shift = ema_shift;
+    scanIoInit( &(pgroup->ioscan) );
+    scanIoSetComplete(pgroup->ioscan, ip330ScanComplete, pgroup);
 
+    epicsMutexLock(pcard->lock);
+    ip330BuildGroupCal(pcard, pgroup);
+    /* The worker is already running, it only looks at the group once everything above is visible */
+    loop = pcard->ngroups;
+    pcard->groups[loop] = pgroup;
+    epicsAtomicWriteMemoryBarrier();
+    pcard->ngroups = loop + 1;
     epicsMutexUnlock(pcard->lock);
 
     return 0;
 }
 
-
 /****************************************************************/
-/* Read data for paticular channel, do average and correction   */
+/* Find a group of the card, NULL or "" is the ip330Create one  */
 /****************************************************************/
-IOSCANPVT * ip330GetIoScanPVT(IP330_ID pcard)
+IP330_GROUP_ID ip330GetGroup(IP330_ID pcard, char * groupname)
 {
-    if(!pcard)
+    int loop;
+
+    if(!pcard) return NULL;
+
+    if(groupname && *groupname)
     {
-        errlogPrintf("ip330GetIoScanPVT called with NULL pointer!\n");
+        for(loop = 0; loop < pcard->ngroups; loop++)
+            if(0 == strcmp(pcard->groups[loop]->name, groupname)) return pcard->groups[loop];
         return NULL;
     }
-    return &(pcard->ioscan);
+
+    return &(pcard->group);
 }
 
-/***********************************************************************/
-/* Read data from mailbox,  check dual level buffer if needed          */
-/* Put data into sum_data, stop scan and trigger record scan if needed */
-/***********************************************************************/
-static void ip330ISR(int arg)
+/****************************************************************/
+/* Whether channel is in the range of a group. Only meant for   */
+/* init_record, ip330Trim may shrink the range at iocInit.      */
+/****************************************************************/
+int ip330GroupHasChannel(IP330_GROUP_ID pgroup, int channel)
 {
-    int loop;
-    UINT32 newdata_flag, misseddata_flag;
-    UINT16 data[MAX_IP330_CHANNELS];
-    UINT32 buf0_avail=0, buf1_avail=0;
+    if(!pgroup) return 0;
+    return (channel >= pgroup->start_channel && channel <= pgroup->end_channel);
+}
 
-    IP330_ID pcard = (IP330_ID)arg;
+/****************************************************************/
+/* Fastest frame rate the timer and the conversions allow       */
+/****************************************************************/
+static double ip330MaxFrameRate(IP330_ID pcard)
+{
+    epicsUInt64 period;
 
-    ipmIrqCmd(pcard->carrier, pcard->slot, 0, ipac_irqDisable);
-    if(IP330_DRV_DEBUG) epicsInterruptContextMessage("IP330 ISR called\n");
+    period = (epicsUInt64)(pcard->end_channel - pcard->start_channel + 1) * IP330_CONVERSION_NS;
+    if(pcard->period_ns > period) period = pcard->period_ns;
+    return 1e9/period;
+}
 
-    if(pcard->inp_typ == INP_TYP_DIFF)
-    {/* Input type is differential, we have buf0 and buf1 */
-        UINT16 newdata_flag0, newdata_flag1;
-        UINT16 misseddata_flag0, misseddata_flag1;
+/****************************************************************/
+/* Shrink the hardware scan range to the channels records use.  */
+/* The IP330 scans a contiguous range, so it becomes the lowest */
+/* to the highest channel used. Called once at iocInit.         */
+/****************************************************************/
+static void ip330Trim(IP330_ID pcard)
+{
+    UINT32 used;
+    int start, end, old_start, old_end, loop;
+    double old_rate;
 
-        newdata_flag0 = (pcard->pHardware->newData[0]) & pcard->chnl_mask;
-        newdata_flag1 = (pcard->pHardware->newData[1]) & pcard->chnl_mask;
-        newdata_flag = ((newdata_flag1 << 16) | newdata_flag0);
+    used = pcard->used_mask & pcard->chnl_mask;
+    if(!used || used == pcard->chnl_mask) return;
 
-        misseddata_flag0 = (pcard->pHardware->missedData[0]) & pcard->chnl_mask;
-        misseddata_flag1 = (pcard->pHardware->missedData[1]) & pcard->chnl_mask;
-        misseddata_flag = ((misseddata_flag1 << 16) | misseddata_flag0);
+    for(start = pcard->start_channel; !(used & (1 << start)); start++);
+    for(end = pcard->end_channel; !(used & (1 << end)); end--);
+    if(start == pcard->start_channel && end == pcard->end_channel) return;
 
-        if(newdata_flag0 == pcard->chnl_mask)
-        {/* Read Data from buf0 */
-            for(loop = pcard->start_channel; loop <= pcard->end_channel; loop++)
-            {
-                data[loop] = pcard->pHardware->data[loop];
-            }
-            buf0_avail = 1;
-        }
+    old_start = pcard->start_channel;
+    old_end = pcard->end_channel;
+    old_rate = ip330MaxFrameRate(pcard);
 
-        if(newdata_flag1 == pcard->chnl_mask)
-        {/* Read Data from buf1 */
-            for(loop = pcard->start_channel; loop <= pcard->end_channel; loop++)
-            {
-                data[loop+16] = pcard->pHardware->data[loop+16];
-            }
-            buf1_avail = 1;
-        }
+    /* Worker first, its scan reset would restart what we stop here */
+    ip330WorkerPause(pcard);
+    ipmIrqCmd(pcard->carrier, pcard->slot, 0, ipac_irqDisable);
+    pcard->pHardware->controlReg = 0x0;
+    epicsThreadSleep(0.1);
+
+    pcard->start_channel = start;
+    pcard->end_channel = end;
+    pcard->chnl_mask = ip330ChannelMask(start, end);
+    pcard->group.start_channel = start;
+    pcard->group.end_channel = end;
+    /* Other groups only keep the channels still scanned, they may end up empty */
+    for(loop = 0; loop < pcard->ngroups; loop++)
+    {
+        if(pcard->groups[loop]->start_channel < start) pcard->groups[loop]->start_channel = start;
+        if(pcard->groups[loop]->end_channel > end) pcard->groups[loop]->end_channel = end;
     }
-    else
-    {/* Input type is single-end, there is only buf0 */
-        newdata_flag = ((pcard->pHardware->newData[1]  << 16) | pcard->pHardware->newData[0]);
-        newdata_flag &= pcard->chnl_mask;
+    /* Worker is paused, nothing queued before now belongs to the new range */
+    pcard->raw_discard = pcard->raw_head;
+
+    ip330Configure(pcard);
+    ipmIrqCmd(pcard->carrier, pcard->slot, 0, ipac_irqEnable);
+    ip330WorkerResume(pcard);
 
-        misseddata_flag = ((pcard->pHardware->missedData[1]  << 16) | pcard->pHardware->missedData[0]);
-        misseddata_flag &= pcard->chnl_mask;
+    printf("IP330 %s: records only use chnl%d~chnl%d, scan trimmed from chnl%d~chnl%d, frame rate up to %gHz (was %gHz)\n",
+           pcard->cardname, start, end, old_start, old_end, ip330MaxFrameRate(pcard), old_rate);
+}
 
-        if(newdata_flag == pcard->chnl_mask)
-        {/* Read Data */
-            for(loop = pcard->start_channel; loop <= pcard->end_channel; loop++)
-            {
-                data[loop] = pcard->pHardware->data[loop];
-            }
-            buf0_avail = 1;
-        }
-    }
+/****************************************************************/
+/* All records are initialized after initDatabase, so we know   */
+/* which channels are used before any of them is scanned. Cards */
+/* are calibrated first, all at once instead of one by one in   */
+/* ip330Create. Cached ones stay, see ip330CalBackground.       */
+/****************************************************************/
+static void ip330InitHook(initHookState state)
+{
+    IP330_ID pcard;
 
-    if(buf0_avail || buf1_avail)
+    if(state == initHookAfterInitDatabase)
     {
-        /* Load sum_data, if reach avg_times and cont. mode needs reset, stop scan */
-        for(loop = pcard->start_channel; loop <= pcard->end_channel; loop++)
+        for(pcard=(IP330_ID)ellFirst((ELLLIST *)&ip330_card_list); pcard; pcard = (IP330_ID)ellNext((ELLNODE *)pcard))
         {
-            UINT32 tmp;
-            UINT32 tmp_avgtimes, tmp_sum;
-
-            tmp = pcard->sum_data[loop];
-            tmp_sum = (tmp & 0x00FFFFFF);
-            tmp_avgtimes = ((tmp & 0xFF000000) >> 24) + 1;
-
-            if( tmp == 0xFFFFFFFF || tmp_avgtimes >= pcard->avg_times)
-            {/* No data or already reached the average times */
-                tmp_sum = 0;
-                tmp_avgtimes = 0;
-            }
-
-            if(buf0_avail &&  (tmp_avgtimes+1) <= pcard->avg_times)
-            {
-                tmp_sum += data[loop];
-                tmp_avgtimes += 1;
-            }
-            if(buf1_avail &&  (tmp_avgtimes+1) <= pcard->avg_times)
+            pcard->cal_started = 0;
+            if(pcard->cal_state != IP330_CAL_NONE) continue;
+            if(ip330CalStart(pcard, IP330_WORKER_PRIORITY) == 0)
             {
-                tmp_sum += data[loop+16];
-                tmp_avgtimes += 1;
+                pcard->cal_started = 1;
             }
-            pcard->sum_data[loop] = ( (tmp_sum & 0x00FFFFFF) | ((tmp_avgtimes - 1) << 24) );
-
-            if(tmp_avgtimes >= pcard->avg_times && loop == pcard->end_channel)
+            else
             {
-                if( (pcard->avg_rst) && ((pcard->scan_mode == SCAN_MODE_UNIFORMCONT) || (pcard->scan_mode == SCAN_MODE_BURSTCONT)) )
-                {
-                    int ntimes = 0;
-                    UINT16 saved_ctrl;
-                    saved_ctrl = pcard->pHardware->controlReg;
-                    pcard->pHardware->controlReg = (saved_ctrl) & 0xF8FF; /* Disable scan */
-                    while(ntimes++ < 1000)
-                    {
-                        if(!(pcard->pHardware->controlReg & 0x0700)) break;
-                    }
-                    if (ntimes == 1000) epicsInterruptContextMessage("Disable scan error\n");
-                    /* Work around hardware bug of uniform continuous mode */
-                    if(pcard->scan_mode == SCAN_MODE_UNIFORMCONT) pcard->pHardware->startChannel = pcard->start_channel;
-
-                    pcard->pHardware->controlReg = saved_ctrl;
-                }
-                scanIoRequest(pcard->ioscan);
+                errlogPrintf("IP330 %s: calibration not started, the card stays uncalibrated\n", pcard->cardname);
+                pcard->cal_failed = 1;
             }
         }
-    }
-    else
-    {
-#ifdef vxWorks
-        logMsg("Unexpected new data flag 0x%08x\n", newdata_flag, 0,0,0,0,0);
-#else
-        epicsInterruptContextMessage("Unexpected new data flag\n");
-#endif
-    }
+        for(pcard=(IP330_ID)ellFirst((ELLLIST *)&ip330_card_list); pcard; pcard = (IP330_ID)ellNext((ELLNODE *)pcard))
+            if(pcard->cal_started) ip330CalWait(pcard);
+        ioc_initialized = 1;
 
-    if(misseddata_flag != 0)
-    {
-        epicsInterruptContextMessage("Missed data flag is set\n");
+        if(!IP330_AUTO_TRIM) return;
+        for(pcard=(IP330_ID)ellFirst((ELLLIST *)&ip330_card_list); pcard; pcard = (IP330_ID)ellNext((ELLNODE *)pcard))
+            ip330Trim(pcard);
     }
-
-    ipmIrqCmd(pcard->carrier, pcard->slot, 0, ipac_irqClear);
-    ipmIrqCmd(pcard->carrier, pcard->slot, 0, ipac_irqEnable);
 }
 
-/***********************************************************************/
-/* Software trigger                                                    */
-/***********************************************************************/
-void ip330StartConvert(IP330_ID pcard)
+/****************************************************************/
+/* Calibrated value in counts << IP330_CAL_QBITS of a frame sum */
+/****************************************************************/
+static epicsInt64 ip330CalQ(IP330_CAL_TABLE * pcal, UINT16 channel, epicsInt64 sum, UINT32 count)
 {
-    if(pcard)
-    {
-        if(pcard->trg_dir == TRG_DIR_OUTPUT)
-            pcard->pHardware->startConvert = 0x1;
-    }
-}
+    if(count == pcal->divisor)
+        sum = (sum * pcal->scale[channel]) >> pcal->shift;
+    else	/* Published frames always hold divisor samples, this is only a fallback */
+        sum = sum * pcal->slope[channel] / (epicsInt64)count;
 
-void ip330StartConvertByName(char * cardname)
-{
-    IP330_ID pcard = ip330GetByName(cardname);
-    ip330StartConvert(pcard);
+    return sum + pcal->offset[channel];
 }
-/**************************************************************************************************/
-/* Here we supply the driver report function for epics                                            */
-/**************************************************************************************************/
-static  long    IP330_EPICS_Report(int level);
-
-const struct drvet drvIP330 = {2,                              /*2 Table Entries */
-                              (DRVSUPFUN) IP330_EPICS_Report,  /* Driver Report Routine */
-                              NULL}; /* Driver Initialization Routine */
-
-epicsExportAddress(drvet,drvIP330);
 
-/* implementation */
-static long IP330_EPICS_Report(int level)
+/****************************************************************/
+/* Read data for paticular channel, do average and correction   */
+/* Data comes from the frame pinned for the current scan, so    */
+/* all records of one I/O Intr scan see the same frame. No lock.*/
+/* *pq is the calibrated value in counts << IP330_CAL_QBITS     */
+/****************************************************************/
+static int ip330ReadQ(IP330_GROUP * pgroup, UINT16 channel, epicsInt64 * pq, UINT32 * pseq)
 {
     IP330_ID pcard;
-
-    printf("\n"IP330_DRV_VERSION"\n\n");
-
-    if(!card_list_inited)
+    IP330_FRAME * pframe;
+    IP330_CAL_TABLE * pcal;
+    UINT32 wseq, seq, cal_seq;
+    epicsInt64 sum;
+    UINT32 count;
+    epicsUInt64 mono;
+
+    if(!pgroup)
     {
-        printf("IP330 card link list is not inited yet!\n\n");
-        return 0;
+        errlogPrintf("ip330Read called with NULL pointer!\n");
+        return -1;
     }
+    pcard = pgroup->pcard;
 
-    if(level > 0)   /* we only get into link list for detail when user wants */
+    if(channel < pgroup->start_channel || channel > pgroup->end_channel)
     {
-        for(pcard=(IP330_ID)ellFirst((ELLLIST *)&ip330_card_list); pcard; pcard = (IP330_ID)ellNext((ELLNODE *)pcard))
-        {
-            printf("\tIP330 card %s is installed on carrier %d slot %d\n", pcard->cardname, pcard->carrier, pcard->slot);
+        errlogPrintf("Bad channel number %d in ip330Read card %s\n", channel, pcard->cardname);
+        return -1;
+    }
 
-            if(level > 1)
-            {
-                printf("\tInput range is %s, chnl%d~chnl%d is in use, scan mode is %s\n", rangeName[pcard->inp_typ*N_RANGES+pcard->inp_range], pcard->start_channel, pcard->end_channel, scanModeName[pcard->scan_mode]);
-                printf("\tTrigger direction is %s, average %d times %s reset, timer is %gus\n", trgDirName[pcard->trg_dir], pcard->avg_times, pcard->avg_rst?"with":"without", pcard->timer_prescaler*pcard->conversion_timer/8.0);
-                printf("\tIO space is at %p\nn", pcard->pHardware);
-            }
-        }
+    do
+    {/* Retry if the worker reused this buffer while we were copying */
+        pframe = &(pgroup->frame[pgroup->frame_pinned]);
+        wseq = pframe->wseq;
+        epicsAtomicReadMemoryBarrier();
+        seq = pframe->seq;
+        mono = pframe->mono;
+        sum = pframe->sum[channel];
+        count = pframe->count[channel];
+        epicsAtomicReadMemoryBarrier();
+    } while( (wseq & 0x1) || (wseq != pframe->wseq) );
+
+    if(seq == 0 || count == 0)
+    {
+        errlogPrintf("No data for channel number %d in ip330Read card %s\n", channel, pcard->cardname);
+        return -1;
     }
 
+    ip330HistAdd(&(pcard->hist_read), epicsMonotonicGet() - mono);
+
+    do
+    {/* Retry if the table was rebuilt while we used it */
+        cal_seq = pgroup->cal_seq;
+        epicsAtomicReadMemoryBarrier();
+        pcal = &(pgroup->cal[pgroup->cal_active]);
+        epicsAtomicReadMemoryBarrier();
+        *pq = ip330CalQ(pcal, channel, sum, count);
+        epicsAtomicReadMemoryBarrier();
+    } while(cal_seq != pgroup->cal_seq);
+    if(pseq) *pseq = seq;
+
     return 0;
 }
 
+int ip330GroupReadSeq(IP330_GROUP_ID pgroup, UINT16 channel, signed int * pvalue, UINT32 * pseq)
+{
+    epicsInt64 q;
+
+    if(ip330ReadQ(pgroup, channel, &q, pseq)) return -1;
+
+    *pvalue = (signed int)((q + IP330_CAL_ROUND) >> IP330_CAL_QBITS);
+    return 0;
+}
+
+/****************************************************************/
+/* Deep averages and EMA carry more than 16 bits, keep some     */
+/****************************************************************/
+int ip330GroupReadWide(IP330_GROUP_ID pgroup, UINT16 channel, signed int * pvalue, UINT32 * pseq)
+{
+    epicsInt64 q;
+
+    if(ip330ReadQ(pgroup, channel, &q, pseq)) return -1;
+
+    *pvalue = (signed int)((q + (IP330_CAL_ROUND >> IP330_WIDE_FRAC_BITS)) >> (IP330_CAL_QBITS - IP330_WIDE_FRAC_BITS));
+    return 0;
+}
+
+int ip330ReadSeq(IP330_ID pcard, UINT16 channel, signed int * pvalue, UINT32 * pseq)
+{
+    return ip330GroupReadSeq(pcard ? &(pcard->group) : NULL, channel, pvalue, pseq);
+}
+
+int ip330ReadWide(IP330_ID pcard, UINT16 channel, signed int * pvalue, UINT32 * pseq)
+{
+    return ip330GroupReadWide(pcard ? &(pcard->group) : NULL, channel, pvalue, pseq);
+}
+
+int ip330Read(IP330_ID pcard, UINT16 channel, signed int * pvalue)
+{
+    return ip330ReadSeq(pcard, channel, pvalue, NULL);
+}
+
+/****************************************************************/
+/* Read all channels from start_channel to end_channel of the   */
+/* group's pinned frame with one consistency check, so they are all     */
+/* from the same averaging cycle. raw is the average in counts  */
+/* without calibration. Channels without data read 0.           */
+/* Returns the number of values, -1 if there is no frame yet.   */
+/****************************************************************/
+int ip330GroupReadFrame(IP330_GROUP_ID pgroup, int raw, signed int * pvalues, int maxvalues, UINT32 * pseq, epicsTimeStamp * ptime)
+{
+    IP330_ID pcard;
+    IP330_FRAME * pframe;
+    IP330_CAL_TABLE * pcal;
+    UINT32 wseq, seq, cal_seq;
+    epicsInt64 sum[MAX_IP330_CHANNELS];
+    UINT32 count[MAX_IP330_CHANNELS];
+    epicsTimeStamp time;
+    epicsUInt64 mono;
+    int n, loop;
+
+    if(!pgroup || !pvalues || maxvalues < 0)
+    {
+        errlogPrintf("ip330ReadFrame called with NULL pointer!\n");
+        return -1;
+    }
+    pcard = pgroup->pcard;
+
+    n = pgroup->end_channel - pgroup->start_channel + 1;
+    if(n < 0) n = 0;
+    if(n > maxvalues) n = maxvalues;
+
+    do
+    {/* Retry if the worker reused this buffer while we were copying */
+        pframe = &(pgroup->frame[pgroup->frame_pinned]);
+        wseq = pframe->wseq;
+        epicsAtomicReadMemoryBarrier();
+        seq = pframe->seq;
+        time = pframe->time;
+        mono = pframe->mono;
+        memcpy(sum, &(pframe->sum[pgroup->start_channel]), n * sizeof(epicsInt64));
+        memcpy(count, &(pframe->count[pgroup->start_channel]), n * sizeof(UINT32));
+        epicsAtomicReadMemoryBarrier();
+    } while( (wseq & 0x1) || (wseq != pframe->wseq) );
+
+    if(seq == 0)
+    {
+        errlogPrintf("No data in ip330ReadFrame card %s\n", pcard->cardname);
+        return -1;
+    }
+
+    ip330HistAdd(&(pcard->hist_read), epicsMonotonicGet() - mono);
+
+    do
+    {/* Retry if the table was rebuilt while we used it */
+        cal_seq = pgroup->cal_seq;
+        epicsAtomicReadMemoryBarrier();
+        pcal = &(pgroup->cal[pgroup->cal_active]);
+        epicsAtomicReadMemoryBarrier();
+        for(loop = 0; loop < n; loop++)
+        {
+            if(count[loop] == 0)
+                pvalues[loop] = 0;
+            else if(raw)	/* EMA frames have count IP330_EMA_ONE, so this works for both */
+                pvalues[loop] = (signed int)((sum[loop] + count[loop]/2) / count[loop]);
+            else
+                pvalues[loop] = (signed int)((ip330CalQ(pcal, pgroup->start_channel + loop, sum[loop], count[loop]) + IP330_CAL_ROUND) >> IP330_CAL_QBITS);
+        }
+        epicsAtomicReadMemoryBarrier();
+    } while(!raw && cal_seq != pgroup->cal_seq);
+
+    if(pseq) *pseq = seq;
+    if(ptime) *ptime = time;
+    return n;
+}
+
+int ip330ReadFrame(IP330_ID pcard, int raw, signed int * pvalues, int maxvalues, UINT32 * pseq, epicsTimeStamp * ptime)
+{
+    return ip330GroupReadFrame(pcard ? &(pcard->group) : NULL, raw, pvalues, maxvalues, pseq, ptime);
+}
+
+/****************************************************************/
+/* The worker brackets counter updates with these, see cnt_seq  */
+/****************************************************************/
+static void ip330CntBegin(IP330_ID pcard)
+{
+    pcard->cnt_seq++;
+    epicsAtomicWriteMemoryBarrier();
+}
+
+static void ip330CntEnd(IP330_ID pcard)
+{
+    epicsAtomicWriteMemoryBarrier();
+    pcard->cnt_seq++;
+}
+
+/****************************************************************/
+/* Read an error counter, channel < 0 for the card total.       */
+/* Only the first N_IP330_CHNL_CNT counters have channel values */
+/****************************************************************/
+int ip330GetCounter(IP330_ID pcard, int counter, int channel, epicsUInt64 * pvalue)
+{
+    UINT32 seq;
+
+    if(!pcard || !pvalue)
+    {
+        errlogPrintf("ip330GetCounter called with NULL pointer!\n");
+        return -1;
+    }
+
+    if(counter < 0 || counter >= N_IP330_CNT || channel >= MAX_IP330_CHANNELS || (channel >= 0 && counter >= N_IP330_CHNL_CNT))
+    {
+        errlogPrintf("Bad counter %d channel %d in ip330GetCounter card %s\n", counter, channel, pcard->cardname);
+        return -1;
+    }
+
+    do
+    {/* Retry if the worker updated the counters while we read */
+        seq = pcard->cnt_seq;
+        epicsAtomicReadMemoryBarrier();
+        if(channel < 0)
+            *pvalue = pcard->cnt[counter];
+        else
+            *pvalue = pcard->cnt_chnl[counter][channel];
+        epicsAtomicReadMemoryBarrier();
+    } while( (seq & 0x1) || (seq != pcard->cnt_seq) );
+
+    return 0;
+}
+
+/****************************************************************/
+/* Read data for paticular channel, do average and correction   */
+/****************************************************************/
+IOSCANPVT * ip330GetIoScanPVT(IP330_ID pcard)
+{
+    if(!pcard)
+    {
+        errlogPrintf("ip330GetIoScanPVT called with NULL pointer!\n");
+        return NULL;
+    }
+    return &(pcard->group.ioscan);
+}
+
+IOSCANPVT * ip330GroupGetIoScanPVT(IP330_GROUP_ID pgroup)
+{
+    if(!pgroup)
+    {
+        errlogPrintf("ip330GroupGetIoScanPVT called with NULL pointer!\n");
+        return NULL;
+    }
+    return &(pgroup->ioscan);
+}
+
+/****************************************************************/
+/* Raw sample stream. Every conversion is kept in a ring of     */
+/* nframes frames, readers keep their own cursor and never lock.*/
+/* Must be called after ip330Create and before iocInit.         */
+/****************************************************************/
+int ip330StreamEnable(char * cardname, UINT32 nframes, UINT32 block)
+{
+    IP330_ID pcard;
+    IP330_STREAM_FRAME * pstream;
+    UINT32 size;
+
+    pcard = ip330GetByName(cardname);
+    if(!pcard)
+    {
+        errlogPrintf("ip330StreamEnable: %s is not registered!\n", cardname);
+        return -1;
+    }
+
+    if(pcard->stream)
+    {
+        errlogPrintf("ip330StreamEnable: stream for %s is already enabled!\n", cardname);
+        return -1;
+    }
+
+    if(nframes < 2 || nframes > 0x1000000)
+    {
+        errlogPrintf("ip330StreamEnable: %u frames is illegal for device %s\n", nframes, cardname);
+        return -1;
+    }
+
+    for(size = 2; size < nframes; size <<= 1);
+
+    if(block < 1 || block > size/2)
+    {
+        errlogPrintf("ip330StreamEnable: block of %u frames is illegal for device %s\n", block, cardname);
+        return -1;
+    }
+
+    pcard->stream_size = size;
+    pcard->stream_block = block;
+    pcard->stream_head = 0;
+    scanIoInit( &(pcard->stream_ioscan) );
+    pstream = callocMustSucceed(size, sizeof(IP330_STREAM_FRAME), "ip330StreamEnable");
+    /* ip330StreamRead callers are no records, keep every channel in the scan */
+    ip330UseChannel(pcard, -1);
+
+    /* The worker is already running, it only looks at stream once everything above, zeroed ring included, is visible */
+    epicsAtomicWriteMemoryBarrier();
+    pcard->stream = pstream;
+
+    return 0;
+}
+
+/****************************************************************/
+/* Set *pcursor to the next frame the stream will produce       */
+/****************************************************************/
+int ip330StreamOpen(IP330_ID pcard, UINT32 * pcursor)
+{
+    if(!pcard || !pcard->stream)
+    {
+        errlogPrintf("ip330StreamOpen: stream is not enabled!\n");
+        return -1;
+    }
+
+    *pcursor = pcard->stream_head;
+    return 0;
+}
+
+/****************************************************************/
+/* Find the frames [*pcursor, *pcursor+n) which are safe to     */
+/* read, skipping those already overwritten. Returns n.         */
+/****************************************************************/
+static int ip330StreamWindow(IP330_ID pcard, UINT32 * pcursor, int max, UINT32 * plost)
+{
+    UINT32 head, avail;
+
+    head = pcard->stream_head;
+    epicsAtomicReadMemoryBarrier();
+
+    /* Frame head - stream_size may be being overwritten right now */
+    avail = head - *pcursor;
+    if(avail > pcard->stream_size - 1)
+    {
+        if(plost) *plost += avail - (pcard->stream_size - 1);
+        *pcursor = head - (pcard->stream_size - 1);
+        avail = pcard->stream_size - 1;
+    }
+
+    return (avail < (UINT32)max) ? (int)avail : max;
+}
+
+/****************************************************************/
+/* The frames from cursor on are still intact after the copy    */
+/****************************************************************/
+static int ip330StreamIntact(IP330_ID pcard, UINT32 cursor)
+{
+    epicsAtomicReadMemoryBarrier();
+    return (pcard->stream_head - cursor) <= (pcard->stream_size - 1);
+}
+
+/****************************************************************/
+/* Copy up to maxframes whole frames starting at *pcursor and   */
+/* advance the cursor. Frames lost to overrun are added to      */
+/* *plost if plost is not NULL. Returns number of frames read.  */
+/****************************************************************/
+int ip330StreamRead(IP330_ID pcard, UINT32 * pcursor, IP330_STREAM_FRAME * pframes, int maxframes, UINT32 * plost)
+{
+    int n, first;
+
+    if(!pcard || !pcard->stream || !pcursor || !pframes || maxframes < 0)
+    {
+        errlogPrintf("ip330StreamRead: stream is not enabled or bad parameters!\n");
+        return -1;
+    }
+
+    do
+    {
+        n = ip330StreamWindow(pcard, pcursor, maxframes, plost);
+        /* At most two memcpy, the ring may wrap once */
+        first = pcard->stream_size - (*pcursor & (pcard->stream_size - 1));
+        if(first > n) first = n;
+        memcpy(pframes, &(pcard->stream[*pcursor & (pcard->stream_size - 1)]), first * sizeof(IP330_STREAM_FRAME));
+        memcpy(pframes + first, pcard->stream, (n - first) * sizeof(IP330_STREAM_FRAME));
+    } while(!ip330StreamIntact(pcard, *pcursor));
+
+    *pcursor += n;
+    return n;
+}
+
+/****************************************************************/
+/* Same as ip330StreamRead, but only one channel, straight into */
+/* pbuf. *ptime gets the time of the last sample read.          */
+/****************************************************************/
+int ip330StreamReadChannel(IP330_ID pcard, UINT16 channel, UINT32 * pcursor, UINT16 * pbuf, int maxsamples, epicsTimeStamp * ptime, UINT32 * plost)
+{
+    int n, loop;
+    UINT32 mask;
+
+    if(!pcard || !pcard->stream || !pcursor || !pbuf || maxsamples < 0)
+    {
+        errlogPrintf("ip330StreamReadChannel: stream is not enabled or bad parameters!\n");
+        return -1;
+    }
+
+    if(channel < pcard->start_channel || channel > pcard->end_channel)
+    {
+        errlogPrintf("Bad channel number %d in ip330StreamReadChannel card %s\n", channel, pcard->cardname);
+        return -1;
+    }
+
+    mask = pcard->stream_size - 1;
+    do
+    {
+        n = ip330StreamWindow(pcard, pcursor, maxsamples, plost);
+        for(loop = 0; loop < n; loop++)
+            pbuf[loop] = pcard->stream[(*pcursor + loop) & mask].data[channel];
+        if(n > 0 && ptime)
+            *ptime = pcard->stream[(*pcursor + n - 1) & mask].time;
+    } while(!ip330StreamIntact(pcard, *pcursor));
+
+    *pcursor += n;
+    return n;
+}
+
+/****************************************************************/
+/* Whole frames, channels start_channel to end_channel of each  */
+/* frame one after another. maxsamples is rounded down to whole */
+/* frames. Returns the number of samples read.                  */
+/****************************************************************/
+int ip330StreamReadFrames(IP330_ID pcard, UINT32 * pcursor, UINT16 * pbuf, int maxsamples, epicsTimeStamp * ptime, UINT32 * plost)
+{
+    int n, nchnl, loop;
+    UINT32 mask;
+    IP330_STREAM_FRAME * pframe;
+
+    if(!pcard || !pcard->stream || !pcursor || !pbuf || maxsamples < 0)
+    {
+        errlogPrintf("ip330StreamReadFrames: stream is not enabled or bad parameters!\n");
+        return -1;
+    }
+
+    nchnl = pcard->end_channel - pcard->start_channel + 1;
+    mask = pcard->stream_size - 1;
+    do
+    {
+        n = ip330StreamWindow(pcard, pcursor, maxsamples/nchnl, plost);
+        for(loop = 0; loop < n; loop++)
+        {
+            pframe = &(pcard->stream[(*pcursor + loop) & mask]);
+            memcpy(pbuf + loop*nchnl, &(pframe->data[pcard->start_channel]), nchnl * sizeof(UINT16));
+        }
+        if(n > 0 && ptime)
+            *ptime = pcard->stream[(*pcursor + n - 1) & mask].time;
+    } while(!ip330StreamIntact(pcard, *pcursor));
+
+    *pcursor += n;
+    return n * nchnl;
+}
+
+IOSCANPVT * ip330StreamGetIoScanPVT(IP330_ID pcard)
+{
+    if(!pcard || !pcard->stream)
+    {
+        errlogPrintf("ip330StreamGetIoScanPVT: stream is not enabled!\n");
+        return NULL;
+    }
+    return &(pcard->stream_ioscan);
+}
+
+/***********************************************************************/
+/* Append the conversions of one raw frame to the stream               */
+/* Called from worker thread only                                      */
+/***********************************************************************/
+static void ip330StreamPush(IP330_ID pcard, IP330_RAW_FRAME * praw)
+{
+    int buf, loop;
+    UINT32 head;
+    IP330_STREAM_FRAME * pframe;
+
+    for(buf = 0; buf < 2; buf++)
+    {
+        if(!(praw->buf_avail & (IP330_BUF0_AVAIL << buf))) continue;
+
+        head = pcard->stream_head;
+        pframe = &(pcard->stream[head & (pcard->stream_size - 1)]);
+        pframe->seq = head;
+        pframe->time = praw->time;
+        if(pcard->inp_typ == INP_TYP_DIFF)
+        {/* buf1 is the second conversion of the same channels */
+            for(loop = pcard->start_channel; loop <= pcard->end_channel; loop++)
+                pframe->data[loop] = praw->data[loop + 16*buf];
+        }
+        else
+        {
+            for(loop = pcard->start_channel; loop <= pcard->end_channel; loop++)
+                pframe->data[loop] = praw->data[loop];
+        }
+        epicsAtomicWriteMemoryBarrier();
+        pcard->stream_head = head + 1;
+
+        if(((head + 1) % pcard->stream_block) == 0) scanIoRequest(pcard->stream_ioscan);
+    }
+}
+
+/***********************************************************************/
+/* Copy acc_sum into a free frame and make it the latest one.         */
+/* If no scan is still busy with the pinned frame, pin the new frame   */
+/* and trigger the records. Called from worker thread only.            */
+/***********************************************************************/
+static void ip330PublishFrame(IP330_GROUP * pgroup, IP330_RAW_FRAME * praw)
+{
+    IP330_ID pcard = pgroup->pcard;
+    int loop, index, old, mask;
+    IP330_FRAME * pframe;
+
+    /* The buffer to write is neither the latest nor the pinned one */
+    for(index = 0; index < N_IP330_FRAMES; index++)
+    {
+        if(index != pgroup->frame_latest && index != pgroup->frame_pinned) break;
+    }
+    pframe = &(pgroup->frame[index]);
+
+    pframe->wseq++;
+    epicsAtomicWriteMemoryBarrier();
+    if(++pgroup->frame_seq == 0) pgroup->frame_seq = 1;	/* 0 is reserved for no data */
+    pframe->seq = pgroup->frame_seq;
+    pframe->time = praw->time;
+    pframe->mono = praw->mono;
+    for(loop = 0; loop < MAX_IP330_CHANNELS; loop++)
+    {
+        pframe->sum[loop] = pgroup->acc_sum[loop];
+        if(pgroup->ema_shift)
+            pframe->count[loop] = pgroup->acc_count[loop] ? IP330_EMA_ONE : 0;
+        else
+            pframe->count[loop] = pgroup->acc_count[loop];
+    }
+    epicsAtomicWriteMemoryBarrier();
+    pframe->wseq++;
+
+    pgroup->frame_latest = index;
+
+    if(epicsAtomicGetIntT(&(pgroup->scan_pending)))
+    {/* Records are still busy with the pinned frame, they will never see this one */
+        ip330CntBegin(pcard);
+        pcard->cnt[IP330_CNT_SCAN_DROPPED]++;
+        ip330CntEnd(pcard);
+    }
+    else
+    {
+        pgroup->frame_pinned = index;
+        epicsAtomicSetIntT(&(pgroup->scan_pending), IP330_SCAN_PRIO_ALL);
+        mask = scanIoRequest(pgroup->ioscan);
+        ip330HistAdd(&(pcard->hist_scan), epicsMonotonicGet() - praw->mono);
+        /* Drop priorities with no records, ip330ScanComplete may already have cleared some bits */
+        do
+        {
+            old = epicsAtomicGetIntT(&(pgroup->scan_pending));
+        } while(epicsAtomicCmpAndSwapIntT(&(pgroup->scan_pending), old, old & mask) != old);
+    }
+}
+
+/***********************************************************************/
+/* All records of one callback priority finished with the pinned frame */
+/***********************************************************************/
+static void ip330ScanComplete(void *arg, IOSCANPVT ioscan, int prio)
+{
+    int old;
+    IP330_GROUP * pgroup = (IP330_GROUP *)arg;
+
+    do
+    {
+        old = epicsAtomicGetIntT(&(pgroup->scan_pending));
+    } while(epicsAtomicCmpAndSwapIntT(&(pgroup->scan_pending), old, old & ~(1 << prio)) != old);
+}
+
+/***********************************************************************/
+/* Add one raw frame to the group's acc_sum. Returns 1 when the group  */
+/* has a full averaging cycle. Called from worker thread only          */
+/***********************************************************************/
+static int ip330GroupAdd(IP330_GROUP * pgroup, IP330_RAW_FRAME * praw)
+{
+    int loop, buf;
+    epicsInt64 sample;
+
+    /* Trimmed away at iocInit, no record reads it */
+    if(pgroup->start_channel > pgroup->end_channel) return 0;
+
+    for(buf = 0; buf < 2; buf++)
+    {
+        if(!(praw->buf_avail & (IP330_BUF0_AVAIL << buf))) continue;
+
+        /* Boxcar never takes more than avg_times, the rest of the frame is dropped */
+        if(!pgroup->ema_shift && pgroup->acc_count[pgroup->end_channel] >= pgroup->avg_times) break;
+
+        for(loop = pgroup->start_channel; loop <= pgroup->end_channel; loop++)
+        {
+            sample = praw->data[loop + 16*buf];
+            if(pgroup->ema_shift)
+            {
+                sample <<= IP330_EMA_QBITS;
+                if(pgroup->ema_seeded)
+                    pgroup->acc_sum[loop] += (sample - pgroup->acc_sum[loop]) >> pgroup->ema_shift;
+                else
+                    pgroup->acc_sum[loop] = sample;
+            }
+            else
+            {
+                pgroup->acc_sum[loop] += sample;
+            }
+            pgroup->acc_count[loop]++;
+        }
+        pgroup->ema_seeded = 1;
+    }
+
+    return pgroup->acc_count[pgroup->end_channel] >= pgroup->avg_times;
+}
+
+/***********************************************************************/
+/* Publish the group's cycle and start the next one                    */
+/***********************************************************************/
+static void ip330GroupPublish(IP330_GROUP * pgroup, IP330_RAW_FRAME * praw)
+{
+    int loop;
+
+    ip330PublishFrame(pgroup, praw);
+
+    /* Boxcar starts over, EMA carries on */
+    for(loop = pgroup->start_channel; loop <= pgroup->end_channel; loop++)
+    {
+        if(!pgroup->ema_shift) pgroup->acc_sum[loop] = 0;
+        pgroup->acc_count[loop] = 0;
+    }
+}
+
+/***********************************************************************/
+/* Add one raw frame to all groups, stop scan and publish if needed    */
+/* Called from worker thread only                                      */
+/***********************************************************************/
+static void ip330Accumulate(IP330_ID pcard, IP330_RAW_FRAME * praw)
+{
+    int loop;
+
+    if(ip330GroupAdd(&(pcard->group), praw))
+    {
+        if( (pcard->avg_rst) && ((pcard->scan_mode == SCAN_MODE_UNIFORMCONT) || (pcard->scan_mode == SCAN_MODE_BURSTCONT)) )
+        {
+            int ntimes = 0;
+            UINT16 saved_ctrl;
+            saved_ctrl = pcard->pHardware->controlReg;
+            pcard->pHardware->controlReg = (saved_ctrl) & 0xF8FF; /* Disable scan */
+            while(ntimes++ < 1000)
+            {
+                if(!(pcard->pHardware->controlReg & 0x0700)) break;
+            }
+            if (ntimes == 1000) errlogPrintf("IP330 %s: Disable scan error\n", pcard->cardname);
+            /* Work around hardware bug of uniform continuous mode */
+            if(pcard->scan_mode == SCAN_MODE_UNIFORMCONT) pcard->pHardware->startChannel = pcard->start_channel;
+
+            /* Whatever the ISR queued before the restart belongs to the old scan */
+            pcard->raw_discard = pcard->raw_head;
+            pcard->pHardware->controlReg = saved_ctrl;
+        }
+        ip330GroupPublish(&(pcard->group), praw);
+    }
+
+    /* Other groups have their own rates, they never reset the scan */
+    for(loop = 0; loop < pcard->ngroups; loop++)
+    {
+        if(ip330GroupAdd(pcard->groups[loop], praw))
+            ip330GroupPublish(pcard->groups[loop], praw);
+    }
+}
+
+/***********************************************************************/
+/* Run each conversion of the raw frame through the filter and average */
+/* the decimated output. Called from worker thread only                */
+/***********************************************************************/
+static void ip330Filter(IP330_ID pcard, IP330_RAW_FRAME * praw)
+{
+    int buf;
+    IP330_RAW_FRAME out;
+
+    out.buf_avail = IP330_BUF0_AVAIL;
+    out.time = praw->time;
+    out.mono = praw->mono;
+    for(buf = 0; buf < 2; buf++)
+    {
+        if(!(praw->buf_avail & (IP330_BUF0_AVAIL << buf))) continue;
+
+        /* buf1 of a differential frame is the next conversion of the same channels */
+        if(ip330FilterProcess(pcard->filter, praw->data + 16*buf, out.data, pcard->num_chnl))
+            ip330Accumulate(pcard, &out);
+    }
+}
+
+/***********************************************************************/
+/* Count missed data, partly converted buffers and interrupts without  */
+/* any complete buffer. Called from worker thread only                 */
+/***********************************************************************/
+static void ip330CountFlags(IP330_ID pcard, IP330_RAW_FRAME * praw)
+{
+    int buf, loop;
+    UINT32 flags, missed, partial;
+    size_t overflow;
+
+    if(pcard->inp_typ == INP_TYP_DIFF)
+    {/* Both buffers hold the same channels, bit 16+n of the flags is channel n */
+        missed = (praw->misseddata_flag | (praw->misseddata_flag >> 16)) & 0xFFFF;
+        partial = 0;
+        for(buf = 0; buf < 2; buf++)
+        {
+            flags = (praw->newdata_flag >> (16*buf)) & 0xFFFF;
+            if(flags && flags != pcard->chnl_mask) partial |= pcard->chnl_mask & ~flags;
+        }
+    }
+    else
+    {
+        missed = praw->misseddata_flag;
+        flags = praw->newdata_flag;
+        partial = (flags && flags != pcard->chnl_mask) ? (pcard->chnl_mask & ~flags) : 0;
+    }
+
+    overflow = epicsAtomicGetSizeT(&(pcard->isr_overflow));
+
+    if(praw->buf_avail && !missed && !partial && overflow == pcard->isr_overflow_seen) return;
+
+    ip330CntBegin(pcard);
+
+    /* Unsigned difference is right even after isr_overflow wrapped */
+    pcard->cnt[IP330_CNT_OVERFLOW] += (size_t)(overflow - pcard->isr_overflow_seen);
+    pcard->isr_overflow_seen = overflow;
+
+    if(!praw->buf_avail)
+    {
+        pcard->cnt[IP330_CNT_UNEXPECTED]++;
+        pcard->last_unexpected = praw->newdata_flag;
+    }
+
+    if(missed)
+    {
+        pcard->cnt[IP330_CNT_MISSED]++;
+        for(loop = pcard->start_channel; loop <= pcard->end_channel; loop++)
+            if(missed & (1 << loop)) pcard->cnt_chnl[IP330_CNT_MISSED][loop]++;
+    }
+
+    if(partial)
+    {
+        pcard->cnt[IP330_CNT_PARTIAL]++;
+        for(loop = pcard->start_channel; loop <= pcard->end_channel; loop++)
+            if(partial & (1 << loop)) pcard->cnt_chnl[IP330_CNT_PARTIAL][loop]++;
+    }
+
+    ip330CntEnd(pcard);
+}
+
+/***********************************************************************/
+/* One line summary of what the counters did since the last one, so a  */
+/* card in trouble does not flood the log. Called from worker only     */
+/***********************************************************************/
+static void ip330CounterLog(IP330_ID pcard, epicsUInt64 now)
+{
+    epicsUInt64 cnt[N_IP330_CNT];
+    int loop, changed = 0;
+
+    for(loop = 0; loop < N_IP330_CNT; loop++)
+    {/* The worker is the writer, no need for cnt_seq */
+        cnt[loop] = pcard->cnt[loop];
+        if(cnt[loop] != pcard->cnt_logged[loop]) changed = 1;
+    }
+
+    if(changed)
+    {
+        errlogPrintf("IP330 %s: in %.1fs %lu missed data, %lu partial, %lu unexpected (last 0x%08x), %lu scans dropped, %lu ring overflows\n",
+                     pcard->cardname, (now - pcard->cnt_logged_mono)/1e9,
+                     (unsigned long)(cnt[IP330_CNT_MISSED] - pcard->cnt_logged[IP330_CNT_MISSED]),
+                     (unsigned long)(cnt[IP330_CNT_PARTIAL] - pcard->cnt_logged[IP330_CNT_PARTIAL]),
+                     (unsigned long)(cnt[IP330_CNT_UNEXPECTED] - pcard->cnt_logged[IP330_CNT_UNEXPECTED]), pcard->last_unexpected,
+                     (unsigned long)(cnt[IP330_CNT_SCAN_DROPPED] - pcard->cnt_logged[IP330_CNT_SCAN_DROPPED]),
+                     (unsigned long)(cnt[IP330_CNT_OVERFLOW] - pcard->cnt_logged[IP330_CNT_OVERFLOW]));
+        for(loop = 0; loop < N_IP330_CNT; loop++) pcard->cnt_logged[loop] = cnt[loop];
+    }
+
+    pcard->cnt_logged_mono = now;
+}
+
+/****************************************************************/
+/* Park the worker between two frames, so another thread may    */
+/* change raw_discard, the groups and the scan registers. The   */
+/* ring keeps filling, the worker drains it once resumed.       */
+/* Task level only, never from the worker itself.               */
+/****************************************************************/
+void ip330WorkerPause(IP330_ID pcard)
+{
+    epicsMutexLock(pcard->worker_pause_lock);
+    pcard->worker_cmd = IP330_WORKER_PAUSE;
+    epicsEventSignal(pcard->raw_event);
+    epicsEventMustWait(pcard->worker_ack);
+}
+
+void ip330WorkerResume(IP330_ID pcard)
+{
+    pcard->worker_cmd = IP330_WORKER_RUN;
+    epicsEventSignal(pcard->worker_resume);
+    epicsMutexUnlock(pcard->worker_pause_lock);
+}
+
+/***********************************************************************/
+/* Bottom half, one per card. Drain the raw ring filled by ip330ISR    */
+/***********************************************************************/
+static void ip330Worker(void * arg)
+{
+    IP330_ID pcard = (IP330_ID)arg;
+    IP330_RAW_FRAME * praw;
+    UINT32 tail;
+
+    while(TRUE)
+    {
+        epicsEventMustWait(pcard->raw_event);
+
+        if(pcard->worker_cmd == IP330_WORKER_STOP)
+        {/* Last touch of pcard, ip330Create frees it */
+            epicsEventSignal(pcard->worker_ack);
+            return;
+        }
+        if(pcard->worker_cmd == IP330_WORKER_PAUSE)
+        {/* Hands over raw_discard, the scan registers and the groups until resumed */
+            epicsEventSignal(pcard->worker_ack);
+            epicsEventMustWait(pcard->worker_resume);
+        }
+
+        tail = pcard->raw_tail;
+        while(tail != pcard->raw_head)
+        {
+            epicsAtomicReadMemoryBarrier();
+            praw = &(pcard->raw_ring[tail & IP330_RAW_RING_MASK]);
+
+            if(pcard->stream) ip330StreamPush(pcard, praw);
+            if(pcard->history) ip330HistoryPush(pcard, praw);
+
+            if((int)(tail - pcard->raw_discard) >= 0)
+            {
+                if(praw->buf_avail && pcard->filter)
+                    ip330Filter(pcard, praw);
+                else if(praw->buf_avail)
+                    ip330Accumulate(pcard, praw);
+
+                ip330CountFlags(pcard, praw);
+                if(pcard->sync && praw->buf_avail) ip330SyncPush(pcard, praw);
+            }
+
+            if(praw->mono - pcard->cnt_logged_mono >= IP330_CNT_LOG_INTERVAL_NS) ip330CounterLog(pcard, praw->mono);
+
+            tail++;
+            /* Slot must be fully consumed before the ISR may reuse it */
+            epicsAtomicWriteMemoryBarrier();
+            pcard->raw_tail = tail;
+        }
+    }
+}
+
+/***********************************************************************/
+/* Read the flags and data of one interrupt into a raw frame. There is */
+/* one reader per input type and channel range, ip330SelectRead picks  */
+/* one, so the ISR has no configuration branch. FIRST, LAST and MASK   */
+/* are constants in the full range readers and their loops unroll.     */
+/* A trimmed card, the usual case with IP330_AUTO_TRIM, runs one of    */
+/* the readers for a fixed count of up to IP330_READ_N_MAX channels,   */
+/* only the first channel and the mask come from pcard. Longer ranges  */
+/* use the Range readers. D32 readers move two data registers per bus  */
+/* access through ipacBulkRead16, see ipacBulk.h, so they have no      */
+/* fixed count variant: nothing in that call would unroll.             */
+/***********************************************************************/
+#define IP330_COPY_DATA(D32, FIRST, LAST, OFF)					\
+    if(D32)									\
+        ipacBulkRead16(&(pcard->pHardware->data[(FIRST)+(OFF)]), &(praw->data[(FIRST)+(OFF)]), (LAST)-(FIRST)+1, 1);	\
+    else									\
+        for(loop = (FIRST); loop <= (LAST); loop++)				\
+            praw->data[loop+(OFF)] = pcard->pHardware->data[loop+(OFF)];
+
+#define IP330_DEFINE_READ_DIFF(name, FIRST, LAST, MASK, D32)			\
+static void name(IP330_ID pcard, IP330_RAW_FRAME * praw)			\
+{/* Input type is differential, we have buf0 and buf1 */			\
+    int loop;									\
+    UINT16 newdata_flag0, newdata_flag1;					\
+										\
+    newdata_flag0 = (pcard->pHardware->newData[0]) & (MASK);			\
+    newdata_flag1 = (pcard->pHardware->newData[1]) & (MASK);			\
+    praw->newdata_flag = ((newdata_flag1 << 16) | newdata_flag0);		\
+    praw->misseddata_flag = (((pcard->pHardware->missedData[1] & (MASK)) << 16) |	\
+                             (pcard->pHardware->missedData[0] & (MASK)));	\
+										\
+    if(newdata_flag0 == (MASK))							\
+    {/* Read Data from buf0 */							\
+        IP330_COPY_DATA(D32, FIRST, LAST, 0)					\
+        praw->buf_avail |= IP330_BUF0_AVAIL;					\
+    }										\
+										\
+    if(newdata_flag1 == (MASK))							\
+    {/* Read Data from buf1 */							\
+        IP330_COPY_DATA(D32, FIRST, LAST, 16)					\
+        praw->buf_avail |= IP330_BUF1_AVAIL;					\
+    }										\
+}
+
+#define IP330_DEFINE_READ_SE(name, FIRST, LAST, MASK, D32)			\
+static void name(IP330_ID pcard, IP330_RAW_FRAME * praw)			\
+{/* Input type is single-end, there is only buf0 */				\
+    int loop;									\
+										\
+    praw->newdata_flag = ((pcard->pHardware->newData[1] << 16) | pcard->pHardware->newData[0]) & (MASK);	\
+    praw->misseddata_flag = ((pcard->pHardware->missedData[1] << 16) | pcard->pHardware->missedData[0]) & (MASK);	\
+										\
+    if(praw->newdata_flag == (MASK))						\
+    {/* Read Data */								\
+        IP330_COPY_DATA(D32, FIRST, LAST, 0)					\
+        praw->buf_avail |= IP330_BUF0_AVAIL;					\
+    }										\
+}
+
+/* Fixed count of channels from start_channel, the loops unroll */
+#define IP330_DEFINE_READ_N(N)							\
+IP330_DEFINE_READ_DIFF(ip330ReadDiff##N, pcard->start_channel, pcard->start_channel + (N) - 1, pcard->chnl_mask, 0)	\
+IP330_DEFINE_READ_SE(ip330ReadSe##N, pcard->start_channel, pcard->start_channel + (N) - 1, pcard->chnl_mask, 0)
+
+IP330_DEFINE_READ_N(1)
+IP330_DEFINE_READ_N(2)
+IP330_DEFINE_READ_N(3)
+IP330_DEFINE_READ_N(4)
+IP330_DEFINE_READ_N(5)
+IP330_DEFINE_READ_N(6)
+IP330_DEFINE_READ_N(7)
+IP330_DEFINE_READ_N(8)
+IP330_DEFINE_READ_N(9)
+IP330_DEFINE_READ_N(10)
+IP330_DEFINE_READ_N(11)
+IP330_DEFINE_READ_N(12)
+IP330_DEFINE_READ_N(13)
+IP330_DEFINE_READ_N(14)
+IP330_DEFINE_READ_N(15)
+IP330_DEFINE_READ_N(16)
+
+/* Differential cards have at most 16 channels, so no Range reader without D32 */
+#define IP330_READ_N_MAX	16
+
+static void (* const ip330ReadDiffN[IP330_READ_N_MAX])(IP330_ID pcard, IP330_RAW_FRAME * praw) =
+{
+    ip330ReadDiff1, ip330ReadDiff2, ip330ReadDiff3, ip330ReadDiff4, ip330ReadDiff5, ip330ReadDiff6, ip330ReadDiff7, ip330ReadDiff8,
+    ip330ReadDiff9, ip330ReadDiff10, ip330ReadDiff11, ip330ReadDiff12, ip330ReadDiff13, ip330ReadDiff14, ip330ReadDiff15, ip330ReadDiff16
+};
+
+static void (* const ip330ReadSeN[IP330_READ_N_MAX])(IP330_ID pcard, IP330_RAW_FRAME * praw) =
+{
+    ip330ReadSe1, ip330ReadSe2, ip330ReadSe3, ip330ReadSe4, ip330ReadSe5, ip330ReadSe6, ip330ReadSe7, ip330ReadSe8,
+    ip330ReadSe9, ip330ReadSe10, ip330ReadSe11, ip330ReadSe12, ip330ReadSe13, ip330ReadSe14, ip330ReadSe15, ip330ReadSe16
+};
+
+IP330_DEFINE_READ_DIFF(ip330ReadDiffAll, 0, 15, 0xFFFF, 0)
+IP330_DEFINE_READ_SE(ip330ReadSeAll, 0, 31, 0xFFFFFFFF, 0)
+IP330_DEFINE_READ_SE(ip330ReadSeRange, pcard->start_channel, pcard->end_channel, pcard->chnl_mask, 0)
+IP330_DEFINE_READ_DIFF(ip330ReadDiffAllD32, 0, 15, 0xFFFF, 1)
+IP330_DEFINE_READ_DIFF(ip330ReadDiffRangeD32, pcard->start_channel, pcard->end_channel, pcard->chnl_mask, 1)
+IP330_DEFINE_READ_SE(ip330ReadSeAllD32, 0, 31, 0xFFFFFFFF, 1)
+IP330_DEFINE_READ_SE(ip330ReadSeRangeD32, pcard->start_channel, pcard->end_channel, pcard->chnl_mask, 1)
+
+/****************************************************************/
+/* Pick the reader of ip330ISR for the current input type and   */
+/* channel range. Only while the card can not interrupt         */
+/****************************************************************/
+static void ip330SelectRead(IP330_ID pcard)
+{
+    int nchannels = pcard->end_channel - pcard->start_channel + 1;
+
+    if(pcard->inp_typ == INP_TYP_DIFF && pcard->d32)
+        pcard->isr_read = (pcard->start_channel == 0 && pcard->end_channel == 15) ? ip330ReadDiffAllD32 : ip330ReadDiffRangeD32;
+    else if(pcard->inp_typ == INP_TYP_DIFF)
+        pcard->isr_read = (pcard->start_channel == 0 && pcard->end_channel == 15) ? ip330ReadDiffAll : ip330ReadDiffN[nchannels - 1];
+    else if(pcard->d32)
+        pcard->isr_read = (pcard->start_channel == 0 && pcard->end_channel == 31) ? ip330ReadSeAllD32 : ip330ReadSeRangeD32;
+    else if(pcard->start_channel == 0 && pcard->end_channel == 31)
+        pcard->isr_read = ip330ReadSeAll;
+    else
+        pcard->isr_read = (nchannels <= IP330_READ_N_MAX) ? ip330ReadSeN[nchannels - 1] : ip330ReadSeRange;
+}
+
+/***********************************************************************/
+/* Read data from mailbox, check dual level buffer if needed           */
+/* Only copy the raw frame into the ring, ip330Worker does the rest    */
+/***********************************************************************/
+static void ip330ISR(int arg)
+{
+    UINT32 head;
+    IP330_RAW_FRAME * praw;
+    epicsUInt64 entry, period;
+
+    IP330_ID pcard = (IP330_ID)arg;
+
+    entry = epicsMonotonicGet();
+    if(pcard->isr_last)
+    {/* Without a nominal period, jitter is against the previous period */
+        period = entry - pcard->isr_last;
+        if(pcard->period_ns)
+            ip330HistAdd(&(pcard->hist_jitter), period > pcard->period_ns ? period - pcard->period_ns : pcard->period_ns - period);
+        else if(pcard->isr_period)
+            ip330HistAdd(&(pcard->hist_jitter), period > pcard->isr_period ? period - pcard->isr_period : pcard->isr_period - period);
+        pcard->isr_period = period;
+    }
+    pcard->isr_last = entry;
+
+    ipmIrqCmd(pcard->carrier, pcard->slot, 0, ipac_irqDisable);
+    if(IP330_DRV_DEBUG) epicsInterruptContextMessage("IP330 ISR called\n");
+
+    head = pcard->raw_head;
+    if(head - pcard->raw_tail >= N_IP330_RAW_RING)
+    {/* Worker fell behind, still read the data to clear newData flags */
+        praw = &(pcard->raw_scratch);
+        epicsAtomicIncrSizeT(&(pcard->isr_overflow));
+    }
+    else
+    {
+        praw = &(pcard->raw_ring[head & IP330_RAW_RING_MASK]);
+    }
+
+    praw->buf_avail = 0;
+    praw->mono = entry;
+    epicsTimeGetCurrentInt(&(praw->time));
+
+    pcard->isr_read(pcard, praw);
+    pcard->isr_count++;
+
+    /* Even when the ring is full, protection must not depend on the worker */
+    if(pcard->interlock && praw->buf_avail) ip330InterlockCheck(pcard, praw);
+
+    if(praw != &(pcard->raw_scratch))
+    {
+        /* Frame must be complete before the worker can see it */
+        epicsAtomicWriteMemoryBarrier();
+        pcard->raw_head = head + 1;
+        epicsEventSignal(pcard->raw_event);
+    }
+
+    ipmIrqCmd(pcard->carrier, pcard->slot, 0, ipac_irqClear);
+    ipmIrqCmd(pcard->carrier, pcard->slot, 0, ipac_irqEnable);
+
+    ip330HistAdd(&(pcard->hist_isr), epicsMonotonicGet() - entry);
+}
+
+/***********************************************************************/
+/* Software trigger                                                    */
+/***********************************************************************/
+void ip330StartConvert(IP330_ID pcard)
+{
+    if(pcard)
+    {
+        if(pcard->trg_dir == TRG_DIR_OUTPUT)
+            pcard->pHardware->startConvert = 0x1;
+    }
+}
+
+void ip330StartConvertByName(char * cardname)
+{
+    IP330_ID pcard = ip330GetByName(cardname);
+    ip330StartConvert(pcard);
+}
+
+/****************************************************************/
+/* Print the error counters of one card with the average rates  */
+/****************************************************************/
+static void ip330CounterPrint(IP330_ID pcard)
+{
+    static const char * cntName[N_IP330_CNT] = {"missed data", "partial", "unexpected", "scans dropped", "ring overflows"};
+    epicsUInt64 cnt;
+    double seconds;
+    int loop;
+
+    seconds = (epicsMonotonicGet() - pcard->cnt_start_mono)/1e9;
+    if(seconds <= 0.0) seconds = 1.0;
+
+    for(loop = 0; loop < N_IP330_CNT; loop++)
+    {
+        ip330GetCounter(pcard, loop, -1, &cnt);
+        printf("\t%s: %.0f (%.3g/s)\n", cntName[loop], (double)cnt, (double)cnt/seconds);
+    }
+}
+
+/****************************************************************/
+/* Print the timing histograms of one card                      */
+/****************************************************************/
+static void ip330TimingPrint(IP330_ID pcard)
+{
+    printf("\tIP330 %s timing, nominal interrupt period %gus\n", pcard->cardname, pcard->period_ns/1000.0);
+    ip330HistReport(&(pcard->hist_isr), "ISR duration");
+    ip330HistReport(&(pcard->hist_jitter), pcard->period_ns ? "Interrupt period jitter" : "Interrupt period change");
+    ip330HistReport(&(pcard->hist_scan), "ISR to scanIoRequest");
+    ip330HistReport(&(pcard->hist_read), "ISR to ip330Read");
+}
+
+/****************************************************************/
+/* Print, and optionally clear, the timing histograms of the    */
+/* named card, or of all cards if cardname is NULL or empty     */
+/****************************************************************/
+int ip330TimingReport(char * cardname, int reset)
+{
+    IP330_ID pcard;
+
+    if(!card_list_inited)
+    {
+        printf("IP330 card link list is not inited yet!\n");
+        return -1;
+    }
+
+    for(pcard=(IP330_ID)ellFirst((ELLLIST *)&ip330_card_list); pcard; pcard = (IP330_ID)ellNext((ELLNODE *)pcard))
+    {
+        if(cardname && *cardname && strcmp(cardname, pcard->cardname)) continue;
+
+        ip330TimingPrint(pcard);
+        if(reset)
+        {
+            ip330HistReset(&(pcard->hist_isr));
+            ip330HistReset(&(pcard->hist_jitter));
+            ip330HistReset(&(pcard->hist_scan));
+            ip330HistReset(&(pcard->hist_read));
+        }
+    }
+
+    return 0;
+}
+
+/**************************************************************************************************/
+/* Here we supply the driver report function for epics                                            */
+/**************************************************************************************************/
+static  long    IP330_EPICS_Report(int level);
+
+const struct drvet drvIP330 = {2,                              /*2 Table Entries */
+                              (DRVSUPFUN) IP330_EPICS_Report,  /* Driver Report Routine */
+                              NULL}; /* Driver Initialization Routine */
+
+epicsExportAddress(drvet,drvIP330);
+
+/* implementation */
+static long IP330_EPICS_Report(int level)
+{
+    IP330_ID pcard;
+    IP330_GROUP * pgroup;
+    int loop;
+
+    printf("\n"IP330_DRV_VERSION"\n\n");
+
+    if(!card_list_inited)
+    {
+        printf("IP330 card link list is not inited yet!\n\n");
+        return 0;
+    }
+
+    if(level > 0)   /* we only get into link list for detail when user wants */
+    {
+        for(pcard=(IP330_ID)ellFirst((ELLLIST *)&ip330_card_list); pcard; pcard = (IP330_ID)ellNext((ELLNODE *)pcard))
+        {
+            printf("\tIP330 card %s is installed on carrier %d slot %d\n", pcard->cardname, pcard->carrier, pcard->slot);
+
+            if(level > 1)
+            {
+                printf("\tInput range is %s, chnl%d~chnl%d is in use, scan mode is %s\n", rangeName[pcard->inp_typ*N_RANGES+pcard->inp_range], pcard->start_channel, pcard->end_channel, scanModeName[pcard->scan_mode]);
+                if(pcard->group.ema_shift)
+                    printf("\tTrigger direction is %s, moving average 1/%d published every %d samples, timer is %gus\n", trgDirName[pcard->trg_dir], 1 << pcard->group.ema_shift, pcard->group.avg_times, pcard->timer_prescaler*pcard->conversion_timer/8.0);
+                else
+                    printf("\tTrigger direction is %s, average %d times %s reset, timer is %gus\n", trgDirName[pcard->trg_dir], pcard->group.avg_times, pcard->avg_rst?"with":"without", pcard->timer_prescaler*pcard->conversion_timer/8.0);
+                printf("\tLatest frame is #%u, I/O Intr scan %s\n", pcard->group.frame_seq, pcard->group.scan_pending?"in progress":"idle");
+                for(loop = 0; loop < pcard->ngroups; loop++)
+                {
+                    pgroup = pcard->groups[loop];
+                    printf("\tGroup %s: chnl%d~chnl%d, ", pgroup->name, pgroup->start_channel, pgroup->end_channel);
+                    if(pgroup->ema_shift)
+                        printf("moving average 1/%d published every %d samples", 1 << pgroup->ema_shift, pgroup->avg_times);
+                    else
+                        printf("average %d times", pgroup->avg_times);
+                    printf(", latest frame is #%u, I/O Intr scan %s\n", pgroup->frame_seq, pgroup->scan_pending?"in progress":"idle");
+                }
+                printf("\tWorker ring holds %u of %d raw frames\n", pcard->raw_head - pcard->raw_tail, N_IP330_RAW_RING);
+                ip330CalReport(pcard);
+                ip330CounterPrint(pcard);
+                if(pcard->filter) ip330FilterReport(pcard->filter);
+                if(pcard->sync) ip330SyncReport(pcard);
+                if(pcard->interlock) ip330InterlockReport(pcard);
+                if(pcard->history) ip330HistoryReport(pcard);
+                if(pcard->stream) printf("\tRaw stream of %u frames, block of %u, %u frames produced\n", pcard->stream_size, pcard->stream_block, pcard->stream_head);
+                printf("\tIO space is at %p, data read with %s\nn", pcard->pHardware, pcard->d32 ? "D32" : "D16");
+            }
+
+            if(level > 2) ip330TimingPrint(pcard);
+        }
+    }
+
+    return 0;
+}
+
+/**************************************************************************************************/
+/* Here we supply the iocsh commands of IP330                                                      */
+/**************************************************************************************************/
+static const iocshArg ip330TimingReportArg0 = {"cardname", iocshArgString};
+static const iocshArg ip330TimingReportArg1 = {"reset", iocshArgInt};
+static const iocshArg * const ip330TimingReportArgs[2] = {&ip330TimingReportArg0, &ip330TimingReportArg1};
+static const iocshFuncDef ip330TimingReportFuncDef = {"ip330TimingReport", 2, ip330TimingReportArgs};
+static void ip330TimingReportCallFunc(const iocshArgBuf *args)
+{
+    ip330TimingReport(args[0].sval, args[1].ival);
+}
+
+static const iocshArg ip330GroupCreateArg0 = {"cardname", iocshArgString};
+static const iocshArg ip330GroupCreateArg1 = {"groupname", iocshArgString};
+static const iocshArg ip330GroupCreateArg2 = {"channels", iocshArgString};
+static const iocshArg ip330GroupCreateArg3 = {"average", iocshArgString};
+static const iocshArg * const ip330GroupCreateArgs[4] = {&ip330GroupCreateArg0, &ip330GroupCreateArg1, &ip330GroupCreateArg2, &ip330GroupCreateArg3};
+static const iocshFuncDef ip330GroupCreateFuncDef = {"ip330GroupCreate", 4, ip330GroupCreateArgs};
+static void ip330GroupCreateCallFunc(const iocshArgBuf *args)
+{
+    ip330GroupCreate(args[0].sval, args[1].sval, args[2].sval, args[3].sval);
+}
+
+static const iocshArg ip330StreamEnableArg0 = {"cardname", iocshArgString};
+static const iocshArg ip330StreamEnableArg1 = {"nframes", iocshArgInt};
+static const iocshArg ip330StreamEnableArg2 = {"block", iocshArgInt};
+static const iocshArg * const ip330StreamEnableArgs[3] = {&ip330StreamEnableArg0, &ip330StreamEnableArg1, &ip330StreamEnableArg2};
+static const iocshFuncDef ip330StreamEnableFuncDef = {"ip330StreamEnable", 3, ip330StreamEnableArgs};
+static void ip330StreamEnableCallFunc(const iocshArgBuf *args)
+{
+    ip330StreamEnable(args[0].sval, args[1].ival, args[2].ival);
+}
+
+static const iocshArg ip330FilterConfigArg0 = {"cardname", iocshArgString};
+static const iocshArg ip330FilterConfigArg1 = {"filter", iocshArgString};
+static const iocshArg ip330FilterConfigArg2 = {"taps", iocshArgString};
+static const iocshArg * const ip330FilterConfigArgs[3] = {&ip330FilterConfigArg0, &ip330FilterConfigArg1, &ip330FilterConfigArg2};
+static const iocshFuncDef ip330FilterConfigFuncDef = {"ip330FilterConfig", 3, ip330FilterConfigArgs};
+static void ip330FilterConfigCallFunc(const iocshArgBuf *args)
+{
+    ip330FilterConfig(args[0].sval, args[1].sval, args[2].sval);
+}
+
+static const iocshArg ip330HistoryCardArg0 = {"cardname", iocshArgString};
+static const iocshArg * const ip330HistoryCardArgs[1] = {&ip330HistoryCardArg0};
+static const iocshArg ip330HistoryCreateArg1 = {"nframes", iocshArgInt};
+static const iocshArg ip330HistoryCreateArg2 = {"post", iocshArgInt};
+static const iocshArg * const ip330HistoryCreateArgs[3] = {&ip330HistoryCardArg0, &ip330HistoryCreateArg1, &ip330HistoryCreateArg2};
+static const iocshFuncDef ip330HistoryCreateFuncDef = {"ip330HistoryCreate", 3, ip330HistoryCreateArgs};
+static void ip330HistoryCreateCallFunc(const iocshArgBuf *args)
+{
+    ip330HistoryCreate(args[0].sval, args[1].ival, args[2].ival);
+}
+
+static const iocshFuncDef ip330HistoryFreezeFuncDef = {"ip330HistoryFreeze", 1, ip330HistoryCardArgs};
+static void ip330HistoryFreezeCallFunc(const iocshArgBuf *args)
+{
+    ip330HistoryFreezeByName(args[0].sval);
+}
+
+static const iocshFuncDef ip330HistoryRearmFuncDef = {"ip330HistoryRearm", 1, ip330HistoryCardArgs};
+static void ip330HistoryRearmCallFunc(const iocshArgBuf *args)
+{
+    ip330HistoryRearmByName(args[0].sval);
+}
+
+static const iocshArg ip330HistoryDumpArg1 = {"filename", iocshArgString};
+static const iocshArg * const ip330HistoryDumpArgs[2] = {&ip330HistoryCardArg0, &ip330HistoryDumpArg1};
+static const iocshFuncDef ip330HistoryDumpFuncDef = {"ip330HistoryDump", 2, ip330HistoryDumpArgs};
+static void ip330HistoryDumpCallFunc(const iocshArgBuf *args)
+{
+    ip330HistoryDump(args[0].sval, args[1].sval);
+}
+
+static const iocshArg ip330InterlockConfigArg0 = {"cardname", iocshArgString};
+static const iocshArg ip330InterlockConfigArg1 = {"channel", iocshArgInt};
+static const iocshArg ip330InterlockConfigArg2 = {"low", iocshArgInt};
+static const iocshArg ip330InterlockConfigArg3 = {"high", iocshArgInt};
+static const iocshArg ip330InterlockConfigArg4 = {"hyst", iocshArgInt};
+static const iocshArg * const ip330InterlockConfigArgs[5] = {&ip330InterlockConfigArg0, &ip330InterlockConfigArg1, &ip330InterlockConfigArg2, &ip330InterlockConfigArg3, &ip330InterlockConfigArg4};
+static const iocshFuncDef ip330InterlockConfigFuncDef = {"ip330InterlockConfig", 5, ip330InterlockConfigArgs};
+static void ip330InterlockConfigCallFunc(const iocshArgBuf *args)
+{
+    ip330InterlockConfig(args[0].sval, args[1].ival, args[2].ival, args[3].ival, args[4].ival);
+}
+
+static const iocshArg ip330InterlockOutputArg1 = {"outtype", iocshArgString};
+static const iocshArg ip330InterlockOutputArg2 = {"outcard", iocshArgString};
+static const iocshArg ip330InterlockOutputArg3 = {"port", iocshArgInt};
+static const iocshArg ip330InterlockOutputArg4 = {"bit", iocshArgInt};
+static const iocshArg ip330InterlockOutputArg5 = {"level", iocshArgInt};
+static const iocshArg * const ip330InterlockOutputArgs[6] = {&ip330InterlockConfigArg0, &ip330InterlockOutputArg1, &ip330InterlockOutputArg2, &ip330InterlockOutputArg3, &ip330InterlockOutputArg4, &ip330InterlockOutputArg5};
+static const iocshFuncDef ip330InterlockOutputFuncDef = {"ip330InterlockOutput", 6, ip330InterlockOutputArgs};
+static void ip330InterlockOutputCallFunc(const iocshArgBuf *args)
+{
+    ip330InterlockOutput(args[0].sval, args[1].sval, args[2].sval, args[3].ival, args[4].ival, args[5].ival);
+}
+
+static const iocshArg * const ip330InterlockResetArgs[1] = {&ip330InterlockConfigArg0};
+static const iocshFuncDef ip330InterlockResetFuncDef = {"ip330InterlockReset", 1, ip330InterlockResetArgs};
+static void ip330InterlockResetCallFunc(const iocshArgBuf *args)
+{
+    ip330InterlockResetByName(args[0].sval);
+}
+
+static const iocshArg ip330CalCacheConfigArg0 = {"filename", iocshArgString};
+static const iocshArg ip330CalCacheConfigArg1 = {"maxage", iocshArgDouble};
+static const iocshArg * const ip330CalCacheConfigArgs[2] = {&ip330CalCacheConfigArg0, &ip330CalCacheConfigArg1};
+static const iocshFuncDef ip330CalCacheConfigFuncDef = {"ip330CalCacheConfig", 2, ip330CalCacheConfigArgs};
+static void ip330CalCacheConfigCallFunc(const iocshArgBuf *args)
+{
+    ip330CalCacheConfig(args[0].sval, args[1].dval);
+}
+
+static const iocshArg ip330CalCacheModuleArg0 = {"carrier", iocshArgInt};
+static const iocshArg ip330CalCacheModuleArg1 = {"slot", iocshArgInt};
+static const iocshArg ip330CalCacheModuleArg2 = {"serial", iocshArgString};
+static const iocshArg * const ip330CalCacheModuleArgs[3] = {&ip330CalCacheModuleArg0, &ip330CalCacheModuleArg1, &ip330CalCacheModuleArg2};
+static const iocshFuncDef ip330CalCacheModuleFuncDef = {"ip330CalCacheModule", 3, ip330CalCacheModuleArgs};
+static void ip330CalCacheModuleCallFunc(const iocshArgBuf *args)
+{
+    ip330CalCacheModule(args[0].ival, args[1].ival, args[2].sval);
+}
+
+static const iocshArg ip330CalBackgroundArg0 = {"cardname", iocshArgString};
+static const iocshArg ip330CalBackgroundArg1 = {"period", iocshArgDouble};
+static const iocshArg ip330CalBackgroundArg2 = {"nconv", iocshArgInt};
+static const iocshArg * const ip330CalBackgroundArgs[3] = {&ip330CalBackgroundArg0, &ip330CalBackgroundArg1, &ip330CalBackgroundArg2};
+static const iocshFuncDef ip330CalBackgroundFuncDef = {"ip330CalBackground", 3, ip330CalBackgroundArgs};
+static void ip330CalBackgroundCallFunc(const iocshArgBuf *args)
+{
+    ip330CalBackground(args[0].sval, args[1].dval, args[2].ival);
+}
+
+static const iocshArg ip330SyncCreateArg0 = {"master", iocshArgString};
+static const iocshArg ip330SyncCreateArg1 = {"slaves", iocshArgString};
+static const iocshArg ip330SyncCreateArg2 = {"tolerance_us", iocshArgInt};
+static const iocshArg * const ip330SyncCreateArgs[3] = {&ip330SyncCreateArg0, &ip330SyncCreateArg1, &ip330SyncCreateArg2};
+static const iocshFuncDef ip330SyncCreateFuncDef = {"ip330SyncCreate", 3, ip330SyncCreateArgs};
+static void ip330SyncCreateCallFunc(const iocshArgBuf *args)
+{
+    ip330SyncCreate(args[0].sval, args[1].sval, args[2].ival);
+}
+
+static void drvIP330Registrar(void)
+{
+    iocshRegister(&ip330CalCacheConfigFuncDef, ip330CalCacheConfigCallFunc);
+    iocshRegister(&ip330CalCacheModuleFuncDef, ip330CalCacheModuleCallFunc);
+    iocshRegister(&ip330CalBackgroundFuncDef, ip330CalBackgroundCallFunc);
+    iocshRegister(&ip330TimingReportFuncDef, ip330TimingReportCallFunc);
+    iocshRegister(&ip330GroupCreateFuncDef, ip330GroupCreateCallFunc);
+    iocshRegister(&ip330SyncCreateFuncDef, ip330SyncCreateCallFunc);
+    iocshRegister(&ip330StreamEnableFuncDef, ip330StreamEnableCallFunc);
+    iocshRegister(&ip330FilterConfigFuncDef, ip330FilterConfigCallFunc);
+    iocshRegister(&ip330InterlockConfigFuncDef, ip330InterlockConfigCallFunc);
+    iocshRegister(&ip330InterlockOutputFuncDef, ip330InterlockOutputCallFunc);
+    iocshRegister(&ip330InterlockResetFuncDef, ip330InterlockResetCallFunc);
+    iocshRegister(&ip330HistoryCreateFuncDef, ip330HistoryCreateCallFunc);
+    iocshRegister(&ip330HistoryFreezeFuncDef, ip330HistoryFreezeCallFunc);
+    iocshRegister(&ip330HistoryRearmFuncDef, ip330HistoryRearmCallFunc);
+    iocshRegister(&ip330HistoryDumpFuncDef, ip330HistoryDumpCallFunc);
+}
+epicsExportRegistrar(drvIP330Registrar);
@@ -0,0 +1,628 @@
+/****************************************************************/
+/* This file runs the IP330 calibrations in parallel threads    */
+/* and keeps their results in a cache file across reboots       */
+/****************************************************************/
+#include <math.h>
+#include <epicsStdio.h>
+#include <dbAccess.h>
+
+#include "drvIP330Lib.h"
+#include "drvIP330Private.h"
+
+static char		* ip330_cal_cache = NULL;
+static double		ip330_cal_maxage = 0.0;
+static epicsMutexId	ip330_cal_lock = NULL;
+
+/* The ID PROM only tells the module revision, two modules of one revision differ by their serial */
+static struct
+{
+    int		carrier;
+    int		slot;
+    char	* serial;
+} ip330_cal_module[MAX_IP330_CAL_MODULES];
+static int		ip330_cal_nmodules = 0;
+
+static const char ip330CalHeader[] = "# IP330 calibration cache: carrier slot type range revision:serial secPastEpoch, then slope offset of each gain\n";
+
+/****************************************************************************************************/
+/*  Routine: ip330CalCacheConfig                                                                    */
+/*                                                                                                  */
+/*  Purpose: Reuse recent IP-330 calibrations at boot, keyed by carrier/slot/input range/module     */
+/*                                                                                                  */
+/*  SYNOPSIS: int ip330CalCacheConfig(                                                              */
+/*                  char *filename,       Cache file, created on the first calibration              */
+/*                  double maxage)        Seconds a cached calibration is used for                  */
+/*  Example:                                                                                        */
+/*            ip330CalCacheConfig("/data/ioc/ip330.cal", 86400)                                     */
+/*                                                                                                  */
+/*  Call it before ip330Create. A card found in the cache starts with those coefficients and is     */
+/*  calibrated again once the IOC is running, the others are calibrated before iocInit completes.   */
+/****************************************************************************************************/
+int ip330CalCacheConfig(char * filename, double maxage)
+{
+    if(!filename || !filename[0] || maxage < 0.0)
+    {
+        errlogPrintf("ip330CalCacheConfig: file name or maximum age is illegal!\n");
+        return -1;
+    }
+
+    if(ip330_cal_cache)
+    {
+        errlogPrintf("ip330CalCacheConfig: cache is already %s!\n", ip330_cal_cache);
+        return -1;
+    }
+
+    ip330_cal_lock = epicsMutexMustCreate();
+    ip330_cal_maxage = maxage;
+    ip330_cal_cache = epicsStrDup(filename);
+
+    return 0;
+}
+
+/****************************************************************************************************/
+/*  Routine: ip330CalCacheModule                                                                    */
+/*                                                                                                  */
+/*  Purpose: Tell which IP-330 module sits in a slot, so its cached calibration is not used for     */
+/*           another module swapped in                                                              */
+/*                                                                                                  */
+/*  SYNOPSIS: int ip330CalCacheModule(                                                              */
+/*                  int carrier,          Carrier number                                            */
+/*                  int slot,             Slot number on carrier                                    */
+/*                  char *serial)         Serial number on the module label, no blanks              */
+/*  Example:                                                                                        */
+/*            ip330CalCacheModule(0, 1, "1234567")                                                  */
+/*                                                                                                  */
+/*  Call it before ip330Create. Without it, the cache only tells modules apart by the revision in  */
+/*  their ID PROM, and a module swapped for one of the same revision runs with the old coefficients */
+/*  until it is calibrated again.                                                                   */
+/****************************************************************************************************/
+int ip330CalCacheModule(int carrier, int slot, char * serial)
+{
+    char * ptr;
+    int loop;
+
+    if(!serial || !serial[0])
+    {
+        errlogPrintf("ip330CalCacheModule: no serial number for carrier %d slot %d!\n", carrier, slot);
+        return -1;
+    }
+    for(ptr = serial; *ptr; ptr++)
+    {
+        if(isspace((int)*ptr))
+        {
+            errlogPrintf("ip330CalCacheModule: serial number \"%s\" has blanks!\n", serial);
+            return -1;
+        }
+    }
+
+    for(loop = 0; loop < ip330_cal_nmodules; loop++)
+        if(ip330_cal_module[loop].carrier == carrier && ip330_cal_module[loop].slot == slot) break;
+
+    if(loop == MAX_IP330_CAL_MODULES)
+    {
+        errlogPrintf("ip330CalCacheModule: more than %d modules!\n", MAX_IP330_CAL_MODULES);
+        return -1;
+    }
+    if(loop == ip330_cal_nmodules)
+    {
+        ip330_cal_module[loop].carrier = carrier;
+        ip330_cal_module[loop].slot = slot;
+        ip330_cal_nmodules++;
+    }
+    else
+    {
+        free(ip330_cal_module[loop].serial);
+    }
+    ip330_cal_module[loop].serial = epicsStrDup(serial);
+
+    return 0;
+}
+
+/****************************************************************/
+/* Identity of the module in the slot of a card, ID PROM        */
+/* revision and the serial given to ip330CalCacheModule         */
+/****************************************************************/
+static void ip330CalModuleId(IP330_ID pcard, char * buf, size_t size)
+{
+    ipac_idProm_t * pid;
+    char * serial = "-";
+    int loop;
+
+    for(loop = 0; loop < ip330_cal_nmodules; loop++)
+        if(ip330_cal_module[loop].carrier == pcard->carrier && ip330_cal_module[loop].slot == pcard->slot)
+            serial = ip330_cal_module[loop].serial;
+
+    pid = (ipac_idProm_t *) ipmBaseAddr(pcard->carrier, pcard->slot, ipac_addrID);
+    epicsSnprintf(buf, size, "%02X:%s", pid ? (pid->revision & 0xFF) : 0, serial);
+}
+
+/****************************************************************/
+/* Load the cached coefficients of a card if they are recent.   */
+/* Returns 0 when the card needs no calibration at boot.        */
+/****************************************************************/
+int ip330CalCacheLoad(IP330_ID pcard)
+{
+    FILE * fp;
+    char line[256];
+    char module[IP330_CAL_MODULE_LEN];
+    char cached[IP330_CAL_MODULE_LEN];
+    char * ptr;
+    char * pend;
+    int carrier, slot, typ, range, pos, loop, found;
+    unsigned int sec;
+    double coef[2*N_GAINS];
+    epicsTimeStamp now;
+
+    if(!ip330_cal_cache) return -1;
+
+    ip330CalModuleId(pcard, module, sizeof(module));
+
+    epicsMutexLock(ip330_cal_lock);
+    fp = fopen(ip330_cal_cache, "r");
+    if(!fp)
+    {/* First boot, nothing cached yet */
+        epicsMutexUnlock(ip330_cal_lock);
+        return -1;
+    }
+
+    found = 0;
+    while(!found && fgets(line, sizeof(line), fp))
+    {
+        if(6 != sscanf(line, "%d %d %d %d %31s %u%n", &carrier, &slot, &typ, &range, cached, &sec, &pos)) continue;
+        if(carrier != pcard->carrier || slot != pcard->slot || typ != pcard->inp_typ || range != pcard->inp_range) continue;
+        if(strcmp(cached, module))
+        {/* Entries of older files have no module, they never match */
+            printf("IP330 %s: cached calibration is for module %s, this is %s\n", pcard->cardname, cached, module);
+            break;
+        }
+
+        ptr = line + pos;
+        for(loop = 0; loop < 2*N_GAINS; loop++)
+        {
+            coef[loop] = strtod(ptr, &pend);
+            if(pend == ptr) break;
+            ptr = pend;
+        }
+        found = (loop == 2*N_GAINS);
+    }
+    fclose(fp);
+    epicsMutexUnlock(ip330_cal_lock);
+
+    if(!found) return -1;
+
+    epicsTimeGetCurrent(&now);
+    if(now.secPastEpoch < sec || (double)(now.secPastEpoch - sec) > ip330_cal_maxage)
+    {
+        printf("IP330 %s: cached calibration is too old, calibrating\n", pcard->cardname);
+        return -1;
+    }
+
+    epicsMutexLock(pcard->lock);
+    for(loop = 0; loop < N_GAINS; loop++)
+    {
+        pcard->adj_slope[loop] = coef[2*loop];
+        pcard->adj_offset[loop] = coef[2*loop+1];
+    }
+    pcard->cal_time.secPastEpoch = sec;
+    pcard->cal_time.nsec = 0;
+    pcard->cal_state = IP330_CAL_CACHED;
+    epicsMutexUnlock(pcard->lock);
+
+    printf("IP330 %s: calibration from %s, %gh old\n", pcard->cardname, ip330_cal_cache, (now.secPastEpoch - sec)/3600.0);
+    return 0;
+}
+
+/****************************************************************/
+/* Replace the entry of a card in the cache file. The file is   */
+/* written aside and renamed, so a crash never leaves it half   */
+/****************************************************************/
+int ip330CalCacheSave(IP330_ID pcard)
+{
+    FILE * fin;
+    FILE * fout;
+    char line[256];
+    char module[IP330_CAL_MODULE_LEN];
+    char * tmpname;
+    int carrier, slot, typ, range, loop, status;
+    double coef[2*N_GAINS];
+
+    if(!ip330_cal_cache) return 0;
+
+    ip330CalModuleId(pcard, module, sizeof(module));
+
+    epicsMutexLock(pcard->lock);
+    for(loop = 0; loop < N_GAINS; loop++)
+    {
+        coef[2*loop] = pcard->adj_slope[loop];
+        coef[2*loop+1] = pcard->adj_offset[loop];
+    }
+    epicsMutexUnlock(pcard->lock);
+
+    tmpname = mallocMustSucceed(strlen(ip330_cal_cache) + 5, "ip330CalCacheSave");
+    sprintf(tmpname, "%s.tmp", ip330_cal_cache);
+
+    epicsMutexLock(ip330_cal_lock);
+    fout = fopen(tmpname, "w");
+    if(!fout)
+    {
+        epicsMutexUnlock(ip330_cal_lock);
+        errlogPrintf("ip330CalCacheSave: can not write %s for %s!\n", tmpname, pcard->cardname);
+        free(tmpname);
+        return -1;
+    }
+
+    fin = fopen(ip330_cal_cache, "r");
+    if(fin)
+    {/* Keep comments and the other cards, a slot holds one module at a time */
+        while(fgets(line, sizeof(line), fin))
+        {
+            if(4 == sscanf(line, "%d %d %d %d", &carrier, &slot, &typ, &range) &&
+               carrier == pcard->carrier && slot == pcard->slot && typ == pcard->inp_typ && range == pcard->inp_range) continue;
+            fputs(line, fout);
+        }
+        fclose(fin);
+    }
+    else
+    {
+        fputs(ip330CalHeader, fout);
+    }
+
+    fprintf(fout, "%d %d %d %d %s %u", pcard->carrier, pcard->slot, pcard->inp_typ, pcard->inp_range, module, pcard->cal_time.secPastEpoch);
+    for(loop = 0; loop < 2*N_GAINS; loop++) fprintf(fout, " %.17g", coef[loop]);
+    fprintf(fout, "\n");
+
+    status = (fclose(fout) != 0 || rename(tmpname, ip330_cal_cache) != 0) ? -1 : 0;
+    epicsMutexUnlock(ip330_cal_lock);
+
+    if(status) errlogPrintf("ip330CalCacheSave: can not update %s for %s!\n", ip330_cal_cache, pcard->cardname);
+    free(tmpname);
+    return status;
+}
+
+/****************************************************************/
+/* One calibration, the card stops scanning for about 1.2s      */
+/****************************************************************/
+static void ip330CalThread(void * arg)
+{
+    IP330_ID pcard = (IP330_ID)arg;
+    int status;
+
+    /* Same as ip330Trim, no worker and no interrupt while the scan is reprogrammed */
+    ip330WorkerPause(pcard);
+    ipmIrqCmd(pcard->carrier, pcard->slot, 0, ipac_irqDisable);
+    status = ip330Calibrate(pcard);
+    /* Worker is paused, drop what the ISR queued with the old coefficients */
+    pcard->raw_discard = pcard->raw_head;
+    ip330Configure(pcard);
+    ipmIrqCmd(pcard->carrier, pcard->slot, 0, ipac_irqEnable);
+    ip330WorkerResume(pcard);
+
+    if(status == 0)
+    {
+        epicsMutexLock(pcard->lock);
+        epicsTimeGetCurrent(&(pcard->cal_time));
+        pcard->cal_state = IP330_CAL_DONE;
+        epicsMutexUnlock(pcard->lock);
+        ip330CalCacheSave(pcard);
+    }
+    else
+    {
+        errlogPrintf("IP330 %s: calibration failed, keeping the previous coefficients\n", pcard->cardname);
+        if(pcard->cal_state == IP330_CAL_NONE) pcard->cal_failed = 1;
+    }
+
+    epicsEventSignal(pcard->cal_event);
+}
+
+/****************************************************************/
+/* Calibrate a card in its own thread. Task level only          */
+/****************************************************************/
+int ip330CalStart(IP330_ID pcard, unsigned int priority)
+{
+    char name[32];
+
+    if(!pcard->cal_event) pcard->cal_event = epicsEventMustCreate(epicsEventEmpty);
+
+    epicsSnprintf(name, sizeof(name), "%sCal", pcard->cardname);
+    if(!epicsThreadCreate(name, priority, epicsThreadGetStackSize(epicsThreadStackMedium), ip330CalThread, pcard))
+    {
+        errlogPrintf("ip330CalStart: thread creation failed for device %s\n", pcard->cardname);
+        return -1;
+    }
+
+    return 0;
+}
+
+void ip330CalWait(IP330_ID pcard)
+{
+    epicsEventMustWait(pcard->cal_event);
+}
+
+/****************************************************************/
+/* Busy wait, for delays far below a clock tick                 */
+/****************************************************************/
+static void ip330CalSpin(epicsUInt64 ns)
+{
+    epicsUInt64 start = epicsMonotonicGet();
+
+    while(epicsMonotonicGet() - start < ns);
+}
+
+/****************************************************************/
+/* Stop the acquisition right after an interrupt, so the scan   */
+/* just read is whole and the next one has not converted any    */
+/* channel yet. Timer driven cards only, others have no gap to  */
+/* wait for. Returns with the card interrupt disabled.          */
+/****************************************************************/
+static void ip330CalStopAtEndOfScan(IP330_ID pcard)
+{
+    int tries, key;
+    UINT32 count, pending;
+    epicsUInt64 wait;
+
+    for(tries = 0; pcard->period_ns && tries < IP330_CAL_BG_EOS_TRIES; tries++)
+    {
+        count = pcard->isr_count;
+        wait = epicsMonotonicGet();
+        while(pcard->isr_count == count && epicsMonotonicGet() - wait < 2 * pcard->period_ns);
+        if(pcard->isr_count == count) break;	/* No interrupt, nothing to wait for */
+
+        key = epicsInterruptLock();
+        pending = ((pcard->pHardware->newData[1] << 16) | pcard->pHardware->newData[0]) & pcard->chnl_mask;
+        if(!pending)
+        {
+            ipmIrqCmd(pcard->carrier, pcard->slot, 0, ipac_irqDisable);
+            pcard->pHardware->controlReg = 0x0;
+            epicsInterruptUnlock(key);
+            return;
+        }
+        epicsInterruptUnlock(key);	/* Preempted into the next scan, try after its interrupt */
+    }
+
+    if(pcard->period_ns) errlogPrintf("IP330 %s: no gap between two scans found, calibration cuts one\n", pcard->cardname);
+    ipmIrqCmd(pcard->carrier, pcard->slot, 0, ipac_irqDisable);
+    pcard->pHardware->controlReg = 0x0;
+    /* Let a scan in flight finish, the next frame would only be partial anyway */
+    ip330CalSpin((epicsUInt64)IP330_CONVERSION_NS * MAX_IP330_CHANNELS);
+}
+
+/****************************************************************/
+/* Borrow the ADC between two frames to convert one calibration */
+/* voltage nconv times with one gain, then put the acquisition  */
+/* back without resetting the averaging. *pcount is the mean.   */
+/* The worker is paused, its scan reset must not run meanwhile. */
+/****************************************************************/
+static int ip330CalBorrow(IP330_ID pcard, int gain, int high, double * pcount)
+{
+    int loop, n, status;
+    long sum;
+    epicsUInt64 start, gap, wait;
+
+    ip330WorkerPause(pcard);
+    ip330CalStopAtEndOfScan(pcard);
+    start = epicsMonotonicGet();
+
+    pcard->pHardware->startChannel = 0;
+    pcard->pHardware->endChannel = MAX_IP330_CHANNELS-1;
+    for(loop = 0; loop < MAX_IP330_CHANNELS; loop++)
+        pcard->pHardware->gain[loop] = gain;
+    pcard->pHardware->controlReg = high ? calSettings[pcard->inp_range][gain].ctl_calhi : calSettings[pcard->inp_range][gain].ctl_callo;
+    ip330CalSpin(5000);	/* A delay of 5us needed according to manual */
+
+    status = 0;
+    sum = 0;
+    for(n = 0; n < pcard->cal_bg_nconv; n++)
+    {
+        pcard->pHardware->startConvert = 0x0001;
+        wait = epicsMonotonicGet();
+        while( (pcard->pHardware->newData[0]!=0xffff) || (pcard->pHardware->newData[1]!=0xffff) )
+        {
+            if(epicsMonotonicGet() - wait > IP330_CAL_BG_TIMEOUT_NS) break;
+        }
+        if( (pcard->pHardware->newData[0]!=0xffff) || (pcard->pHardware->newData[1]!=0xffff) )
+        {
+            status = -1;
+            break;
+        }
+        for(loop = 0; loop < MAX_IP330_CHANNELS; loop++)
+            sum += pcard->pHardware->data[loop];
+    }
+
+    /* Back to what ip330Configure programmed, the averaging only sees a longer period */
+    pcard->pHardware->controlReg = 0x0;
+    for(loop = 0; loop < MAX_IP330_CHANNELS; loop++)
+        (void)pcard->pHardware->data[loop];
+    for(loop = 0; loop < MAX_IP330_CHANNELS; loop++)
+        pcard->pHardware->gain[loop] = pcard->gain[loop];
+    pcard->pHardware->endChannel = pcard->end_channel;
+    pcard->pHardware->startChannel = pcard->start_channel;
+    pcard->pHardware->controlReg = pcard->ctrl_reg;
+    if(pcard->scan_mode == SCAN_MODE_CVTONEXT) pcard->pHardware->startConvert = 0x1;
+
+    /* ISR is not running, the gap must not show up as jitter */
+    pcard->isr_last = 0;
+    gap = epicsMonotonicGet() - start;
+    ipmIrqCmd(pcard->carrier, pcard->slot, 0, ipac_irqClear);
+    ipmIrqCmd(pcard->carrier, pcard->slot, 0, ipac_irqEnable);
+    ip330WorkerResume(pcard);
+
+    pcard->cal_gap_last_ns = gap;
+    if(gap > pcard->cal_gap_max_ns) pcard->cal_gap_max_ns = gap;
+    if(pcard->period_ns) pcard->cal_skipped += gap / pcard->period_ns;
+
+    if(status == 0) *pcount = (double)sum / (double)(n * MAX_IP330_CHANNELS);
+    return status;
+}
+
+/****************************************************************/
+/* Calibrate all gains one borrow at a time, then switch to the */
+/* new coefficients all at once. Background thread only         */
+/****************************************************************/
+static int ip330CalBackgroundRun(IP330_ID pcard)
+{
+    int gain;
+    double count[N_GAINS][2];
+    double slope[N_GAINS], offset[N_GAINS];
+
+    for(gain = 0; gain < N_GAINS; gain++)
+    {
+        if(ip330CalBorrow(pcard, gain, 0, &(count[gain][0])) != 0) return -1;
+        epicsThreadSleep(IP330_CAL_BG_SPACING);
+        if(ip330CalBorrow(pcard, gain, 1, &(count[gain][1])) != 0) return -1;
+        epicsThreadSleep(IP330_CAL_BG_SPACING);
+        ip330CalFit(pcard, gain, count[gain][0], count[gain][1], &(slope[gain]), &(offset[gain]));
+
+        /* A disturbed borrow must not replace good coefficients, NaN fails too */
+        if( !(fabs(slope[gain] - 1.0) <= IP330_CAL_BG_SLOPE_TOL) || !(fabs(offset[gain]) <= IP330_CAL_BG_OFFSET_MAX) )
+        {
+            errlogPrintf("IP330 %s: background calibration of gain %d gives slope %g offset %g, rejected\n",
+                         pcard->cardname, gain, slope[gain], offset[gain]);
+            return -1;
+        }
+    }
+
+    epicsMutexLock(pcard->lock);
+    for(gain = 0; gain < N_GAINS; gain++)
+    {
+        pcard->adj_slope[gain] = slope[gain];
+        pcard->adj_offset[gain] = offset[gain];
+    }
+    epicsTimeGetCurrent(&(pcard->cal_time));
+    pcard->cal_state = IP330_CAL_DONE;
+    epicsMutexUnlock(pcard->lock);
+
+    /* Readers switch to the new table at once, see ip330BuildGroupCal */
+    ip330BuildCalTable(pcard);
+    ip330CalCacheSave(pcard);
+
+    return 0;
+}
+
+static void ip330CalBackgroundOnce(IP330_ID pcard)
+{
+    /* The borrow blinds the interlock and breaks the lock step of a sync group */
+    if(pcard->interlock || pcard->sync)
+    {
+        pcard->cal_bg_fails++;
+        errlogPrintf("IP330 %s: background calibration refused, the card has an interlock or a sync group\n", pcard->cardname);
+        return;
+    }
+
+    if(ip330CalBackgroundRun(pcard) == 0)
+    {
+        pcard->cal_bg_runs++;
+    }
+    else
+    {
+        pcard->cal_bg_fails++;
+        errlogPrintf("IP330 %s: background calibration failed, keeping the previous coefficients\n", pcard->cardname);
+    }
+}
+
+static void ip330CalBackgroundThread(void * arg)
+{
+    IP330_ID pcard = (IP330_ID)arg;
+
+    /* ip330InitHook calibrates and trims before iocInit completes */
+    while(!interruptAccept) epicsThreadSleep(1.0);
+
+    if(pcard->cal_bg_period <= 0.0)
+    {/* Only measure again what was booted from the cache, once */
+        if(pcard->cal_state == IP330_CAL_CACHED) ip330CalBackgroundOnce(pcard);
+        return;
+    }
+
+    while(TRUE)
+    {
+        epicsThreadSleep(pcard->cal_bg_period);
+        ip330CalBackgroundOnce(pcard);
+    }
+}
+
+static int ip330CalBackgroundInit(IP330_ID pcard)
+{
+    char name[32];
+
+    if(pcard->cal_bg_thread) return 0;
+
+    epicsSnprintf(name, sizeof(name), "%sBgCal", pcard->cardname);
+    pcard->cal_bg_thread = epicsThreadCreate(name, epicsThreadPriorityLow, epicsThreadGetStackSize(epicsThreadStackMedium), ip330CalBackgroundThread, pcard);
+    if(!pcard->cal_bg_thread)
+    {
+        errlogPrintf("ip330CalBackground: thread creation failed for device %s\n", pcard->cardname);
+        return -1;
+    }
+
+    return 0;
+}
+
+/****************************************************************************************************/
+/*  Routine: ip330CalBackground                                                                     */
+/*                                                                                                  */
+/*  Purpose: Calibrate an IP-330 again from time to time without stopping the acquisition           */
+/*                                                                                                  */
+/*  SYNOPSIS: int ip330CalBackground(                                                               */
+/*                  char *cardname,       Name given to ip330Create                                  */
+/*                  double period,        Seconds between two calibrations, 0 to only calibrate     */
+/*                                        after a boot from the calibration cache                   */
+/*                  int nconv)            Conversions of all channels averaged per voltage, 1~256   */
+/*  Example:                                                                                        */
+/*            ip330CalBackground("ip330_1", 3600, 16)                                               */
+/*                                                                                                  */
+/*  Each gain and calibration voltage borrows the ADC between two frames for about nconv*256us,     */
+/*  with normal acquisition in between. ip330 report shows the gaps and the frames skipped.         */
+/*  No interrupt comes during a borrow, so it is refused on cards with an interlock, which would    */
+/*  not be checked for up to 65ms at nconv 256, or in a sync group. A fit far from the ideal is     */
+/*  rejected. Nothing is calibrated in the background unless this is called.                        */
+/****************************************************************************************************/
+int ip330CalBackground(char * cardname, double period, int nconv)
+{
+    IP330_ID pcard;
+
+    pcard = ip330GetByName(cardname);
+    if(!pcard)
+    {
+        errlogPrintf("ip330CalBackground: %s is not registered!\n", cardname);
+        return -1;
+    }
+
+    if(period < 0.0 || nconv < 1 || nconv > 256)
+    {
+        errlogPrintf("ip330CalBackground: period %g or %d conversions is illegal for device %s\n", period, nconv, cardname);
+        return -1;
+    }
+
+    if(pcard->interlock || pcard->sync)
+    {
+        errlogPrintf("ip330CalBackground: device %s has an interlock or a sync group, refused\n", cardname);
+        return -1;
+    }
+
+    pcard->cal_bg_nconv = nconv;
+    pcard->cal_bg_period = period;
+
+    return ip330CalBackgroundInit(pcard);
+}
+
+/****************************************************************/
+/* One line for ip330 report                                    */
+/****************************************************************/
+void ip330CalReport(IP330_ID pcard)
+{
+    static const char * stateName[] = {"none", "from cache", "measured"};
+    char timeStr[40];
+
+    if(pcard->cal_state == IP330_CAL_NONE)
+    {
+        printf("\tCalibration: none%s\n", pcard->cal_failed ? ", failed at boot, data is uncalibrated" : "");
+        return;
+    }
+
+    epicsTimeToStrftime(timeStr, sizeof(timeStr), "%Y/%m/%d %H:%M:%S", &(pcard->cal_time));
+    printf("\tCalibration: %s, measured at %s\n", stateName[pcard->cal_state], timeStr);
+
+    if(pcard->cal_bg_thread)
+        printf("\tBackground calibration: %s%gs, %u done, %u failed, gap %uus last %uus max, %lu frames skipped\n",
+               pcard->cal_bg_period > 0.0 ? "every " : "after boot from cache, period ", pcard->cal_bg_period, pcard->cal_bg_runs, pcard->cal_bg_fails, (unsigned int)(pcard->cal_gap_last_ns / 1000),
+               (unsigned int)(pcard->cal_gap_max_ns / 1000), (unsigned long)pcard->cal_skipped);
+}
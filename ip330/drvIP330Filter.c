@@ -0,0 +1,228 @@
+/****************************************************************/
+/* This file implements the optional decimating CIC/FIR filter  */
+/* which sits between the IP330 raw frames and the averaging    */
+/****************************************************************/
+#include <math.h>
+
+#include "drvIP330Lib.h"
+#include "drvIP330Private.h"
+
+/****************************************************************************************************/
+/*  Routine: ip330FilterConfig                                                                      */
+/*                                                                                                  */
+/*  Purpose: Put a decimating filter in front of the averaging of an IP-330 ADC module              */
+/*                                                                                                  */
+/*  SYNOPSIS: int ip330FilterConfig(                                                                */
+/*                  char *cardname,       Name given to ip330Create                                 */
+/*                  char *filter,         "CICNxR", N stages (1~5) decimating by R, N*log2(R)<=47   */
+/*                                        or "FIRR", FIR decimating by R, taps from the next arg    */
+/*                  char *taps)           Comma separated FIR coefficients, up to 64, normalized    */
+/*                                        to unity DC gain. Ignored for CIC                         */
+/*  Example:                                                                                        */
+/*            ip330FilterConfig("ip330_1", "CIC3x16", "")                                           */
+/*            ip330FilterConfig("ip330_1", "FIR4", "1,3,3,1")                                       */
+/*                                                                                                  */
+/*  The averaging set by ip330Create then works on the decimated samples. Call it once per card.    */
+/****************************************************************************************************/
+int ip330FilterConfig(char * cardname, char * filter, char * taps)
+{
+    IP330_ID pcard;
+    IP330_FILTER * pfilter;
+    int order, decimation, ntaps, loop, bits;
+    double coef[MAX_IP330_FIR_TAPS];
+    double sum, err;
+    char * ptr;
+    char * pend;
+
+    pcard = ip330GetByName(cardname);
+    if(!pcard)
+    {
+        errlogPrintf("ip330FilterConfig: %s is not registered!\n", cardname);
+        return -1;
+    }
+
+    if(pcard->filter)
+    {
+        errlogPrintf("ip330FilterConfig: filter for %s is already configured!\n", cardname);
+        return -1;
+    }
+
+    if(!filter)
+    {
+        errlogPrintf("ip330FilterConfig: no filter for device %s\n", cardname);
+        return -1;
+    }
+
+    pfilter = callocMustSucceed(1, sizeof(IP330_FILTER), "ip330FilterConfig");
+
+    if(2 == sscanf(filter, "CIC%dx%d", &order, &decimation))
+    {
+        if(order < 1 || order > MAX_IP330_CIC_ORDER || decimation < 2 || decimation > MAX_IP330_DECIMATION)
+        {
+            errlogPrintf("ip330FilterConfig: filter %s is out of range for device %s\n", filter, cardname);
+            free(pfilter);
+            return -1;
+        }
+
+        /* Register growth is order*log2(decimation) bits on top of the 16 bit input */
+        for(bits = 0; (1 << bits) < decimation; bits++);
+        if(order * bits > MAX_IP330_CIC_BITS)
+        {
+            errlogPrintf("ip330FilterConfig: filter %s needs more than %d bits for device %s\n", filter, MAX_IP330_CIC_BITS + 16, cardname);
+            free(pfilter);
+            return -1;
+        }
+
+        pfilter->type = IP330_FILTER_CIC;
+        pfilter->order = order;
+        pfilter->gain = 1;
+        for(loop = 0; loop < order; loop++) pfilter->gain *= decimation;
+    }
+    else if(1 == sscanf(filter, "FIR%d", &decimation))
+    {
+        if(decimation < 1 || decimation > MAX_IP330_DECIMATION)
+        {
+            errlogPrintf("ip330FilterConfig: filter %s is out of range for device %s\n", filter, cardname);
+            free(pfilter);
+            return -1;
+        }
+
+        ntaps = 0;
+        sum = 0.0;
+        ptr = taps;
+        while(ptr && *ptr)
+        {
+            if(ntaps >= MAX_IP330_FIR_TAPS)
+            {
+                errlogPrintf("ip330FilterConfig: more than %d taps for device %s\n", MAX_IP330_FIR_TAPS, cardname);
+                free(pfilter);
+                return -1;
+            }
+            coef[ntaps] = strtod(ptr, &pend);
+            if(pend == ptr)
+            {
+                errlogPrintf("ip330FilterConfig: taps %s is illegal for device %s\n", taps, cardname);
+                free(pfilter);
+                return -1;
+            }
+            sum += coef[ntaps++];
+            for(ptr = pend; isspace((int)*ptr) || *ptr == ','; ptr++);
+        }
+
+        if(ntaps == 0 || fabs(sum) < 1e-9)
+        {
+            errlogPrintf("ip330FilterConfig: taps of device %s must not be empty or sum to zero\n", cardname);
+            free(pfilter);
+            return -1;
+        }
+
+        /* Unity DC gain in Q IP330_FIR_QBITS, the rounding error goes into the largest tap */
+        err = 0.0;
+        bits = 0;
+        for(loop = 0; loop < ntaps; loop++)
+        {
+            pfilter->taps[loop] = (epicsInt32)floor(coef[loop] / sum * (1 << IP330_FIR_QBITS) + 0.5);
+            err += pfilter->taps[loop];
+            if(fabs(coef[loop]) > fabs(coef[bits])) bits = loop;
+        }
+        pfilter->taps[bits] += (1 << IP330_FIR_QBITS) - (epicsInt32)err;
+
+        pfilter->type = IP330_FILTER_FIR;
+        pfilter->ntaps = ntaps;
+        pfilter->pos = 0;
+    }
+    else
+    {
+        errlogPrintf("ip330FilterConfig: filter %s is illegal for device %s\n", filter, cardname);
+        free(pfilter);
+        return -1;
+    }
+
+    pfilter->decimation = decimation;
+    pfilter->phase = 0;
+
+    /* The worker is already running, it only looks at filter once everything above is visible */
+    epicsAtomicWriteMemoryBarrier();
+    pcard->filter = pfilter;
+
+    return 0;
+}
+
+/****************************************************************/
+/* Round the filter output back to counts                       */
+/****************************************************************/
+static UINT16 ip330FilterClamp(epicsInt64 value)
+{
+    if(value < 0) return 0;
+    if(value > 0xFFFF) return 0xFFFF;
+    return (UINT16)value;
+}
+
+/****************************************************************/
+/* Feed one conversion of nchnl channels into the filter. When  */
+/* a decimated output is due, write it to pout and return 1,    */
+/* otherwise return 0. Called from worker thread only           */
+/****************************************************************/
+int ip330FilterProcess(IP330_FILTER * pfilter, const UINT16 * pin, UINT16 * pout, int nchnl)
+{
+    int stage, tap, idx, loop;
+    epicsUInt64 value, delayed;
+    epicsInt64 acc[MAX_IP330_CHANNELS];
+
+    if(pfilter->type == IP330_FILTER_CIC)
+    {
+        /* Integrators run at the input rate */
+        for(loop = 0; loop < nchnl; loop++) pfilter->integ[0][loop] += pin[loop];
+        for(stage = 1; stage < pfilter->order; stage++)
+            for(loop = 0; loop < nchnl; loop++) pfilter->integ[stage][loop] += pfilter->integ[stage - 1][loop];
+
+        if(++pfilter->phase < pfilter->decimation) return 0;
+        pfilter->phase = 0;
+
+        /* Combs run at the output rate, modulo 2^64 differences undo the wrap of the integrators */
+        for(loop = 0; loop < nchnl; loop++)
+        {
+            value = pfilter->integ[pfilter->order - 1][loop];
+            for(stage = 0; stage < pfilter->order; stage++)
+            {
+                delayed = pfilter->comb[stage][loop];
+                pfilter->comb[stage][loop] = value;
+                value -= delayed;
+            }
+            pout[loop] = ip330FilterClamp((epicsInt64)((value + pfilter->gain/2) / pfilter->gain));
+        }
+        return 1;
+    }
+    else
+    {
+        if(++pfilter->pos >= pfilter->ntaps) pfilter->pos = 0;
+        for(loop = 0; loop < nchnl; loop++) pfilter->hist[pfilter->pos][loop] = pin[loop];
+
+        if(++pfilter->phase < pfilter->decimation) return 0;
+        pfilter->phase = 0;
+
+        /* Only the outputs which are kept get computed, channels innermost */
+        for(loop = 0; loop < nchnl; loop++) acc[loop] = 0;
+        idx = pfilter->pos;
+        for(tap = 0; tap < pfilter->ntaps; tap++)
+        {
+            for(loop = 0; loop < nchnl; loop++)
+                acc[loop] += (epicsInt64)pfilter->taps[tap] * pfilter->hist[idx][loop];
+            if(--idx < 0) idx = pfilter->ntaps - 1;
+        }
+        for(loop = 0; loop < nchnl; loop++)
+            pout[loop] = ip330FilterClamp((acc[loop] + (1 << (IP330_FIR_QBITS - 1))) >> IP330_FIR_QBITS);
+        return 1;
+    }
+}
+
+/****************************************************************/
+/* One line for ip330 report                                    */
+/****************************************************************/
+void ip330FilterReport(IP330_FILTER * pfilter)
+{
+    if(pfilter->type == IP330_FILTER_CIC)
+        printf("\tFilter: CIC, %d stages, decimation %u\n", pfilter->order, pfilter->decimation);
+    else
+        printf("\tFilter: FIR, %d taps, decimation %u\n", pfilter->ntaps, pfilter->decimation);
+}
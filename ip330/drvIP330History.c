@@ -0,0 +1,307 @@
+/****************************************************************/
+/* This file implements the IP330 post-mortem history: the last */
+/* frames of every channel at full rate, kept until a freeze    */
+/****************************************************************/
+#include "drvIP330Lib.h"
+#include "drvIP330Private.h"
+
+/****************************************************************************************************/
+/*  Routine: ip330HistoryCreate                                                                     */
+/*                                                                                                  */
+/*  Purpose: Keep the last raw frames of an IP-330 ADC module for post-mortem analysis              */
+/*                                                                                                  */
+/*  SYNOPSIS: int ip330HistoryCreate(                                                               */
+/*                  char *cardname,       Name given to ip330Create                                 */
+/*                  UINT32 nframes,       Frames kept, rounded up to a power of 2, memory is        */
+/*                                        nframes*sizeof(IP330_STREAM_FRAME) allocated right now    */
+/*                  UINT32 post)          Frames still recorded after the freeze, less than nframes */
+/*  Example:                                                                                        */
+/*            ip330HistoryCreate("ip330_1", 65536, 1024)                                            */
+/*                                                                                                  */
+/*  Freeze with a bo record "card:0:FREEZE", ip330HistoryFreezeByName or ip330HistoryFreeze, then  */
+/*  read it with waveform records "card:ch:HISTORY" or dump it with ip330HistoryDump.               */
+/****************************************************************************************************/
+int ip330HistoryCreate(char * cardname, UINT32 nframes, UINT32 post)
+{
+    IP330_ID pcard;
+    IP330_STREAM_FRAME * phistory;
+    UINT32 size;
+
+    pcard = ip330GetByName(cardname);
+    if(!pcard)
+    {
+        errlogPrintf("ip330HistoryCreate: %s is not registered!\n", cardname);
+        return -1;
+    }
+
+    if(pcard->history)
+    {
+        errlogPrintf("ip330HistoryCreate: history for %s is already created!\n", cardname);
+        return -1;
+    }
+
+    if(nframes < 2 || nframes > 0x1000000)
+    {
+        errlogPrintf("ip330HistoryCreate: %u frames is illegal for device %s\n", nframes, cardname);
+        return -1;
+    }
+
+    for(size = 2; size < nframes; size <<= 1);
+
+    if(post >= size)
+    {
+        errlogPrintf("ip330HistoryCreate: %u post-trigger frames is illegal for device %s\n", post, cardname);
+        return -1;
+    }
+
+    pcard->history_size = size;
+    pcard->history_post = post;
+    pcard->history_head = 0;
+    pcard->history_filled = 0;
+    pcard->history_state = IP330_HISTORY_RUNNING;
+    scanIoInit( &(pcard->history_ioscan) );
+    phistory = callocMustSucceed(size, sizeof(IP330_STREAM_FRAME), "ip330HistoryCreate");
+    /* The history holds every channel, ip330HistoryDump may be its only reader */
+    ip330UseChannel(pcard, -1);
+
+    /* The worker is already running, it only looks at history once everything above, zeroed ring included, is visible */
+    epicsAtomicWriteMemoryBarrier();
+    pcard->history = phistory;
+
+    return 0;
+}
+
+/****************************************************************/
+/* Copy the conversions of a raw frame into the history unless  */
+/* it is frozen. Called from worker thread only, no lock        */
+/****************************************************************/
+void ip330HistoryPush(IP330_ID pcard, IP330_RAW_FRAME * praw)
+{
+    int buf, loop;
+    UINT32 head;
+    IP330_STREAM_FRAME * pframe;
+
+    for(buf = 0; buf < 2; buf++)
+    {
+        if(!(praw->buf_avail & (IP330_BUF0_AVAIL << buf))) continue;
+
+        if(pcard->history_state == IP330_HISTORY_FROZEN) return;
+        if(pcard->history_state == IP330_HISTORY_STOPPING)
+        {
+            epicsAtomicReadMemoryBarrier();
+            if(pcard->history_left == 0)
+            {
+                pcard->history_state = IP330_HISTORY_FROZEN;
+                scanIoRequest(pcard->history_ioscan);
+                return;
+            }
+            pcard->history_left--;
+        }
+
+        head = pcard->history_head;
+        pframe = &(pcard->history[head & (pcard->history_size - 1)]);
+        pframe->seq = head;
+        pframe->time = praw->time;
+        /* In differential mode buf1 is the second conversion of the same channels */
+        for(loop = pcard->start_channel; loop <= pcard->end_channel; loop++)
+            pframe->data[loop] = praw->data[loop + 16*buf];
+        if(head + 1 == pcard->history_size) pcard->history_filled = 1;
+        epicsAtomicWriteMemoryBarrier();
+        pcard->history_head = head + 1;
+    }
+}
+
+/****************************************************************/
+/* Stop the history post frames from now. Task level only       */
+/****************************************************************/
+int ip330HistoryFreeze(IP330_ID pcard)
+{
+    if(!pcard || !pcard->history)
+    {
+        errlogPrintf("ip330HistoryFreeze: history is not created!\n");
+        return -1;
+    }
+
+    epicsMutexLock(pcard->lock);
+    if(pcard->history_state == IP330_HISTORY_RUNNING)
+    {
+        pcard->history_left = pcard->history_post;
+        epicsTimeGetCurrent(&(pcard->history_time));
+        epicsAtomicWriteMemoryBarrier();
+        pcard->history_state = IP330_HISTORY_STOPPING;
+    }
+    epicsMutexUnlock(pcard->lock);
+
+    return 0;
+}
+
+/****************************************************************/
+/* Start recording again after a freeze. Task level only        */
+/****************************************************************/
+int ip330HistoryRearm(IP330_ID pcard)
+{
+    if(!pcard || !pcard->history)
+    {
+        errlogPrintf("ip330HistoryRearm: history is not created!\n");
+        return -1;
+    }
+
+    epicsMutexLock(pcard->lock);
+    if(pcard->history_state == IP330_HISTORY_FROZEN)
+    {
+        pcard->history_gen++;
+        pcard->history_head = 0;
+        pcard->history_filled = 0;
+        epicsAtomicWriteMemoryBarrier();
+        pcard->history_state = IP330_HISTORY_RUNNING;
+    }
+    epicsMutexUnlock(pcard->lock);
+
+    return 0;
+}
+
+int ip330HistoryFreezeByName(char * cardname)
+{
+    return ip330HistoryFreeze(ip330GetByName(cardname));
+}
+
+int ip330HistoryRearmByName(char * cardname)
+{
+    return ip330HistoryRearm(ip330GetByName(cardname));
+}
+
+/****************************************************************/
+/* Last maxsamples samples of one channel, oldest first. Gives  */
+/* 0 samples unless the history is frozen. *ptime gets the time */
+/* of the last sample. Returns number of samples read.          */
+/****************************************************************/
+int ip330HistoryReadChannel(IP330_ID pcard, UINT16 channel, UINT16 * pbuf, int maxsamples, epicsTimeStamp * ptime)
+{
+    UINT32 head, gen, mask, first;
+    int n, loop;
+
+    if(!pcard || !pcard->history || !pbuf || maxsamples < 0)
+    {
+        errlogPrintf("ip330HistoryReadChannel: history is not created or bad parameters!\n");
+        return -1;
+    }
+
+    if(channel < pcard->start_channel || channel > pcard->end_channel)
+    {
+        errlogPrintf("Bad channel number %d in ip330HistoryReadChannel card %s\n", channel, pcard->cardname);
+        return -1;
+    }
+
+    mask = pcard->history_size - 1;
+    do
+    {/* Retry if it was rearmed and frozen again while we were copying */
+        gen = pcard->history_gen;
+        epicsAtomicReadMemoryBarrier();
+        if(pcard->history_state != IP330_HISTORY_FROZEN) return 0;
+
+        head = pcard->history_head;
+        n = (pcard->history_filled || head >= pcard->history_size) ? (int)pcard->history_size : (int)head;
+        if(n > maxsamples) n = maxsamples;
+        first = head - n;
+        for(loop = 0; loop < n; loop++)
+            pbuf[loop] = pcard->history[(first + loop) & mask].data[channel];
+        if(n > 0 && ptime)
+            *ptime = pcard->history[(head - 1) & mask].time;
+
+        epicsAtomicReadMemoryBarrier();
+    } while(gen != pcard->history_gen || pcard->history_state != IP330_HISTORY_FROZEN);
+
+    return n;
+}
+
+IOSCANPVT * ip330HistoryGetIoScanPVT(IP330_ID pcard)
+{
+    if(!pcard || !pcard->history)
+    {
+        errlogPrintf("ip330HistoryGetIoScanPVT: history is not created!\n");
+        return NULL;
+    }
+    return &(pcard->history_ioscan);
+}
+
+/****************************************************************/
+/* Write the frozen history to filename, oldest frame first, as */
+/* an array of IP330_STREAM_FRAME in the byte order of the IOC  */
+/****************************************************************/
+int ip330HistoryDump(char * cardname, char * filename)
+{
+    IP330_ID pcard;
+    FILE * fp;
+    char timeStr[40];
+    UINT32 head, gen, first, mask, n, chunk, count;
+
+    pcard = ip330GetByName(cardname);
+    if(!pcard || !pcard->history)
+    {
+        errlogPrintf("ip330HistoryDump: %s is not registered or has no history!\n", cardname);
+        return -1;
+    }
+
+    /* A rearm bumps the generation, checked again once the file is written */
+    gen = pcard->history_gen;
+    epicsAtomicReadMemoryBarrier();
+    if(pcard->history_state != IP330_HISTORY_FROZEN)
+    {
+        errlogPrintf("ip330HistoryDump: history of %s is not frozen, freeze it first!\n", cardname);
+        return -1;
+    }
+
+    if(!filename || !(fp = fopen(filename, "wb")))
+    {
+        errlogPrintf("ip330HistoryDump: can not open %s for %s!\n", filename ? filename : "", cardname);
+        return -1;
+    }
+
+    /* Frozen, so the worker leaves it alone until a rearm */
+    head = pcard->history_head;
+    n = (pcard->history_filled || head >= pcard->history_size) ? pcard->history_size : head;
+    first = head - n;
+    mask = pcard->history_size - 1;
+
+    /* At most two fwrite, the ring may wrap once */
+    chunk = pcard->history_size - (first & mask);
+    if(chunk > n) chunk = n;
+    count = fwrite(&(pcard->history[first & mask]), sizeof(IP330_STREAM_FRAME), chunk, fp);
+    if(count == chunk) count += fwrite(pcard->history, sizeof(IP330_STREAM_FRAME), n - chunk, fp);
+    fclose(fp);
+
+    if(count != n)
+    {
+        errlogPrintf("ip330HistoryDump: only %u of %u frames of %s written to %s!\n", count, n, cardname, filename);
+        return -1;
+    }
+
+    epicsAtomicReadMemoryBarrier();
+    if(gen != pcard->history_gen)
+    {/* Part of the file may hold frames recorded after the rearm */
+        remove(filename);
+        errlogPrintf("ip330HistoryDump: history of %s was rearmed while writing %s, nothing written!\n", cardname, filename);
+        return -1;
+    }
+
+    epicsTimeToStrftime(timeStr, sizeof(timeStr), "%Y/%m/%d %H:%M:%S", &(pcard->history_time));
+    printf("IP330 %s: %u frames of history frozen at %s written to %s\n", cardname, n, timeStr, filename);
+    return 0;
+}
+
+/****************************************************************/
+/* One line for ip330 report                                    */
+/****************************************************************/
+void ip330HistoryReport(IP330_ID pcard)
+{
+    static const char * stateName[] = {"running", "stopping", "frozen"};
+    char timeStr[40];
+
+    printf("\tHistory of %u frames, %u after freeze, %s, %u frames recorded", pcard->history_size, pcard->history_post, stateName[pcard->history_state], pcard->history_head);
+    if(pcard->history_state != IP330_HISTORY_RUNNING)
+    {
+        epicsTimeToStrftime(timeStr, sizeof(timeStr), "%Y/%m/%d %H:%M:%S", &(pcard->history_time));
+        printf(", freeze at %s", timeStr);
+    }
+    printf("\n");
+}
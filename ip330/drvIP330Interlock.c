@@ -0,0 +1,342 @@
+/****************************************************************/
+/* This file implements the IP330 threshold interlock, checked  */
+/* by ip330ISR on every conversion before the worker sees it    */
+/****************************************************************/
+#include <registryFunction.h>
+
+#include "drvIP330Lib.h"
+#include "drvIP330Private.h"
+
+/* BIT write of xy2445WriteCard and avme470WriteCard, same value in both headers */
+#define IP330_ILK_WRITE_BIT	0
+
+/****************************************************************/
+/* Interlock of a card, created on first use. Task level only   */
+/****************************************************************/
+static IP330_INTERLOCK * ip330InterlockGet(IP330_ID pcard)
+{
+    IP330_INTERLOCK * pilk;
+
+    epicsMutexLock(pcard->lock);
+    if(!pcard->interlock)
+    {
+        pilk = callocMustSucceed(1, sizeof(IP330_INTERLOCK), "ip330Interlock");
+        /* The ISR is already running, it only looks at interlock once it is cleared */
+        epicsAtomicWriteMemoryBarrier();
+        pcard->interlock = pilk;
+    }
+    epicsMutexUnlock(pcard->lock);
+
+    return pcard->interlock;
+}
+
+/****************************************************************************************************/
+/*  Routine: ip330InterlockConfig                                                                   */
+/*                                                                                                  */
+/*  Purpose: Trip when a channel of an IP-330 leaves a window, checked in the ISR on each sample    */
+/*                                                                                                  */
+/*  SYNOPSIS: int ip330InterlockConfig(                                                             */
+/*                  char *cardname,       Name given to ip330Create                                 */
+/*                  int channel,          Within the channel range of ip330Create                   */
+/*                  int low,              Trips below low, raw ADC counts before calibration        */
+/*                  int high,             Trips above high, raw ADC counts before calibration       */
+/*                  int hyst)             Clears once back within [low+hyst, high-hyst]             */
+/*  Example:                                                                                        */
+/*            ip330InterlockConfig("ip330_1", 3, 0x1000, 0xF000, 0x100)                             */
+/*                                                                                                  */
+/*  A trip drives the output of ip330InterlockOutput, which stays until ip330InterlockReset, and    */
+/*  calls the function given to ip330InterlockCallback. Calling it again changes the thresholds,    */
+/*  low 0 and high 65535 never trip.                                                                */
+/****************************************************************************************************/
+int ip330InterlockConfig(char * cardname, int channel, int low, int high, int hyst)
+{
+    IP330_ID pcard;
+    IP330_INTERLOCK * pilk;
+
+    pcard = ip330GetByName(cardname);
+    if(!pcard)
+    {
+        errlogPrintf("ip330InterlockConfig: %s is not registered!\n", cardname);
+        return -1;
+    }
+
+    if(channel < pcard->start_channel || channel > pcard->end_channel)
+    {
+        errlogPrintf("ip330InterlockConfig: channel %d is out of range for device %s\n", channel, cardname);
+        return -1;
+    }
+
+    if(low < 0 || high > 0xFFFF || hyst < 0 || low + hyst > high - hyst)
+    {
+        errlogPrintf("ip330InterlockConfig: window %d~%d with hysteresis %d is illegal for device %s\n", low, high, hyst, cardname);
+        return -1;
+    }
+
+    pilk = ip330InterlockGet(pcard);
+
+    epicsMutexLock(pcard->lock);
+    /* Take the channel out while the ISR could see half of the new window */
+    pilk->enabled &= ~(1 << channel);
+    epicsAtomicWriteMemoryBarrier();
+    pilk->low[channel] = low;
+    pilk->high[channel] = high;
+    pilk->clear_low[channel] = low + hyst;
+    pilk->clear_high[channel] = high - hyst;
+    epicsAtomicWriteMemoryBarrier();
+    pilk->enabled |= (1 << channel);
+    epicsMutexUnlock(pcard->lock);
+
+    /* The scan range must keep this channel even without a record reading it */
+    ip330UseChannel(pcard, channel);
+
+    return 0;
+}
+
+/****************************************************************************************************/
+/*  Routine: ip330InterlockOutput                                                                   */
+/*                                                                                                  */
+/*  Purpose: Drive one bit of an IP445 or IP470 straight from the IP-330 ISR on a trip              */
+/*                                                                                                  */
+/*  SYNOPSIS: int ip330InterlockOutput(                                                             */
+/*                  char *cardname,       Name given to ip330Create                                 */
+/*                  char *outtype,        "IP445" or "IP470", its driver must be loaded             */
+/*                  char *outcard,        Name given to xy2445Create or avme470Create               */
+/*                  int port,             Port of the output card                                   */
+/*                  int bit,              Bit of the port, 0~7                                      */
+/*                  int level)            Bit value on a trip, the other value is written right now */
+/*  Example:                                                                                        */
+/*            ip330InterlockOutput("ip330_1", "IP445", "ssr_1", 0, 3, 1)                            */
+/*                                                                                                  */
+/*  Nothing else should write to that port, the ISR does a read-modify-write of it.                 */
+/****************************************************************************************************/
+int ip330InterlockOutput(char * cardname, char * outtype, char * outcard, int port, int bit, int level)
+{
+    IP330_ID pcard;
+    IP330_INTERLOCK * pilk;
+    void * (*findcard)(char *);
+    void * poutcard;
+    REGISTRYFUNCTION write;
+    int type, maxports, key;
+
+    pcard = ip330GetByName(cardname);
+    if(!pcard)
+    {
+        errlogPrintf("ip330InterlockOutput: %s is not registered!\n", cardname);
+        return -1;
+    }
+
+    if(!outtype || !outcard)
+    {
+        errlogPrintf("ip330InterlockOutput: no output card for device %s\n", cardname);
+        return -1;
+    }
+
+    /* Found through the registry, so IP330 does not link against the output drivers */
+    if(0 == strcmp(outtype, "IP445"))
+    {
+        type = IP330_ILK_OUT_IP445;
+        maxports = 4;
+        findcard = (void * (*)(char *))registryFunctionFind("xy2445FindCard");
+        write = registryFunctionFind("xy2445WriteCard");
+    }
+    else if(0 == strcmp(outtype, "IP470"))
+    {
+        type = IP330_ILK_OUT_IP470;
+        maxports = 6;
+        findcard = (void * (*)(char *))registryFunctionFind("avme470FindCard");
+        write = registryFunctionFind("avme470WriteCard");
+    }
+    else
+    {
+        errlogPrintf("ip330InterlockOutput: output type %s is illegal for device %s\n", outtype, cardname);
+        return -1;
+    }
+
+    if(!findcard || !write)
+    {
+        errlogPrintf("ip330InterlockOutput: %s driver is not loaded for device %s\n", outtype, cardname);
+        return -1;
+    }
+
+    poutcard = findcard(outcard);
+    if(!poutcard)
+    {
+        errlogPrintf("ip330InterlockOutput: %s %s is not registered!\n", outtype, outcard);
+        return -1;
+    }
+
+    if(port < 0 || port >= maxports || bit < 0 || bit > 7)
+    {
+        errlogPrintf("ip330InterlockOutput: port %d bit %d is out of range for %s %s\n", port, bit, outtype, outcard);
+        return -1;
+    }
+
+    pilk = ip330InterlockGet(pcard);
+
+    key = epicsInterruptLock();
+    pilk->out_type = type;
+    pilk->out_card = poutcard;
+    pilk->out_write = write;
+    pilk->out_port = port;
+    pilk->out_bit = bit;
+    pilk->out_level = level ? 1 : 0;
+    pilk->out_active = 0;
+    epicsInterruptUnlock(key);
+
+    return ip330InterlockReset(pcard);
+}
+
+/****************************************************************/
+/* Function called from the ISR on every trip and clear, it     */
+/* must not block. Task level only                              */
+/****************************************************************/
+int ip330InterlockCallback(IP330_ID pcard, IP330_INTERLOCK_FUNC func, void * arg)
+{
+    IP330_INTERLOCK * pilk;
+    int key;
+
+    if(!pcard)
+    {
+        errlogPrintf("ip330InterlockCallback: card is not registered!\n");
+        return -1;
+    }
+
+    pilk = ip330InterlockGet(pcard);
+
+    key = epicsInterruptLock();
+    pilk->func = func;
+    pilk->arg = arg;
+    epicsInterruptUnlock(key);
+
+    return 0;
+}
+
+/****************************************************************/
+/* Write the output bit, with interrupts locked or from ISR     */
+/****************************************************************/
+static void ip330InterlockWrite(IP330_INTERLOCK * pilk, int value)
+{
+    if(pilk->out_type == IP330_ILK_OUT_IP445)
+        ((long (*)(void *, short, short, int, long, int))pilk->out_write)(pilk->out_card, pilk->out_port, pilk->out_bit, IP330_ILK_WRITE_BIT, value, 0);
+    else if(pilk->out_type == IP330_ILK_OUT_IP470)
+        ((long (*)(void *, short, short, int, long, int, int))pilk->out_write)(pilk->out_card, pilk->out_port, pilk->out_bit, IP330_ILK_WRITE_BIT, value, 1, 0);
+}
+
+/****************************************************************/
+/* Release the output once no channel is tripped. Task level    */
+/****************************************************************/
+int ip330InterlockReset(IP330_ID pcard)
+{
+    IP330_INTERLOCK * pilk;
+    UINT32 tripped;
+    int key;
+
+    if(!pcard || !pcard->interlock)
+    {
+        errlogPrintf("ip330InterlockReset: interlock is not configured!\n");
+        return -1;
+    }
+
+    pilk = pcard->interlock;
+
+    key = epicsInterruptLock();
+    tripped = pilk->tripped;
+    if(!tripped)
+    {
+        ip330InterlockWrite(pilk, !pilk->out_level);
+        pilk->out_active = 0;
+    }
+    epicsInterruptUnlock(key);
+
+    if(tripped)
+    {
+        errlogPrintf("ip330InterlockReset: channels 0x%08X of %s are still tripped!\n", tripped, pcard->cardname);
+        return -1;
+    }
+
+    return 0;
+}
+
+int ip330InterlockResetByName(char * cardname)
+{
+    return ip330InterlockReset(ip330GetByName(cardname));
+}
+
+/****************************************************************/
+/* Check the conversions of a raw frame against the windows.    */
+/* Called from ip330ISR only                                    */
+/****************************************************************/
+void ip330InterlockCheck(IP330_ID pcard, IP330_RAW_FRAME * praw)
+{
+    IP330_INTERLOCK * pilk = pcard->interlock;
+    UINT32 enabled, mask;
+    UINT16 value;
+    int buf, loop;
+
+    enabled = pilk->enabled;
+    epicsAtomicReadMemoryBarrier();
+
+    for(buf = 0; buf < 2; buf++)
+    {
+        if(!(praw->buf_avail & (IP330_BUF0_AVAIL << buf))) continue;
+
+        for(loop = pcard->start_channel; loop <= pcard->end_channel; loop++)
+        {
+            mask = 1 << loop;
+            if(!(enabled & mask)) continue;
+
+            value = praw->data[loop + 16*buf];
+            if(!(pilk->tripped & mask))
+            {
+                if(value >= pilk->low[loop] && value <= pilk->high[loop]) continue;
+
+                /* Output first, the callback may take a while */
+                pilk->tripped |= mask;
+                if(!pilk->out_active && pilk->out_write)
+                {
+                    ip330InterlockWrite(pilk, pilk->out_level);
+                    pilk->out_active = 1;
+                }
+                pilk->trip_value[loop] = value;
+                pilk->trip_time = praw->time;
+                epicsAtomicIncrSizeT(&(pilk->trips));
+                if(pilk->func) pilk->func(pilk->arg, pcard, loop, 1, value);
+            }
+            else if(value >= pilk->clear_low[loop] && value <= pilk->clear_high[loop])
+            {
+                pilk->tripped &= ~mask;
+                if(pilk->func) pilk->func(pilk->arg, pcard, loop, 0, value);
+            }
+        }
+    }
+}
+
+/****************************************************************/
+/* Interlock part of ip330 report                               */
+/****************************************************************/
+void ip330InterlockReport(IP330_ID pcard)
+{
+    static const char * outName[] = {"none", "IP445", "IP470"};
+    IP330_INTERLOCK * pilk = pcard->interlock;
+    char timeStr[40];
+    int loop;
+
+    printf("\tInterlock: channels 0x%08X, tripped 0x%08X, %lu trips, output %s",
+           pilk->enabled, pilk->tripped, (unsigned long)pilk->trips, outName[pilk->out_type]);
+    if(pilk->out_type != IP330_ILK_OUT_NONE)
+        printf(" port %d bit %d %s", pilk->out_port, pilk->out_bit, pilk->out_active ? "active" : "released");
+    printf("\n");
+
+    if(pilk->trips)
+    {
+        epicsTimeToStrftime(timeStr, sizeof(timeStr), "%Y/%m/%d %H:%M:%S.%06f", &(pilk->trip_time));
+        printf("\t\tLast trip at %s\n", timeStr);
+    }
+
+    for(loop = pcard->start_channel; loop <= pcard->end_channel; loop++)
+    {
+        if(!(pilk->enabled & (1 << loop))) continue;
+        printf("\t\tch%d: window 0x%04X~0x%04X, clears within 0x%04X~0x%04X, last trip at 0x%04X\n", loop,
+               pilk->low[loop], pilk->high[loop], pilk->clear_low[loop], pilk->clear_high[loop], pilk->trip_value[loop]);
+    }
+}
@@ -12,25 +12,112 @@ extern "C" {
 #endif  /* __cplusplus */
 
 #include <dbScan.h>
+#include <epicsTime.h>
 
 #include "ptypes.h"
 
 typedef struct IP330_CARD * IP330_ID;
+typedef struct IP330_GROUP * IP330_GROUP_ID;
+typedef struct IP330_SYNC * IP330_SYNC_ID;
+
+/* One raw conversion of all channels, see ip330StreamEnable */
+#define IP330_STREAM_CHANNELS	32
+typedef struct IP330_STREAM_FRAME
+{
+    UINT32		seq;		/* Stream sequence number */
+    epicsTimeStamp	time;		/* Interrupt time of the conversion */
+    UINT16		data[IP330_STREAM_CHANNELS];	/* Raw ADC counts, only scanned channels are valid */
+} IP330_STREAM_FRAME;
+
+/* Error counters, see ip330GetCounter */
+typedef enum {
+    IP330_CNT_MISSED,		/* Interrupts with a missedData flag set */
+    IP330_CNT_PARTIAL,		/* Interrupts with a buffer only partly converted */
+    IP330_CNT_UNEXPECTED,	/* Interrupts without any complete buffer */
+    IP330_CNT_SCAN_DROPPED,	/* Frames not scanned, the previous I/O Intr scan was still running */
+    IP330_CNT_OVERFLOW,		/* Interrupts dropped, the worker ring was full */
+    N_IP330_CNT
+} IP330_CNT;
+/* The first N_IP330_CHNL_CNT counters are also kept per channel */
+#define N_IP330_CHNL_CNT	2
 
 int ip330Create (char *cardname, UINT16 carrier, UINT16 slot, char *adcrange, char * channels, UINT32 gainL, UINT32 gainH, char *scanmode, char * timer, UINT8 vector);
 
 void ip330Configure(IP330_ID pcard);
-void ip330Calibrate(IP330_ID pcard);
+int ip330Calibrate(IP330_ID pcard);
 
 IP330_ID ip330GetByName(char * cardname);
 IP330_ID ip330GetByLocation(UINT16 carrier, UINT16 slot);
 
 int ip330Read(IP330_ID pcard, UINT16 channel, signed int * pvalue);
+int ip330ReadSeq(IP330_ID pcard, UINT16 channel, signed int * pvalue, UINT32 * pseq);
+/* Same as ip330ReadSeq, but value is in ADC counts with IP330_WIDE_FRAC_BITS fraction bits */
+#define IP330_WIDE_FRAC_BITS	8
+int ip330ReadWide(IP330_ID pcard, UINT16 channel, signed int * pvalue, UINT32 * pseq);
+/* All channels of one frame, start_channel first, raw is the average without calibration */
+int ip330ReadFrame(IP330_ID pcard, int raw, signed int * pvalues, int maxvalues, UINT32 * pseq, epicsTimeStamp * ptime);
 IOSCANPVT * ip330GetIoScanPVT(IP330_ID pcard);
 
+/* Channels averaged at another rate with their own I/O Intr scan, see ip330GroupCreate */
+int ip330GroupCreate(char * cardname, char * groupname, char * channels, char * average);
+IP330_GROUP_ID ip330GetGroup(IP330_ID pcard, char * groupname);
+int ip330GroupHasChannel(IP330_GROUP_ID pgroup, int channel);
+int ip330GroupReadSeq(IP330_GROUP_ID pgroup, UINT16 channel, signed int * pvalue, UINT32 * pseq);
+int ip330GroupReadWide(IP330_GROUP_ID pgroup, UINT16 channel, signed int * pvalue, UINT32 * pseq);
+int ip330GroupReadFrame(IP330_GROUP_ID pgroup, int raw, signed int * pvalues, int maxvalues, UINT32 * pseq, epicsTimeStamp * ptime);
+IOSCANPVT * ip330GroupGetIoScanPVT(IP330_GROUP_ID pgroup);
+/* For the scan range trim at iocInit, -1 keeps the whole range */
+void ip330UseChannel(IP330_ID pcard, int channel);
+
 void ip330StartConvert(IP330_ID pcard);
 void ip330StartConvertByName(char * cardname);
 
+/* Recent calibrations are reused at boot, see ip330CalCacheConfig */
+int ip330CalCacheConfig(char * filename, double maxage);
+int ip330CalCacheModule(int carrier, int slot, char * serial);
+/* Calibrate again every period seconds while acquiring, see ip330CalBackground */
+int ip330CalBackground(char * cardname, double period, int nconv);
+
+int ip330TimingReport(char * cardname, int reset);
+int ip330GetCounter(IP330_ID pcard, int counter, int channel, epicsUInt64 * pvalue);
+
+int ip330FilterConfig(char * cardname, char * filter, char * taps);
+
+/* Cards converting on the trigger output of a master, see ip330SyncCreate. A   */
+/* combined frame holds the raw channels of each member, master first.         */
+int ip330SyncCreate(char * master, char * slaves, int tolerance_us);
+IP330_SYNC_ID ip330SyncGet(IP330_ID pcard);
+void ip330SyncUseChannels(IP330_SYNC_ID psync);
+int ip330SyncReadFrame(IP330_SYNC_ID psync, UINT16 * pbuf, int maxsamples, UINT32 * pseq, epicsTimeStamp * ptime);
+IOSCANPVT * ip330SyncGetIoScanPVT(IP330_SYNC_ID psync);
+
+/* Threshold interlock checked in the ISR, see ip330InterlockConfig. The function */
+/* runs at interrupt level on every trip (tripped 1) and clear (tripped 0).       */
+typedef void (*IP330_INTERLOCK_FUNC)(void * arg, IP330_ID pcard, UINT16 channel, int tripped, UINT16 value);
+int ip330InterlockConfig(char * cardname, int channel, int low, int high, int hyst);
+int ip330InterlockOutput(char * cardname, char * outtype, char * outcard, int port, int bit, int level);
+int ip330InterlockCallback(IP330_ID pcard, IP330_INTERLOCK_FUNC func, void * arg);
+int ip330InterlockReset(IP330_ID pcard);
+int ip330InterlockResetByName(char * cardname);
+
+/* Post-mortem history of raw frames, see ip330HistoryCreate. ip330HistoryDump */
+/* writes an array of IP330_STREAM_FRAME, oldest first, in IOC byte order.   */
+int ip330HistoryCreate(char * cardname, UINT32 nframes, UINT32 post);
+int ip330HistoryFreeze(IP330_ID pcard);
+int ip330HistoryRearm(IP330_ID pcard);
+int ip330HistoryFreezeByName(char * cardname);
+int ip330HistoryRearmByName(char * cardname);
+int ip330HistoryReadChannel(IP330_ID pcard, UINT16 channel, UINT16 * pbuf, int maxsamples, epicsTimeStamp * ptime);
+IOSCANPVT * ip330HistoryGetIoScanPVT(IP330_ID pcard);
+int ip330HistoryDump(char * cardname, char * filename);
+
+int ip330StreamEnable(char * cardname, UINT32 nframes, UINT32 block);
+int ip330StreamOpen(IP330_ID pcard, UINT32 * pcursor);
+int ip330StreamRead(IP330_ID pcard, UINT32 * pcursor, IP330_STREAM_FRAME * pframes, int maxframes, UINT32 * plost);
+int ip330StreamReadChannel(IP330_ID pcard, UINT16 channel, UINT32 * pcursor, UINT16 * pbuf, int maxsamples, epicsTimeStamp * ptime, UINT32 * plost);
+int ip330StreamReadFrames(IP330_ID pcard, UINT32 * pcursor, UINT16 * pbuf, int maxsamples, epicsTimeStamp * ptime, UINT32 * plost);
+IOSCANPVT * ip330StreamGetIoScanPVT(IP330_ID pcard);
+
 #ifdef __cplusplus
 }
 #endif  /* __cplusplus */
@@ -21,14 +21,20 @@ extern "C" {
 
 #include <epicsMutex.h>
 #include <epicsThread.h>
+#include <epicsEvent.h>
 #include <epicsString.h>
 #include <epicsInterrupt.h>
+#include <epicsAtomic.h>
+#include <epicsTime.h>
+#include <epicsTypes.h>
 #include <cantProceed.h>
 #include <epicsExport.h>
 #include <drvSup.h>
 #include <dbScan.h>
+#include <callback.h>
 #include <ellLib.h>
 #include <errlog.h>
+#include <registryFunction.h>
 
 #include "drvIpac.h"
 
@@ -63,6 +69,238 @@ typedef struct IP330_HW_MAP
 /* And packed with -mstrict-align will make access to byte-access, it will hurt */
 
 
+/* One completed averaging cycle. The worker fills a free buffer then publishes it, */
+/* readers never lock, they check wseq is even and unchanged around the copy.       */
+typedef struct IP330_FRAME
+{
+    volatile UINT32             wseq;		/* Odd while the worker is writing this buffer */
+    UINT32                      seq;		/* Frame sequence number, 0 means no data yet */
+    epicsTimeStamp              time;		/* When the averaging cycle completed */
+    epicsUInt64                 mono;		/* epicsMonotonicGet() at the interrupt which completed the cycle */
+    epicsInt64                  sum[MAX_IP330_CHANNELS];	/* Copy of acc_sum at the end of the cycle */
+    UINT32                      count[MAX_IP330_CHANNELS];	/* Samples in sum, 0 means no data for this channel */
+} IP330_FRAME;
+
+/* Triple buffer: one latest, one pinned by the running I/O Intr scan, one to write */
+#define N_IP330_FRAMES			3
+
+/* All callback priorities still have records to process for the pinned frame */
+#define IP330_SCAN_PRIO_ALL		((1 << NUM_CALLBACK_PRIORITIES) - 1)
+
+/* One interrupt worth of raw data, copied by the ISR for the worker thread */
+typedef struct IP330_RAW_FRAME
+{
+    UINT32                      newdata_flag;	/* newData registers masked by chnl_mask */
+    UINT32                      misseddata_flag;/* missedData registers masked by chnl_mask */
+    UINT32                      buf_avail;	/* IP330_BUF0_AVAIL and/or IP330_BUF1_AVAIL */
+    epicsTimeStamp              time;		/* When the interrupt came */
+    epicsUInt64                 mono;		/* epicsMonotonicGet() at ISR entry */
+    UINT16                      data[MAX_IP330_CHANNELS];
+} IP330_RAW_FRAME;
+
+#define IP330_BUF0_AVAIL		0x1
+#define IP330_BUF1_AVAIL		0x2
+
+/* ISR to worker ring, single producer and single consumer, must be power of 2 */
+#define N_IP330_RAW_RING		64
+#define IP330_RAW_RING_MASK		(N_IP330_RAW_RING - 1)
+
+#define IP330_WORKER_PRIORITY		epicsThreadPriorityHigh
+
+/* Conversion time of one channel, bounds the frame rate whatever the timer is */
+#define IP330_CONVERSION_NS		8000
+
+/* Post-mortem history state, RUNNING->STOPPING by a freeze, STOPPING->FROZEN by the */
+/* worker after history_post more frames, FROZEN->RUNNING by a rearm                 */
+#define IP330_HISTORY_RUNNING		0
+#define IP330_HISTORY_STOPPING		1
+#define IP330_HISTORY_FROZEN		2
+
+/* worker_cmd, what another thread asks of the worker on its next wake up */
+#define IP330_WORKER_RUN	0
+#define IP330_WORKER_STOP	1	/* Return, ip330Create failed and frees the card */
+#define IP330_WORKER_PAUSE	2	/* Wait for worker_resume, see ip330WorkerPause */
+
+/* The worker prints an error counter summary at most this often */
+#define IP330_CNT_LOG_INTERVAL_NS	((epicsUInt64)10000000000ULL)
+
+/* Timing histogram, bin 0 is below 1us, bin n is [2^(n-1), 2^n) us, the last bin takes the rest. */
+/* Updated with atomic operations, the read latency one has a writer per callback thread.       */
+#define N_IP330_HIST_BINS		24
+
+typedef struct IP330_HIST
+{
+    size_t                      bin[N_IP330_HIST_BINS];
+    size_t                      count;
+    size_t                      sum_us;
+    size_t                      max_us;
+} IP330_HIST;
+
+/* Per-channel calibration in fixed point, rebuilt by ip330Configure/ip330Calibrate.  */
+/* value = ((sum * scale) >> shift + offset) >> IP330_CAL_QBITS, no FP or division.  */
+#define IP330_CAL_QBITS			24
+#define IP330_CAL_ROUND			((epicsInt64)1 << (IP330_CAL_QBITS - 1))
+
+/* EMA state is kept in counts << IP330_EMA_QBITS and published as that many samples */
+#define IP330_EMA_QBITS			16
+#define IP330_EMA_ONE			(1 << IP330_EMA_QBITS)
+
+typedef struct IP330_CAL_TABLE
+{
+    epicsInt64                  scale[MAX_IP330_CHANNELS];	/* adj_slope*2^shift/divisor of the channel gain */
+    epicsInt32                  slope[MAX_IP330_CHANNELS];	/* adj_slope, for a frame with another sample count */
+    epicsInt64                  offset[MAX_IP330_CHANNELS];	/* adj_slope*adj_offset */
+    UINT32                      divisor;	/* Sample count the scale was built for */
+    UINT32                      shift;		/* Smallest shift with 2^shift >= divisor */
+} IP330_CAL_TABLE;
+
+/* One averaging of some channels with its own records. Every card has the one set up by */
+/* ip330Create, ip330GroupCreate adds more, all fed from the same raw frames.           */
+#define MAX_IP330_GROUPS		8
+
+typedef struct IP330_GROUP
+{
+    struct IP330_CARD           * pcard;
+    char                        * name;		/* NULL for the group of ip330Create */
+
+    UINT8                       start_channel;	/* Channels averaged, within the card's range */
+    UINT8                       end_channel;
+    UINT32                      avg_times;	/* Average times, or EMA publication interval */
+    UINT32                      ema_shift;	/* 0 for boxcar average, else EMA alpha is 1/2^ema_shift */
+
+    IP330_CAL_TABLE             cal[2];		/* Readers use cal[cal_active], the other one is rebuilt */
+    volatile int                cal_active;
+    volatile UINT32             cal_seq;	/* Odd during a rebuild, readers retry if it changed around their use */
+
+    epicsInt64                  acc_sum[MAX_IP330_CHANNELS];	/* Boxcar sum, or EMA state in counts << IP330_EMA_QBITS */
+    UINT32                      acc_count[MAX_IP330_CHANNELS];	/* Samples since the last publication */
+    int                         ema_seeded;	/* EMA state holds a sample, worker only */
+    IOSCANPVT                   ioscan;         /* Trigger EPICS record */
+
+    IP330_FRAME                 frame[N_IP330_FRAMES];	/* Published frames, see IP330_FRAME */
+    volatile int                frame_latest;	/* Index of the latest published frame */
+    volatile int                frame_pinned;	/* Index of the frame all readers use until the scan completes */
+    int                         scan_pending;	/* Bit per callback priority still processing frame_pinned */
+    UINT32                      frame_seq;	/* Sequence number of the latest published frame */
+} IP330_GROUP;
+
+/* Optional decimating filter between the raw frames and the averaging, see drvIP330Filter.c */
+/* State is structure-of-arrays, [stage][channel], so the inner loops run over channels.  */
+#define IP330_FILTER_NONE		0
+#define IP330_FILTER_CIC		1
+#define IP330_FILTER_FIR		2
+
+#define MAX_IP330_CIC_ORDER		5
+#define MAX_IP330_CIC_BITS		47	/* order*log2(decimation), keeps 16 bit input in 64 bits */
+#define MAX_IP330_FIR_TAPS		64
+#define MAX_IP330_DECIMATION		4096
+#define IP330_FIR_QBITS			16
+
+typedef struct IP330_FILTER
+{
+    int                         type;		/* IP330_FILTER_CIC or IP330_FILTER_FIR */
+    UINT32                      decimation;	/* One output every decimation inputs */
+    UINT32                      phase;		/* Inputs since the last output */
+
+    int                         order;		/* CIC stages */
+    epicsUInt64                 gain;		/* CIC gain, decimation^order */
+    epicsUInt64                 integ[MAX_IP330_CIC_ORDER][MAX_IP330_CHANNELS];	/* CIC integrators, wrap around on purpose */
+    epicsUInt64                 comb[MAX_IP330_CIC_ORDER][MAX_IP330_CHANNELS];	/* CIC comb delays */
+
+    int                         ntaps;		/* FIR taps */
+    int                         pos;		/* Newest entry in hist */
+    epicsInt32                  taps[MAX_IP330_FIR_TAPS];	/* Q IP330_FIR_QBITS, unity DC gain */
+    epicsInt32                  hist[MAX_IP330_FIR_TAPS][MAX_IP330_CHANNELS];	/* FIR delay line */
+} IP330_FILTER;
+
+/* Threshold interlock checked by ip330ISR, see drvIP330Interlock.c */
+#define IP330_ILK_OUT_NONE		0
+#define IP330_ILK_OUT_IP445		1
+#define IP330_ILK_OUT_IP470		2
+
+typedef struct IP330_INTERLOCK
+{
+    volatile UINT32             enabled;	/* Bit per channel with a window */
+    volatile UINT32             tripped;	/* Bit per channel tripped and not cleared yet, ISR only */
+    UINT16                      low[MAX_IP330_CHANNELS];	/* Trips outside [low, high], raw counts */
+    UINT16                      high[MAX_IP330_CHANNELS];
+    UINT16                      clear_low[MAX_IP330_CHANNELS];	/* Clears within [clear_low, clear_high] */
+    UINT16                      clear_high[MAX_IP330_CHANNELS];
+    UINT16                      trip_value[MAX_IP330_CHANNELS];	/* Sample of the last trip */
+    epicsTimeStamp              trip_time;	/* When the last trip happened */
+    size_t                      trips;		/* Number of trips of all channels */
+
+    IP330_INTERLOCK_FUNC        func;		/* Called from ISR on trip and clear, may be NULL */
+    void                        * arg;
+
+    int                         out_type;	/* IP330_ILK_OUT_NONE, IP445 or IP470 */
+    void                        * out_card;	/* Handle from xy2445FindCard or avme470FindCard */
+    REGISTRYFUNCTION            out_write;	/* xy2445WriteCard or avme470WriteCard */
+    short                       out_port;
+    short                       out_bit;
+    int                         out_level;	/* Bit value while tripped */
+    volatile int                out_active;	/* Output is at out_level until ip330InterlockReset */
+} IP330_INTERLOCK;
+
+/* Where the calibration coefficients of a card come from, see drvIP330Cal.c */
+#define IP330_CAL_NONE			0
+#define IP330_CAL_CACHED		1
+#define IP330_CAL_DONE			2
+
+/* Modules told apart by ip330CalCacheModule, and their identity in the cache file */
+#define MAX_IP330_CAL_MODULES		32
+#define IP330_CAL_MODULE_LEN		32
+
+/* Background calibration borrows the ADC for one calibration voltage at a time */
+#define IP330_CAL_BG_NCONV		16	/* Default conversions of all channels averaged per borrow */
+#define IP330_CAL_BG_SPACING		0.5	/* Seconds of normal acquisition between two borrows */
+#define IP330_CAL_BG_TIMEOUT_NS		1000000	/* One conversion of all channels takes 256us */
+#define IP330_CAL_BG_EOS_TRIES		4	/* Frames ip330CalBorrow may wait for a gap between two scans */
+#define IP330_CAL_BG_SLOPE_TOL		0.1	/* A fit with slope off 1.0 by more is thrown away */
+#define IP330_CAL_BG_OFFSET_MAX		2048.0	/* Same for an offset of more raw counts */
+
+/* Cards sampling on the trigger of one master, see drvIP330Sync.c. Member workers */
+/* match their raw frames by interrupt time in slots, a slot all members filled    */
+/* is published as one frame, older slots still open can never complete.          */
+#define MAX_IP330_SYNC_MEMBERS		8
+#define N_IP330_SYNC_SLOTS		8
+#define N_IP330_SYNC_FRAMES		4
+#define IP330_SYNC_TOLERANCE_NS		50000	/* Interrupt latency spread allowed without a timer period */
+
+typedef struct IP330_SYNC_SLOT
+{
+    UINT32                      arrived;	/* Bit per member, 0 when the slot is free */
+    int                         buf;		/* IP330_BUF0_AVAIL or IP330_BUF1_AVAIL */
+    epicsUInt64                 mono;		/* Interrupt of the member which opened the slot */
+    epicsUInt64                 skew;		/* Largest interrupt time difference to mono */
+    epicsTimeStamp              time;		/* Interrupt time of the master */
+    UINT16                      data[MAX_IP330_SYNC_MEMBERS][MAX_IP330_CHANNELS];
+} IP330_SYNC_SLOT;
+
+typedef struct IP330_SYNC_FRAME
+{
+    UINT32                      seq;		/* Combined frame sequence number */
+    epicsTimeStamp              time;		/* Interrupt time of the master */
+    UINT16                      data[MAX_IP330_SYNC_MEMBERS][MAX_IP330_CHANNELS];
+} IP330_SYNC_FRAME;
+
+typedef struct IP330_SYNC
+{
+    epicsMutexId                lock;		/* Member workers fill the slots */
+    int                         nmembers;	/* Master is member 0 */
+    struct IP330_CARD           * member[MAX_IP330_SYNC_MEMBERS];
+    UINT32                      all_mask;	/* arrived of a complete slot */
+    epicsUInt64                 tolerance_ns;	/* Interrupts closer than this are the same trigger */
+
+    IP330_SYNC_SLOT             slot[N_IP330_SYNC_SLOTS];
+    IP330_SYNC_FRAME            frame[N_IP330_SYNC_FRAMES];	/* Published, readers check head around the copy */
+    volatile UINT32             head;		/* Combined frames published */
+    IOSCANPVT                   ioscan;		/* Triggered once per combined frame */
+
+    size_t                      incomplete;	/* Slots dropped without all members */
+    epicsUInt64                 skew_max;	/* Largest skew of a published frame */
+} IP330_SYNC;
+
 /* device driver ID structure */
 
 typedef ELLLIST IP330_CARD_LIST;
@@ -74,10 +312,79 @@ typedef struct IP330_CARD
     epicsMutexId                lock;
     double                      adj_slope[N_GAINS];
     double                      adj_offset[N_GAINS];
+    int                         cal_state;	/* IP330_CAL_NONE, CACHED or DONE, what adj_slope/adj_offset hold */
+    epicsTimeStamp              cal_time;	/* When adj_slope/adj_offset were measured */
+    epicsEventId                cal_event;	/* Calibration thread is done, see ip330CalStart */
+    int                         cal_started;	/* ip330InitHook waits for this card */
+    int                         cal_failed;	/* Boot calibration could not run or failed, data is raw */
+    epicsThreadId               cal_bg_thread;	/* Background calibration, see ip330CalBackground */
+    double                      cal_bg_period;	/* Seconds between background calibrations, 0 once after a boot from the cache */
+    int                         cal_bg_nconv;	/* Conversions averaged for each calibration voltage */
+    UINT32                      cal_bg_runs;	/* Background calibrations completed */
+    UINT32                      cal_bg_fails;	/* Background calibrations given up, coefficients kept */
+    epicsUInt64                 cal_gap_last_ns;	/* Acquisition stopped by the last borrow */
+    epicsUInt64                 cal_gap_max_ns;	/* Longest acquisition stop of any borrow */
+    epicsUInt64                 cal_skipped;	/* Frames not acquired because of borrows, 0 if not timer driven */
 
-    UINT32                      sum_data[MAX_IP330_CHANNELS]; /* The highest byte +1 is number of samples, then lower 24 bits holds summary of up to 255 samples */
-                                                              /* The maximum will be 0xFFFFFF00, so 0xFFFFFFFF is used to indicate no data */
-    IOSCANPVT                   ioscan;         /* Trigger EPICS record */
+    IP330_GROUP                 group;		/* Averaging set by ip330Create */
+    IP330_GROUP                 * groups[MAX_IP330_GROUPS];	/* More from ip330GroupCreate */
+    volatile int                ngroups;	/* groups[ngroups] is only set once it is ready */
+
+    IP330_RAW_FRAME             raw_ring[N_IP330_RAW_RING];	/* Filled by ISR, drained by worker */
+    IP330_RAW_FRAME             raw_scratch;	/* ISR reads into this when the ring is full */
+    volatile UINT32             raw_head;	/* Written by ISR only */
+    volatile UINT32             raw_tail;	/* Written by worker only */
+    UINT32                      raw_discard;	/* Worker drops entries before this after a scan reset */
+    epicsEventId                raw_event;	/* ISR wakes the worker */
+    epicsThreadId               worker;		/* Averaging, scan reset and record trigger */
+    volatile int                worker_cmd;	/* IP330_WORKER_RUN unless another thread needs the worker */
+    epicsEventId                worker_ack;	/* Worker took worker_cmd */
+    epicsEventId                worker_resume;	/* Ends IP330_WORKER_PAUSE */
+    epicsMutexId                worker_pause_lock;	/* One pause at a time, taken before lock */
+
+    epicsUInt64                 period_ns;	/* Nominal interrupt period, 0 when it is not timer driven */
+    epicsUInt64                 isr_last;	/* ISR entry of the previous interrupt, ISR only */
+    epicsUInt64                 isr_period;	/* Previous interrupt period, ISR only */
+    volatile UINT32             isr_count;	/* Interrupts taken, ISR only, ip330CalBorrow waits on it */
+    IP330_HIST                  hist_isr;	/* ISR duration */
+    IP330_HIST                  hist_jitter;	/* Interrupt period minus period_ns, or the previous period */
+    IP330_HIST                  hist_scan;	/* ISR entry to scanIoRequest */
+    IP330_HIST                  hist_read;	/* ISR entry to ip330Read */
+
+    /* 64 bits do not wrap, but are not atomic on 32 bit targets. The worker is the only */
+    /* writer and makes cnt_seq odd around updates, readers retry if it changed.        */
+    epicsUInt64                 cnt[N_IP330_CNT];	/* Error counters, written by worker only */
+    epicsUInt64                 cnt_chnl[N_IP330_CHNL_CNT][MAX_IP330_CHANNELS];	/* Same per channel */
+    volatile UINT32             cnt_seq;
+    size_t                      isr_overflow;	/* Incremented by ISR, folded into cnt by worker, may wrap */
+    size_t                      isr_overflow_seen;	/* isr_overflow already in cnt, worker only */
+    epicsUInt64                 cnt_logged[N_IP330_CNT];	/* cnt at the last summary printed, worker only */
+    epicsUInt64                 cnt_logged_mono;	/* When the last summary was printed */
+    epicsUInt64                 cnt_start_mono;	/* When counting started, for the rates */
+    UINT32                      last_unexpected;	/* newdata_flag of the last IP330_CNT_UNEXPECTED */
+
+    IP330_SYNC                  * sync;		/* NULL unless the card is in an ip330SyncCreate */
+    int                         sync_member;	/* Index in sync->member */
+
+    IP330_FILTER                * filter;	/* NULL unless ip330FilterConfig was called */
+    IP330_INTERLOCK             * interlock;	/* NULL unless an ip330Interlock function was called */
+
+    IP330_STREAM_FRAME          * history;	/* Post-mortem ring, NULL unless ip330HistoryCreate was called */
+    UINT32                      history_size;	/* Number of frames in history, power of 2 */
+    UINT32                      history_post;	/* Frames still written after a freeze */
+    volatile UINT32             history_head;	/* Frames written since the last rearm, worker only, wraps */
+    volatile int                history_filled;	/* Ring went round once since the last rearm, head may have wrapped */
+    volatile int                history_state;	/* IP330_HISTORY_RUNNING, STOPPING or FROZEN */
+    UINT32                      history_left;	/* Frames still written while STOPPING */
+    volatile UINT32             history_gen;	/* Bumped by every rearm, readers check it */
+    epicsTimeStamp              history_time;	/* When the freeze was asked for */
+    IOSCANPVT                   history_ioscan;	/* Trigger history waveform records once frozen */
+
+    IP330_STREAM_FRAME          * stream;	/* Raw frame ring, NULL unless ip330StreamEnable was called */
+    UINT32                      stream_size;	/* Number of frames in stream, power of 2 */
+    volatile UINT32             stream_head;	/* Sequence number of the next frame to write */
+    UINT32                      stream_block;	/* Trigger stream_ioscan every stream_block frames */
+    IOSCANPVT                   stream_ioscan;	/* Trigger stream waveform/aai records */
 
     char                        * cardname;	/* Card identification */
     UINT16                      carrier;	/* Industry Pack Carrier Index */
@@ -90,13 +397,14 @@ typedef struct IP330_CARD
     UINT8                       start_channel;	/* start channel, from 0 */
     UINT8                       end_channel;	/* end channel, up to 15 or 31 */
     UINT32                      chnl_mask;	/* mask to screen missedData and newData flag */
+    UINT32                      used_mask;	/* Channels records read, see ip330UseChannel */
 
     UINT8                       gain[MAX_IP330_CHANNELS];
 
+    UINT16                      ctrl_reg;	/* Control register set by ip330Configure */
     UINT16                      scan_mode;	/* Scan Mode */
     UINT16                      trg_dir;	/* Trigger Direction */
-    UINT32                      avg_times;	/* Average times */
-    UINT32                      avg_rst;	/* Reset after Average */
+    UINT32                      avg_rst;	/* Reset after Average, only for group */
 
     UINT8                       timer_prescaler;/* Tomer Prescaler */
     UINT16                      conversion_timer;/* Conversion Timer */
@@ -104,10 +412,46 @@ typedef struct IP330_CARD
     UINT8                       vector;		/* Interrupt vector */
 
     volatile IP330_HW_MAP       *pHardware;	/* controller registers */
+    int                         d32;		/* Carrier passes D32 to the data registers, see ipacBulk.h */
+    void                        (*isr_read)(struct IP330_CARD * pcard, IP330_RAW_FRAME * praw);	/* Picked by ip330SelectRead */
 
     char                        debug_msg[DEBUG_MSG_SIZE];
 } IP330_CARD;
 
+/* drvIP330Timing.c */
+void ip330HistAdd(IP330_HIST * phist, epicsUInt64 ns);
+void ip330HistReset(IP330_HIST * phist);
+void ip330HistReport(IP330_HIST * phist, const char * title);
+
+/* drvIP330.c */
+void ip330WorkerPause(IP330_ID pcard);
+void ip330WorkerResume(IP330_ID pcard);
+void ip330BuildCalTable(IP330_ID pcard);
+void ip330CalFit(IP330_ID pcard, int gain, double count_callo, double count_calhi, double * pslope, double * poffset);
+
+/* drvIP330Cal.c */
+int ip330CalCacheLoad(IP330_ID pcard);
+int ip330CalCacheSave(IP330_ID pcard);
+int ip330CalStart(IP330_ID pcard, unsigned int priority);
+void ip330CalWait(IP330_ID pcard);
+void ip330CalReport(IP330_ID pcard);
+
+/* drvIP330History.c */
+void ip330HistoryPush(IP330_ID pcard, IP330_RAW_FRAME * praw);
+void ip330HistoryReport(IP330_ID pcard);
+
+/* drvIP330Sync.c */
+void ip330SyncPush(IP330_ID pcard, IP330_RAW_FRAME * praw);
+void ip330SyncReport(IP330_ID pcard);
+
+/* drvIP330Interlock.c */
+void ip330InterlockCheck(IP330_ID pcard, IP330_RAW_FRAME * praw);
+void ip330InterlockReport(IP330_ID pcard);
+
+/* drvIP330Filter.c, worker thread only */
+int ip330FilterProcess(IP330_FILTER * pfilter, const UINT16 * pin, UINT16 * pout, int nchnl);
+void ip330FilterReport(IP330_FILTER * pfilter);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,359 @@
+/****************************************************************/
+/* This file implements IP330 sync groups: cards converting on  */
+/* the trigger output of a master, assembled into one frame     */
+/****************************************************************/
+#include "drvIP330Lib.h"
+#include "drvIP330Private.h"
+
+/****************************************************************************************************/
+/*  Routine: ip330SyncCreate                                                                        */
+/*                                                                                                  */
+/*  Purpose: Sample several IP-330 ADC modules on the same trigger, as one frame with one scan      */
+/*                                                                                                  */
+/*  SYNOPSIS: int ip330SyncCreate(                                                                  */
+/*                  char *master,         Name given to ip330Create, its trigger becomes an output  */
+/*                  char *slaves,         "card1,card2,..." their trigger becomes an input and     */
+/*                                        their scan mode cvtOnExt                                  */
+/*                  int tolerance_us)     Interrupts of the same trigger are this close, 0 for half */
+/*                                        the timer period of the master                            */
+/*  Example:                                                                                        */
+/*            ip330SyncCreate("ip330_1", "ip330_2,ip330_3", 0)                                      */
+/*            record(waveform, "ADC:SYNC") { field(DTYP, "IP330") field(SCAN, "I/O Intr")           */
+/*                                           field(INP, "#C0 S0 @ip330_1:0:SYNC") }                  */
+/*                                                                                                  */
+/*  All cards must have the same input type. The trigger lines of the cards must be wired together */
+/*  on the carrier. Call it after ip330Create of all cards and before iocInit.                      */
+/****************************************************************************************************/
+int ip330SyncCreate(char * master, char * slaves, int tolerance_us)
+{
+    IP330_SYNC * psync;
+    IP330_ID pcard;
+    char * list, * name, * last;
+    int loop;
+
+    if(!master || !(pcard = ip330GetByName(master)))
+    {
+        errlogPrintf("ip330SyncCreate: master %s is not registered!\n", master ? master : "");
+        return -1;
+    }
+
+    if(tolerance_us < 0)
+    {
+        errlogPrintf("ip330SyncCreate: tolerance %dus is illegal for %s\n", tolerance_us, master);
+        return -1;
+    }
+
+    psync = callocMustSucceed(1, sizeof(IP330_SYNC), "ip330SyncCreate");
+    psync->member[psync->nmembers++] = pcard;
+
+    list = epicsStrDup(slaves ? slaves : "");
+    for(name = epicsStrtok_r(list, ", ", &last); name; name = epicsStrtok_r(NULL, ", ", &last))
+    {
+        pcard = ip330GetByName(name);
+        if(!pcard)
+        {
+            errlogPrintf("ip330SyncCreate: slave %s is not registered!\n", name);
+            goto FAIL;
+        }
+        if(psync->nmembers >= MAX_IP330_SYNC_MEMBERS)
+        {
+            errlogPrintf("ip330SyncCreate: more than %d cards for master %s!\n", MAX_IP330_SYNC_MEMBERS, master);
+            goto FAIL;
+        }
+        for(loop = 0; loop < psync->nmembers; loop++)
+        {
+            if(psync->member[loop] == pcard)
+            {
+                errlogPrintf("ip330SyncCreate: %s is listed twice for master %s!\n", name, master);
+                goto FAIL;
+            }
+        }
+        psync->member[psync->nmembers++] = pcard;
+    }
+
+    if(psync->nmembers < 2)
+    {
+        errlogPrintf("ip330SyncCreate: no slave for master %s!\n", master);
+        goto FAIL;
+    }
+
+    for(loop = 0; loop < psync->nmembers; loop++)
+    {
+        pcard = psync->member[loop];
+        if(pcard->sync)
+        {
+            errlogPrintf("ip330SyncCreate: %s is already synchronized!\n", pcard->cardname);
+            goto FAIL;
+        }
+        if(pcard->inp_typ != psync->member[0]->inp_typ)
+        {
+            errlogPrintf("ip330SyncCreate: %s has another input type than master %s!\n", pcard->cardname, master);
+            goto FAIL;
+        }
+    }
+
+    /* Park the workers and stop all cards, then start the slaves before the master drives their trigger */
+    for(loop = 0; loop < psync->nmembers; loop++)
+    {
+        pcard = psync->member[loop];
+        ip330WorkerPause(pcard);
+        ipmIrqCmd(pcard->carrier, pcard->slot, 0, ipac_irqDisable);
+        pcard->pHardware->controlReg = 0x0;
+    }
+    epicsThreadSleep(0.1);
+
+    for(loop = psync->nmembers - 1; loop >= 0; loop--)
+    {
+        pcard = psync->member[loop];
+        if(loop == 0)
+        {
+            pcard->trg_dir = TRG_DIR_OUTPUT;
+        }
+        else
+        {
+            if(pcard->scan_mode != SCAN_MODE_CVTONEXT)
+                printf("IP330 %s: scan mode %s changed to %s for master %s\n", pcard->cardname, scanModeName[pcard->scan_mode], scanModeName[SCAN_MODE_CVTONEXT], master);
+            pcard->trg_dir = TRG_DIR_INPUT;
+            pcard->scan_mode = SCAN_MODE_CVTONEXT;
+        }
+        /* Worker is paused, nothing queued before now was triggered by the master */
+        pcard->raw_discard = pcard->raw_head;
+        ip330Configure(pcard);
+    }
+
+    if(tolerance_us)
+        psync->tolerance_ns = (epicsUInt64)tolerance_us * 1000;
+    else if(psync->member[0]->period_ns)
+        psync->tolerance_ns = psync->member[0]->period_ns / 2;
+    else
+        psync->tolerance_ns = IP330_SYNC_TOLERANCE_NS;
+
+    psync->all_mask = (1 << psync->nmembers) - 1;
+    psync->lock = epicsMutexMustCreate();
+    scanIoInit( &(psync->ioscan) );
+
+    /* Workers only look at sync once everything above is visible */
+    for(loop = 0; loop < psync->nmembers; loop++)
+        psync->member[loop]->sync_member = loop;
+    epicsAtomicWriteMemoryBarrier();
+    for(loop = 0; loop < psync->nmembers; loop++)
+        psync->member[loop]->sync = psync;
+
+    for(loop = 0; loop < psync->nmembers; loop++)
+    {
+        ipmIrqCmd(psync->member[loop]->carrier, psync->member[loop]->slot, 0, ipac_irqEnable);
+        ip330WorkerResume(psync->member[loop]);
+    }
+
+    free(list);
+    return 0;
+
+FAIL:
+    free(list);
+    free(psync);
+    return -1;
+}
+
+/****************************************************************/
+/* Free the slot, it can not be published                       */
+/****************************************************************/
+static void ip330SyncDrop(IP330_SYNC * psync, IP330_SYNC_SLOT * pslot)
+{
+    pslot->arrived = 0;
+    psync->incomplete++;
+}
+
+/****************************************************************/
+/* Copy a complete slot into the next frame and trigger records */
+/* Caller holds psync->lock                                     */
+/****************************************************************/
+static void ip330SyncPublish(IP330_SYNC * psync, IP330_SYNC_SLOT * pslot)
+{
+    IP330_SYNC_FRAME * pframe;
+    UINT32 head;
+    int loop;
+
+    /* Every member is past this trigger, nothing older can complete anymore */
+    for(loop = 0; loop < N_IP330_SYNC_SLOTS; loop++)
+    {
+        if(psync->slot[loop].arrived && (epicsInt64)(psync->slot[loop].mono - pslot->mono) < 0)
+            ip330SyncDrop(psync, &(psync->slot[loop]));
+    }
+
+    head = psync->head;
+    pframe = &(psync->frame[head % N_IP330_SYNC_FRAMES]);
+    pframe->seq = head;
+    pframe->time = pslot->time;
+    memcpy(pframe->data, pslot->data, psync->nmembers * sizeof(pslot->data[0]));
+    if(pslot->skew > psync->skew_max) psync->skew_max = pslot->skew;
+    pslot->arrived = 0;
+
+    epicsAtomicWriteMemoryBarrier();
+    psync->head = head + 1;
+    scanIoRequest(psync->ioscan);
+}
+
+/****************************************************************/
+/* Put the conversions of a raw frame into the slot of their    */
+/* trigger. Called from the worker thread of each member        */
+/****************************************************************/
+void ip330SyncPush(IP330_ID pcard, IP330_RAW_FRAME * praw)
+{
+    IP330_SYNC * psync = pcard->sync;
+    IP330_SYNC_SLOT * pslot, * poldest;
+    UINT32 bit = (1 << pcard->sync_member);
+    epicsUInt64 skew;
+    int buf, loop;
+
+    epicsMutexLock(psync->lock);
+    for(buf = IP330_BUF0_AVAIL; buf <= IP330_BUF1_AVAIL; buf <<= 1)
+    {
+        if(!(praw->buf_avail & buf)) continue;
+
+        /* Slot of the same trigger this member has not filled yet */
+        pslot = NULL;
+        poldest = NULL;
+        for(loop = 0; loop < N_IP330_SYNC_SLOTS; loop++)
+        {
+            IP330_SYNC_SLOT * ptry = &(psync->slot[loop]);
+
+            if(!ptry->arrived)
+            {
+                if(!pslot) pslot = ptry;
+                continue;
+            }
+            if(!poldest || (epicsInt64)(ptry->mono - poldest->mono) < 0) poldest = ptry;
+            skew = (praw->mono > ptry->mono) ? praw->mono - ptry->mono : ptry->mono - praw->mono;
+            if(ptry->buf == buf && !(ptry->arrived & bit) && skew <= psync->tolerance_ns)
+            {
+                pslot = ptry;
+                break;
+            }
+        }
+
+        if(!pslot)
+        {/* A member stopped converting, give up its oldest trigger */
+            ip330SyncDrop(psync, poldest);
+            pslot = poldest;
+        }
+
+        if(!pslot->arrived)
+        {
+            pslot->buf = buf;
+            pslot->mono = praw->mono;
+            pslot->skew = 0;
+        }
+        else
+        {
+            skew = (praw->mono > pslot->mono) ? praw->mono - pslot->mono : pslot->mono - praw->mono;
+            if(skew > pslot->skew) pslot->skew = skew;
+        }
+
+        if(pcard->sync_member == 0) pslot->time = praw->time;
+        /* In differential mode buf1 is the second conversion of the same channels */
+        memcpy(&(pslot->data[pcard->sync_member][pcard->start_channel]),
+               &(praw->data[pcard->start_channel + (buf == IP330_BUF1_AVAIL ? 16 : 0)]),
+               (pcard->end_channel - pcard->start_channel + 1) * sizeof(UINT16));
+        pslot->arrived |= bit;
+
+        if(pslot->arrived == psync->all_mask) ip330SyncPublish(psync, pslot);
+    }
+    epicsMutexUnlock(psync->lock);
+}
+
+IP330_SYNC_ID ip330SyncGet(IP330_ID pcard)
+{
+    if(!pcard || !pcard->sync)
+    {
+        errlogPrintf("ip330SyncGet: card is not synchronized!\n");
+        return NULL;
+    }
+    return pcard->sync;
+}
+
+/****************************************************************/
+/* Combined frames carry every channel of every member, keep    */
+/* ip330Trim from shrinking any of them. From init_record only  */
+/****************************************************************/
+void ip330SyncUseChannels(IP330_SYNC_ID psync)
+{
+    int loop;
+
+    if(!psync) return;
+
+    for(loop = 0; loop < psync->nmembers; loop++)
+        ip330UseChannel(psync->member[loop], -1);
+}
+
+/****************************************************************/
+/* Latest combined frame, channels start_channel to end_channel */
+/* of each member one after another, master first. Returns the  */
+/* number of samples read, 0 if no frame is complete yet.       */
+/****************************************************************/
+int ip330SyncReadFrame(IP330_SYNC_ID psync, UINT16 * pbuf, int maxsamples, UINT32 * pseq, epicsTimeStamp * ptime)
+{
+    IP330_SYNC_FRAME * pframe;
+    IP330_ID pcard;
+    UINT32 head;
+    int n, nchnl, loop;
+
+    if(!psync || !pbuf || maxsamples < 0)
+    {
+        errlogPrintf("ip330SyncReadFrame: card is not synchronized or bad parameters!\n");
+        return -1;
+    }
+
+    do
+    {/* Retry if the worker came around to this frame while we were copying */
+        head = psync->head;
+        epicsAtomicReadMemoryBarrier();
+        if(head == 0) return 0;
+
+        pframe = &(psync->frame[(head - 1) % N_IP330_SYNC_FRAMES]);
+        n = 0;
+        for(loop = 0; loop < psync->nmembers && n < maxsamples; loop++)
+        {
+            pcard = psync->member[loop];
+            nchnl = pcard->end_channel - pcard->start_channel + 1;
+            if(nchnl > maxsamples - n) nchnl = maxsamples - n;
+            memcpy(pbuf + n, &(pframe->data[loop][pcard->start_channel]), nchnl * sizeof(UINT16));
+            n += nchnl;
+        }
+        if(pseq) *pseq = pframe->seq;
+        if(ptime) *ptime = pframe->time;
+
+        epicsAtomicReadMemoryBarrier();
+    } while(psync->head - head > N_IP330_SYNC_FRAMES - 2);
+
+    return n;
+}
+
+IOSCANPVT * ip330SyncGetIoScanPVT(IP330_SYNC_ID psync)
+{
+    if(!psync)
+    {
+        errlogPrintf("ip330SyncGetIoScanPVT: card is not synchronized!\n");
+        return NULL;
+    }
+    return &(psync->ioscan);
+}
+
+/****************************************************************/
+/* One or two lines for ip330 report                            */
+/****************************************************************/
+void ip330SyncReport(IP330_ID pcard)
+{
+    IP330_SYNC * psync = pcard->sync;
+    int loop;
+
+    if(pcard->sync_member)
+    {
+        printf("\tSynchronized as slave %d of master %s\n", pcard->sync_member, psync->member[0]->cardname);
+        return;
+    }
+
+    printf("\tSynchronized as master of");
+    for(loop = 1; loop < psync->nmembers; loop++) printf(" %s", psync->member[loop]->cardname);
+    printf(", tolerance %gus\n", psync->tolerance_ns/1000.0);
+    printf("\t%u combined frames, %lu dropped incomplete, largest skew %gus\n", psync->head, (unsigned long)psync->incomplete, psync->skew_max/1000.0);
+}
@@ -0,0 +1,65 @@
+/****************************************************************/
+/* This file implements the timing histograms of IP330, used to */
+/* see how many cards one CPU can serve, see ip330TimingReport  */
+/****************************************************************/
+#include "drvIP330Lib.h"
+#include "drvIP330Private.h"
+
+/****************************************************************/
+/* Add one sample in ns. Called from ISR, worker and readers    */
+/****************************************************************/
+void ip330HistAdd(IP330_HIST * phist, epicsUInt64 ns)
+{
+    size_t us, old;
+    int bin;
+
+    us = (size_t)(ns / 1000);
+    for(bin = 0; bin < N_IP330_HIST_BINS - 1 && (us >> bin); bin++);
+
+    epicsAtomicIncrSizeT(&(phist->bin[bin]));
+    epicsAtomicIncrSizeT(&(phist->count));
+    epicsAtomicAddSizeT(&(phist->sum_us), us);
+    do
+    {
+        old = epicsAtomicGetSizeT(&(phist->max_us));
+    } while(us > old && epicsAtomicCmpAndSwapSizeT(&(phist->max_us), old, us) != old);
+}
+
+void ip330HistReset(IP330_HIST * phist)
+{
+    int bin;
+
+    for(bin = 0; bin < N_IP330_HIST_BINS; bin++) epicsAtomicSetSizeT(&(phist->bin[bin]), 0);
+    epicsAtomicSetSizeT(&(phist->count), 0);
+    epicsAtomicSetSizeT(&(phist->sum_us), 0);
+    epicsAtomicSetSizeT(&(phist->max_us), 0);
+}
+
+/****************************************************************/
+/* Print count, mean, max and the non-empty bins                */
+/****************************************************************/
+void ip330HistReport(IP330_HIST * phist, const char * title)
+{
+    int bin;
+    size_t count;
+
+    count = phist->count;
+    printf("\t%s: %lu samples", title, (unsigned long)count);
+    if(count == 0)
+    {
+        printf("\n");
+        return;
+    }
+    printf(", mean %luus, max %luus\n", (unsigned long)(phist->sum_us / count), (unsigned long)phist->max_us);
+
+    for(bin = 0; bin < N_IP330_HIST_BINS; bin++)
+    {
+        if(!phist->bin[bin]) continue;
+        if(bin == 0)
+            printf("\t\t       <1us: %lu\n", (unsigned long)phist->bin[bin]);
+        else if(bin == N_IP330_HIST_BINS - 1)
+            printf("\t\t>=%8luus: %lu\n", 1UL << (bin - 1), (unsigned long)phist->bin[bin]);
+        else
+            printf("\t\t<%9luus: %lu\n", 1UL << bin, (unsigned long)phist->bin[bin]);
+    }
+}
@@ -120,6 +120,7 @@ static long init_bi(struct biRecord *pbi)
           ptr = xy2440FindCard(pxip->name);
           if( ptr )
           {
+            pxip->card = ptr;
             if( (pxip->port < 0) || (pxip->port >= MAXPORTS) )
             {
               handleError(pbi, &status, S_xy2440_portError,
@@ -136,7 +137,7 @@ static long init_bi(struct biRecord *pbi)
               xy2440WhichHandler( pxip->name, &handler );
               pxip->intHandler = handler;
               pbi->dpvt        = pxip;
-              status           = xy2440Read(pxip->name, pxip->port, pxip->bit, BIT, &value, 0);
+              status           = xy2440ReadCard(pxip->card, pxip->port, pxip->bit, BIT, &value, 0);
               if( status )
               {
                 handleError(pbi, &status, S_xy2440_readError,
@@ -190,7 +191,7 @@ static long read_bi(struct biRecord *pbi)
   unsigned short value;
 	
   pxip   = (xipIo_t *)pbi->dpvt;
-  status = xy2440Read(pxip->name, pxip->port, pxip->bit, BIT, &value, 0);
+  status = xy2440ReadCard(pxip->card, pxip->port, pxip->bit, BIT, &value, 0);
   if( status )
   {
     handleError(pbi, &status, S_xy2440_readError, "devBiXy2440 (read_bi) error", FALSE);
@@ -237,6 +238,7 @@ static long init_mbbi(struct mbbiRecord *pmbbi)
           ptr = xy2440FindCard(pxip->name);
           if( ptr )
           {
+            pxip->card = ptr;
             if( (pxip->port < 0) || (pxip->port >= MAXPORTS) )
             {
               handleError(pmbbi, &status, S_xy2440_portError,
@@ -253,7 +255,7 @@ static long init_mbbi(struct mbbiRecord *pmbbi)
               xy2440WhichHandler( pxip->name, &handler );
               pxip->intHandler = handler;
               pmbbi->dpvt      = pxip;
-              status           = xy2440Read(pxip->name, pxip->port, pxip->bit, NIBBLE, &value, 0);
+              status           = xy2440ReadCard(pxip->card, pxip->port, pxip->bit, NIBBLE, &value, 0);
               if( status )
               {
                 handleError(pmbbi, &status, S_xy2440_readError,
@@ -307,7 +309,7 @@ static long read_mbbi(struct mbbiRecord	*pmbbi)
   unsigned short value;
 	
   pxip   = (xipIo_t *)pmbbi->dpvt;
-  status = xy2440Read(pxip->name, pxip->port, pxip->bit, NIBBLE, &value, 0);
+  status = xy2440ReadCard(pxip->card, pxip->port, pxip->bit, NIBBLE, &value, 0);
   if( status )
   {
     handleError(pmbbi, &status, S_xy2440_readError, "devMbbiXy2440 (read_mbbi) error", FALSE);
@@ -354,6 +356,7 @@ static long init_mbbiDirect(struct mbbiDirectRecord *pmbbiDirect)
           ptr = xy2440FindCard(pxip->name);
           if( ptr )
           {
+            pxip->card = ptr;
             if( (pxip->port < 0) || (pxip->port >= MAXPORTS) )
             {
               handleError(pmbbiDirect, &status, S_xy2440_portError,
@@ -370,7 +373,7 @@ static long init_mbbiDirect(struct mbbiDirectRecord *pmbbiDirect)
               xy2440WhichHandler( pxip->name, &handler );
               pxip->intHandler  = handler;
               pmbbiDirect->dpvt = pxip;
-              status            = xy2440Read(pxip->name, pxip->port, pxip->bit, WORD, &value, 0);
+              status            = xy2440ReadCard(pxip->card, pxip->port, pxip->bit, WORD, &value, 0);
               if( status )
               {
                 handleError(pmbbiDirect, &status, S_xy2440_readError,
@@ -426,7 +429,7 @@ static long read_mbbiDirect( struct mbbiDirectRecord *pmbbiDirect )
   unsigned short value;
 	
   pxip   = (xipIo_t *)pmbbiDirect->dpvt;
-  status = xy2440Read(pxip->name, pxip->port, pxip->bit, WORD, &value, 0);
+  status = xy2440ReadCard(pxip->card, pxip->port, pxip->bit, WORD, &value, 0);
   if( status )
   {
     handleError(pmbbiDirect, &status, S_xy2440_readError, 
@@ -67,8 +67,10 @@ Copyright (c) 2002 Andy Foster
 
 #include "drvIpac.h"
 #include "drvXy2440.h"
+#include "ipacRegistry.h"
 
 LOCAL struct config2440 *ptrXy2440First = NULL;
+LOCAL const char xy2440RegType[] = "IP440";
 
 #ifndef NO_EPICS
 /* EPICS Driver Support Entry Table */
@@ -137,7 +139,7 @@ int xy2440Report( int interest )
         printf("Port %d:  ", i);
         for( j=0; j<MAXBITS; j++ )
         {
-          xy2440Read( plist->pName, i, j, BIT, &val, 0 );
+          xy2440ReadCard( plist, i, j, BIT, &val, 0 );
           printf("%d ", val);
         }
         printf("\n");
@@ -291,6 +293,12 @@ int xy2440Create( char *pName, unsigned short card, unsigned short slot,
     return S_xy2440_validateFailed;
   }
 
+  if( xy2440FindCard( pName ) || ipacRegFindByLocation( NULL, card, slot ) )
+  {
+    printf("xy2440Create: Duplicate device (%s, %d, %d)\n", pName, card, slot);
+    return S_xy2440_duplicateDevice;
+  }
+
   if( !ptrXy2440First )
   {
     ptrXy2440First = malloc(sizeof(struct config2440));
@@ -301,8 +309,14 @@ int xy2440Create( char *pName, unsigned short card, unsigned short slot,
     }
     else
     {
-      xy2440SetConfig( pName, card, slot, mode, intHandler, usrFunc, vector, event, 
-                       debounce, ptrXy2440First );
+      status = xy2440SetConfig( pName, card, slot, mode, intHandler, usrFunc, vector, event, 
+                                debounce, ptrXy2440First );
+      if( status )
+      {
+        free(ptrXy2440First);
+        ptrXy2440First = NULL;
+        return status;
+      }
 
       /* Configure the new board based on above settings */
       xy2440Config( ptrXy2440First );
@@ -310,16 +324,11 @@ int xy2440Create( char *pName, unsigned short card, unsigned short slot,
   }
   else
   {
-    /* Check for unique card */
+    /* Find the end of the list */
 
     plist = ptrXy2440First;
     while( TRUE )
     {
-      if( !strcmp(plist->pName, pName) || ((plist->card == card) && (plist->slot == slot)) )
-      {
-        printf("xy2440Create: Duplicate device (%s, %d, %d)\n", pName, card, slot);
-        return S_xy2440_duplicateDevice;
-      }
       if( plist->pnext == NULL )
         break;
       else
@@ -336,8 +345,13 @@ int xy2440Create( char *pName, unsigned short card, unsigned short slot,
     }
 
     /* pconfig is the configuration block for our new card */
-    xy2440SetConfig( pName, card, slot, mode, intHandler, usrFunc, vector, event,
-                     debounce, pconfig );
+    status = xy2440SetConfig( pName, card, slot, mode, intHandler, usrFunc, vector, event,
+                              debounce, pconfig );
+    if( status )
+    {
+      free(pconfig);
+      return status;
+    }
 
     /* Update linked-list */
     plist->pnext = pconfig;
@@ -349,7 +363,7 @@ int xy2440Create( char *pName, unsigned short card, unsigned short slot,
 }
 
 
-void xy2440SetConfig( char *pName, unsigned short card, unsigned short slot,
+int xy2440SetConfig( char *pName, unsigned short card, unsigned short slot,
                       unsigned char mode,
                       unsigned char intHandler, char *usrFunc,
                       unsigned short vector,
@@ -360,6 +374,14 @@ void xy2440SetConfig( char *pName, unsigned short card, unsigned short slot,
   pconfig->pName      = pName;
   pconfig->card       = card;
   pconfig->slot       = slot;
+
+  /* Register for constant-time lookup by name and location */
+  if( ipacRegAdd( xy2440RegType, pName, card, slot, pconfig ) )
+  {
+    printf("xy2440SetConfig: Failed to register device (%s, %d, %d)\n", pName, card, slot);
+    return S_xy2440_duplicateDevice;
+  }
+
   pconfig->brd_ptr    = (struct map2440 *)ipmBaseAddr(card, slot, ipac_addrIO);
   pconfig->mask_reg   = OUTPUT_MASK;  /* Mask writes to all outputs */
   pconfig->e_mode     = mode;
@@ -513,6 +535,21 @@ long xy2440Read( char *name, short port, short bit, int readFlag,
                       unsigned short *pval, int debug )
 {
   struct config2440 *plist;
+
+  plist = xy2440FindCard(name);
+  if( !plist )
+  {
+    printf("xy2440Read: Card %s not found\n", name);
+    return S_xy2440_cardNotFound;
+  }
+  return xy2440ReadCard( plist, port, bit, readFlag, pval, debug );
+}
+
+
+long xy2440ReadCard( void *ptr, short port, short bit, int readFlag,
+                     unsigned short *pval, int debug )
+{
+  struct config2440 *plist;
   struct map2440    *map_ptr;
   unsigned char     port0;
   unsigned char     port1;
@@ -521,70 +558,68 @@ long xy2440Read( char *name, short port, short bit, int readFlag,
   unsigned int      res;
   int               shift;
 
+  plist = (struct config2440 *)ptr;
+  if( !plist )
+  {
+    printf("xy2440ReadCard: NULL card handle\n");
+    return S_xy2440_cardNotFound;
+  }
+
   if( (port < 0) || (port >= MAXPORTS) )
   {
-    printf("xy2440Read: %s: port number out of range %d\n", name, port );
+    printf("xy2440Read: %s: port number out of range %d\n", plist->pName, port );
     return S_xy2440_portError;
   }
   else if( (bit < 0) || (bit >= MAXBITS) )
   {
-    printf("xy2440Read: %s: bit number out of range %d\n", name, bit );
+    printf("xy2440Read: %s: bit number out of range %d\n", plist->pName, bit );
     return S_xy2440_bitError;
   }
   else
   {
-    plist = xy2440FindCard(name);
-    if( plist )
+    xy2440SelectBank(BANK0, plist);      /* select I/O bank */
+    map_ptr = plist->brd_ptr;
+    if( readFlag == BIT || readFlag == PORT )
     {
-      xy2440SelectBank(BANK0, plist);      /* select I/O bank */
-      map_ptr = plist->brd_ptr;
-      if( readFlag == BIT || readFlag == PORT )
+      *pval = xy2440Input((unsigned *)&map_ptr->port[port].b_select);
+      if( readFlag == BIT )
       {
-        *pval = xy2440Input((unsigned *)&map_ptr->port[port].b_select);
-        if( readFlag == BIT )
-        {
-          if( *pval & (1 << bit) )
-            *pval = 1;
-          else 
-            *pval = 0;
-        }
-
-        if( debug )
-          printf("xy2440Read: name = %s, port = %d, bit = %d, pval = %d\n", 
-                  name, port, bit, *pval);
+        if( *pval & (1 << bit) )
+          *pval = 1;
+        else 
+          *pval = 0;
       }
-      else if( readFlag == NIBBLE || readFlag == WORD )
-      {
-        port0 = xy2440Input((unsigned *)&map_ptr->port[0].b_select);
-        port1 = xy2440Input((unsigned *)&map_ptr->port[1].b_select);
-        port2 = xy2440Input((unsigned *)&map_ptr->port[2].b_select);
-        port3 = xy2440Input((unsigned *)&map_ptr->port[3].b_select);
 
-        /* Combine into a 32-bit integer */
-        res   = (port3<<24) + (port2<<16) + (port1<<8) + port0;
+      if( debug )
+        printf("xy2440Read: name = %s, port = %d, bit = %d, pval = %d\n", 
+                plist->pName, port, bit, *pval);
+    }
+    else if( readFlag == NIBBLE || readFlag == WORD )
+    {
+      port0 = xy2440Input((unsigned *)&map_ptr->port[0].b_select);
+      port1 = xy2440Input((unsigned *)&map_ptr->port[1].b_select);
+      port2 = xy2440Input((unsigned *)&map_ptr->port[2].b_select);
+      port3 = xy2440Input((unsigned *)&map_ptr->port[3].b_select);
+
+      /* Combine into a 32-bit integer */
+      res   = (port3<<24) + (port2<<16) + (port1<<8) + port0;
 
-        /* Calculate position in integer where we want to be */
-        shift = port*MAXBITS + bit;
+      /* Calculate position in integer where we want to be */
+      shift = port*MAXBITS + bit;
 
-        if( readFlag == NIBBLE )
-          *pval = (res >> shift) & 0xF;
-        else if( readFlag == WORD )
-          *pval = (res >> shift) & 0xFFFF;
+      if( readFlag == NIBBLE )
+        *pval = (res >> shift) & 0xF;
+      else if( readFlag == WORD )
+        *pval = (res >> shift) & 0xFFFF;
 
-        if( debug )
-          printf("xy2440Read: name = %s, port = %d, bit = %d, pval = %d\n", 
-                  name, port, bit, *pval);
-      }
-      else
-      {
-        printf("xy2440Read: %s: Data flag error (%d)\n", name, readFlag );
-        return S_xy2440_dataFlagError;
-      }
+      if( debug )
+        printf("xy2440Read: name = %s, port = %d, bit = %d, pval = %d\n", 
+                plist->pName, port, bit, *pval);
     }
     else
     {
-      printf("xy2440Read: Card %s not found\n", name);
-      return S_xy2440_cardNotFound;
+      printf("xy2440Read: %s: Data flag error (%d)\n", plist->pName, readFlag );
+      return S_xy2440_dataFlagError;
     }
   }
   return(OK);
@@ -869,24 +904,7 @@ void xy2440WhichHandler( char *name, unsigned char *handler )
 
 void *xy2440FindCard( char *name )
 {
-  struct config2440 *plist;
-  int               foundCard = 0;
-
-  plist = ptrXy2440First;
-  while( plist )
-  {
-    if( !strcmp(plist->pName, name) )
-    {
-      foundCard = 1;
-      break;
-    }
-    plist = plist->pnext;
-  }
-
-  if( !foundCard )
-    return NULL;
-  else
-    return plist;
+  return ipacRegFindByName( xy2440RegType, name );
 }
 
 
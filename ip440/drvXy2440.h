@@ -165,7 +165,7 @@ int           xy2440Create( char *pName, unsigned short card, unsigned short slo
                             char *modeName,
                             char *intHandlerName, char *usrFunc, short vector, 
                             short event, short debounce );
-void          xy2440SetConfig( char *pName, unsigned short card, unsigned short slot,
+int           xy2440SetConfig( char *pName, unsigned short card, unsigned short slot,
                                unsigned char mode,
                                unsigned char intHandler, char *usrFunc,
                                unsigned short vector, 
@@ -175,6 +175,8 @@ void          xy2440Config( struct config2440 *pconfig );
 unsigned char xy2440SelectBank( unsigned char newBank, struct config2440 *pconfig );
 long          xy2440Read( char *name, short port, short bit, int readFlag,
                           unsigned short *pval, int debug );
+long          xy2440ReadCard( void *ptr, short port, short bit, int readFlag,
+                              unsigned short *pval, int debug );
 unsigned char xy2440Input( unsigned int *addr );
 void          xy2440Output( unsigned int *addr, int b );
 void          xy2440COS( struct config2440 *pconfig );
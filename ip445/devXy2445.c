@@ -118,6 +118,7 @@ static long init_bo(struct boRecord *pbo)
           ptr = xy2445FindCard(pxip->name);
           if( ptr )
           {
+            pxip->card = ptr;
             if( (pxip->port < 0) || (pxip->port >= MAXPORTS) )
             {
               handleError(pbo, &status, S_xy2445_portError,
@@ -131,7 +132,7 @@ static long init_bo(struct boRecord *pbo)
             else
             {
               pbo->dpvt = pxip;
-              status    = xy2445Read( pxip->name, pxip->port, pxip->bit, BIT, &value, debug );
+              status    = xy2445ReadCard( pxip->card, pxip->port, pxip->bit, BIT, &value, debug );
               if( status )
               {
                 handleError(pbo, &status, S_xy2445_readError,
@@ -170,7 +171,7 @@ static long write_bo(struct boRecord *pbo)
   int            debug = DEBUG;
 
   pxip   = (xipIo_t *)pbo->dpvt;
-  status = xy2445Write( pxip->name, pxip->port, pxip->bit, BIT, pbo->rval, debug );
+  status = xy2445WriteCard( pxip->card, pxip->port, pxip->bit, BIT, pbo->rval, debug );
   if( status )
   {
     handleError(pbo, &status, S_xy2445_writeError, "devBoXy2445 (write_bo) error", FALSE);
@@ -178,7 +179,7 @@ static long write_bo(struct boRecord *pbo)
   }
   else
   {
-    status = xy2445Read( pxip->name, pxip->port, pxip->bit, BIT, &value, debug );
+    status = xy2445ReadCard( pxip->card, pxip->port, pxip->bit, BIT, &value, debug );
     if( status )
     {
       handleError(pbo, &status, S_xy2445_readError, "devBoXy2445 (write_bo) error", FALSE);
@@ -222,6 +223,7 @@ static long init_mbbo(struct mbboRecord *pmbbo)
           ptr = xy2445FindCard(pxip->name);
           if( ptr )
           {
+            pxip->card = ptr;
             if( (pxip->port < 0) || (pxip->port >= MAXPORTS) )
             {
               handleError(pmbbo, &status, S_xy2445_portError,
@@ -235,7 +237,7 @@ static long init_mbbo(struct mbboRecord *pmbbo)
             else
             {
               pmbbo->dpvt = pxip;
-              status      = xy2445Read( pxip->name, pxip->port, pxip->bit, NIBBLE, &value, debug );
+              status      = xy2445ReadCard( pxip->card, pxip->port, pxip->bit, NIBBLE, &value, debug );
               if( status )
               {
                 handleError(pmbbo, &status, S_xy2445_readError,
@@ -274,7 +276,7 @@ static long write_mbbo(struct mbboRecord *pmbbo)
   int            debug = DEBUG;
 
   pxip   = (xipIo_t *)pmbbo->dpvt;
-  status = xy2445Write( pxip->name, pxip->port, pxip->bit, NIBBLE, (pmbbo->rval & pmbbo->mask),
+  status = xy2445WriteCard( pxip->card, pxip->port, pxip->bit, NIBBLE, (pmbbo->rval & pmbbo->mask),
                         debug );
   if( status )
   {
@@ -283,7 +285,7 @@ static long write_mbbo(struct mbboRecord *pmbbo)
   }
   else
   {
-    status = xy2445Read( pxip->name, pxip->port, pxip->bit, NIBBLE, &value, debug );
+    status = xy2445ReadCard( pxip->card, pxip->port, pxip->bit, NIBBLE, &value, debug );
     if( status )
     {
       handleError(pmbbo, &status, S_xy2445_readError, 
@@ -328,6 +330,7 @@ static long init_mbboDirect(struct mbboDirectRecord *pmbboDirect)
           ptr = xy2445FindCard(pxip->name);
           if( ptr )
           {
+            pxip->card = ptr;
             if( (pxip->port < 0) || (pxip->port >= MAXPORTS) )
             {
               handleError(pmbboDirect, &status, S_xy2445_portError,
@@ -341,7 +344,7 @@ static long init_mbboDirect(struct mbboDirectRecord *pmbboDirect)
             else
             {
               pmbboDirect->dpvt = pxip;
-              status            = xy2445Read( pxip->name, pxip->port, pxip->bit, WORD, &value, debug );
+              status            = xy2445ReadCard( pxip->card, pxip->port, pxip->bit, WORD, &value, debug );
               if( status )
               {
                 handleError(pmbboDirect, &status, S_xy2445_readError,
@@ -385,7 +388,7 @@ static long write_mbboDirect(struct mbboDirectRecord *pmbboDirect)
   int             debug = DEBUG;
 
   pxip   = (xipIo_t *)pmbboDirect->dpvt;
-  status = xy2445Write( pxip->name, pxip->port, pxip->bit, WORD, 
+  status = xy2445WriteCard( pxip->card, pxip->port, pxip->bit, WORD, 
                         (pmbboDirect->rval & pmbboDirect->mask), debug );
   if( status )
   {
@@ -395,7 +398,7 @@ static long write_mbboDirect(struct mbboDirectRecord *pmbboDirect)
   }
   else
   {
-    status = xy2445Read( pxip->name, pxip->port, pxip->bit, WORD, &value, debug );
+    status = xy2445ReadCard( pxip->card, pxip->port, pxip->bit, WORD, &value, debug );
     if( status )
     {
       handleError(pmbboDirect, &status, S_xy2445_readError, 
@@ -36,6 +36,7 @@ Copyright (c) 2002 Andy Foster
 
 #ifdef NO_EPICS
 #include <vxWorks.h>
+#include <intLib.h>
 #endif
 #include <stdio.h>
 #include <stdlib.h>
@@ -49,12 +50,24 @@ Copyright (c) 2002 Andy Foster
 
 #include "drvIpac.h"
 #include "drvXy2445.h"
+#include "ipacRegistry.h"
+
+/* Output read-modify-writes may come from an ISR too (ip330 interlock) */
+#ifdef NO_EPICS
+#define xy2445LockOut()          intLock()
+#define xy2445UnlockOut(key)     intUnlock(key)
+#else
+#define xy2445LockOut()          epicsInterruptLock()
+#define xy2445UnlockOut(key)     epicsInterruptUnlock(key)
+#endif
 
 #ifndef NO_EPICS
 #include "devLib.h"
 #include "drvSup.h"
 #include "epicsExport.h"
+#include "epicsInterrupt.h"
 #include "iocsh.h"
+#include "registryFunction.h"
 
 /* EPICS Driver Support Entry Table */
 
@@ -67,6 +80,7 @@ epicsExportAddress(drvet, drvXy2445);
 #endif
 
 LOCAL struct config2445 *ptrXy2445First = NULL;
+LOCAL const char xy2445RegType[] = "IP445";
 
 int xy2445Report( int interest )
 {
@@ -112,7 +126,7 @@ int xy2445Report( int interest )
         printf("Port %d:  ", i);
         for( j=0; j<MAXBITS; j++ )
         {
-          xy2445Read( plist->pName, i, j, BIT, &val, 0 );
+          xy2445ReadCard( plist, i, j, BIT, &val, 0 );
           printf("%d ", val);
         }
         printf("\n");
@@ -144,6 +158,12 @@ int xy2445Create( char *pName, unsigned short card, unsigned short slot )
     return S_xy2445_validateFailed;
   }
 
+  if( xy2445FindCard( pName ) || ipacRegFindByLocation( NULL, card, slot ) )
+  {
+    printf("xy2445Create: Duplicate device (%s, %d, %d)\n", pName, card, slot);
+    return S_xy2445_duplicateDevice;
+  }
+
   if( !ptrXy2445First )
   {
     ptrXy2445First = malloc(sizeof(struct config2445));
@@ -153,20 +173,23 @@ int xy2445Create( char *pName, unsigned short card, unsigned short slot )
       return S_xy2445_mallocFailed;
     }
     else
-      xy2445SetConfig( pName, card, slot, ptrXy2445First );
+    {
+      status = xy2445SetConfig( pName, card, slot, ptrXy2445First );
+      if( status )
+      {
+        free(ptrXy2445First);
+        ptrXy2445First = NULL;
+        return status;
+      }
+    }
   }
   else
   {
-    /* Check for unique card */
+    /* Find the end of the list */
 
     plist = ptrXy2445First;
     while( TRUE )
     {
-      if( !strcmp(plist->pName, pName) || ((plist->card == card) && (plist->slot == slot)) )
-      {
-        printf("xy2445Create: Duplicate device (%s, %d, %d)\n", pName, card, slot);
-        return S_xy2445_duplicateDevice;
-      }
       if( plist->pnext == NULL )
         break;
       else
@@ -183,7 +206,12 @@ int xy2445Create( char *pName, unsigned short card, unsigned short slot )
     }
 
     /* pconfig is the configuration block for our new card */
-    xy2445SetConfig( pName, card, slot, pconfig );
+    status = xy2445SetConfig( pName, card, slot, pconfig );
+    if( status )
+    {
+      free(pconfig);
+      return status;
+    }
 
     /* Update linked-list */
     plist->pnext = pconfig;
@@ -192,17 +220,26 @@ int xy2445Create( char *pName, unsigned short card, unsigned short slot )
 }
 
 
-void xy2445SetConfig( char *pName, unsigned short card, unsigned short slot,
+int xy2445SetConfig( char *pName, unsigned short card, unsigned short slot,
                       struct config2445 *pconfig )
 {
   pconfig->pnext   = NULL;
   pconfig->pName   = pName;
   pconfig->card    = card;
   pconfig->slot    = slot;
+
+  /* Register for constant-time lookup by name and location */
+  if( ipacRegAdd( xy2445RegType, pName, card, slot, pconfig ) )
+  {
+    printf("xy2445SetConfig: Failed to register device (%s, %d, %d)\n", pName, card, slot);
+    return S_xy2445_duplicateDevice;
+  }
+
   pconfig->brd_ptr = (struct map2445 *)ipmBaseAddr(card, slot, ipac_addrIO);
   
   /* Perform a software reset */
   xy2445Output((unsigned *)&pconfig->brd_ptr->cntl_reg, (int)0x01);
+  return(OK);
 }
 
 
@@ -210,6 +247,21 @@ long xy2445Read( char *name, short port, short bit, int readFlag,
                  unsigned short *pval, int debug )
 {
   struct config2445 *plist;
+
+  plist = xy2445FindCard( name );
+  if( !plist )
+  {
+    printf("xy2445Read: Card %s not found\n", name);
+    return S_xy2445_cardNotFound;
+  }
+  return xy2445ReadCard( plist, port, bit, readFlag, pval, debug );
+}
+
+
+long xy2445ReadCard( void *ptr, short port, short bit, int readFlag, 
+                     unsigned short *pval, int debug )
+{
+  struct config2445 *plist;
   struct map2445    *map_ptr;
   unsigned char     port0;
   unsigned char     port1;
@@ -218,65 +270,63 @@ long xy2445Read( char *name, short port, short bit, int readFlag,
   unsigned int      res;
   int               shift;
 
+  plist = (struct config2445 *)ptr;
+  if( !plist )
+  {
+    printf("xy2445ReadCard: NULL card handle\n");
+    return S_xy2445_cardNotFound;
+  }
+
   if( (port < 0) || (port >= MAXPORTS) )
   {
-    printf("xy2445Read: %s: port number out of range %d\n", name, port );
+    printf("xy2445Read: %s: port number out of range %d\n", plist->pName, port );
     return S_xy2445_portError;
   }
   else if( (bit < 0) || (bit >= MAXBITS) )
   {
-    printf("xy2445Read: %s: bit number out of range %d\n", name, bit );
+    printf("xy2445Read: %s: bit number out of range %d\n", plist->pName, bit );
     return S_xy2445_bitError;
   }
   else
   {
-    plist = xy2445FindCard( name );
-    if( plist )
+    map_ptr = plist->brd_ptr;
+    if( readFlag == BIT || readFlag == PORT )
     {
-      map_ptr = plist->brd_ptr;
-      if( readFlag == BIT || readFlag == PORT )
-      {
-        *pval = xy2445Input((unsigned *)&map_ptr->io_map[port].io_port);
-        if( readFlag == BIT )
-        {
-          if( *pval & (1 << bit) )
-            *pval = 1;
-          else
-            *pval = 0;
-        }
-      }
-      else
+      *pval = xy2445Input((unsigned *)&map_ptr->io_map[port].io_port);
+      if( readFlag == BIT )
       {
-        port0 = xy2445Input((unsigned *)&map_ptr->io_map[0].io_port);
-        port1 = xy2445Input((unsigned *)&map_ptr->io_map[1].io_port);
-        port2 = xy2445Input((unsigned *)&map_ptr->io_map[2].io_port);
-        port3 = xy2445Input((unsigned *)&map_ptr->io_map[3].io_port);
-
-        /* Combine into a 32-bit integer */
-        res   = (port3<<24) + (port2<<16) + (port1<<8) + port0;
-
-        /* Calculate position in integer where we want to be */
-        shift = port*MAXBITS + bit;
-
-        if( readFlag == NIBBLE )
-          *pval = (res >> shift) & 0xF;
-        else if( readFlag == WORD )
-          *pval = (res >> shift) & 0xFFFF;
+        if( *pval & (1 << bit) )
+          *pval = 1;
         else
-        {
-          printf("xy2445Read: %s: Data flag error (%d)\n", name, readFlag );
-          return S_xy2445_readError;
-        }
+          *pval = 0;
       }
-      if( debug )
-        printf("xy2445Read: name = %s, port = %d, bit = %d, readFlag = %d, value = 0x%x\n", 
-                name, port, bit, readFlag, *pval);
     }
     else
     {
-      printf("xy2445Read: Card %s not found\n", name);
-      return S_xy2445_cardNotFound;
+      port0 = xy2445Input((unsigned *)&map_ptr->io_map[0].io_port);
+      port1 = xy2445Input((unsigned *)&map_ptr->io_map[1].io_port);
+      port2 = xy2445Input((unsigned *)&map_ptr->io_map[2].io_port);
+      port3 = xy2445Input((unsigned *)&map_ptr->io_map[3].io_port);
+
+      /* Combine into a 32-bit integer */
+      res   = (port3<<24) + (port2<<16) + (port1<<8) + port0;
+
+      /* Calculate position in integer where we want to be */
+      shift = port*MAXBITS + bit;
+
+      if( readFlag == NIBBLE )
+        *pval = (res >> shift) & 0xF;
+      else if( readFlag == WORD )
+        *pval = (res >> shift) & 0xFFFF;
+      else
+      {
+        printf("xy2445Read: %s: Data flag error (%d)\n", plist->pName, readFlag );
+        return S_xy2445_readError;
+      }
     }
+    if( debug )
+      printf("xy2445Read: name = %s, port = %d, bit = %d, readFlag = %d, value = 0x%x\n", 
+              plist->pName, port, bit, readFlag, *pval);
   }
   return(OK);
 }
@@ -286,6 +336,21 @@ long xy2445Write( char *name, short port, short bit, int writeFlag,
                   long value, int debug )
 {
   struct config2445 *plist;
+
+  plist = xy2445FindCard( name );
+  if( !plist )
+  {
+    printf("xy2445Write: Card %s not found\n", name);
+    return S_xy2445_cardNotFound;
+  }
+  return xy2445WriteCard( plist, port, bit, writeFlag, value, debug );
+}
+
+
+long xy2445WriteCard( void *ptr, short port, short bit, int writeFlag,
+                      long value, int debug )
+{
+  struct config2445 *plist;
   struct map2445    *map_ptr;
   unsigned char     port0;
   unsigned char     port1;
@@ -293,124 +358,128 @@ long xy2445Write( char *name, short port, short bit, int writeFlag,
   unsigned char     port3;
   unsigned char     newport;
   unsigned char     bpos;
-  unsigned int      res;
+  unsigned int      res, oldres;
   unsigned int      zeroOut;
   unsigned short    zeroMask=0;
   int               shift;
+  int               key;
+
+  plist = (struct config2445 *)ptr;
+  if( !plist )
+  {
+    printf("xy2445WriteCard: NULL card handle\n");
+    return S_xy2445_cardNotFound;
+  }
 
   if( (port < 0) || (port >= MAXPORTS) )
   {
-    printf("xy2445Write: %s: port number out of range %d\n", name, port );
+    printf("xy2445Write: %s: port number out of range %d\n", plist->pName, port );
     return S_xy2445_portError;
   }
   else if( (bit < 0) || (bit >= MAXBITS) )
   {
-    printf("xy2445Write: %s: bit number out of range %d\n", name, bit );
+    printf("xy2445Write: %s: bit number out of range %d\n", plist->pName, bit );
     return S_xy2445_bitError;
   }
   else
   {
-    plist = xy2445FindCard( name );
-    if( plist )
+    if( debug )
+      printf("xy2445Write: name = %s, port = %d, bit = %d, writeFlag = %d, value = 0x%lx\n", 
+                           plist->pName, port, bit, writeFlag, value);
+    map_ptr = plist->brd_ptr;
+    if( writeFlag == BIT )
     {
-      if( debug )
-        printf("xy2445Write: name = %s, port = %d, bit = %d, writeFlag = %d, value = 0x%lx\n", 
-                             name, port, bit, writeFlag, value);
-      map_ptr = plist->brd_ptr;
-      if( writeFlag == BIT )
+      if( value < 0x0 || value > 0x1 )
       {
-        if( value < 0x0 || value > 0x1 )
-        {
-          printf("xy2445Write: %s: BIT value out of range = %ld\n", name, value);
-          return S_xy2445_writeError;
-        }
-        else
-        {
-          bpos  = 1 << bit;
-          value = value << bit;
-          xy2445Output( (unsigned *)&map_ptr->io_map[port].io_port, 
-                        (int)((xy2445Input((unsigned *)&map_ptr->io_map[port].io_port) & ~bpos) | value));
-        }
+        printf("xy2445Write: %s: BIT value out of range = %ld\n", plist->pName, value);
+        return S_xy2445_writeError;
       }
-      else if( writeFlag == PORT )
+      else
       {
-        if( value < 0x0 || value > 0xFF )
-        {
-          printf("xy2445Write: %s: PORT value out of range = %ld\n", name, value);
-          return S_xy2445_writeError;
-        }
-        else
-          xy2445Output( (unsigned *)&map_ptr->io_map[port].io_port, (int)value );
+        bpos  = 1 << bit;
+        value = value << bit;
+        key = xy2445LockOut();
+        xy2445Output( (unsigned *)&map_ptr->io_map[port].io_port, 
+                      (int)((xy2445Input((unsigned *)&map_ptr->io_map[port].io_port) & ~bpos) | value));
+        xy2445UnlockOut(key);
       }
-      else if( writeFlag == NIBBLE || writeFlag == WORD )
+    }
+    else if( writeFlag == PORT )
+    {
+      if( value < 0x0 || value > 0xFF )
       {
-        if( (writeFlag == NIBBLE) && (value < 0x0 || value > 0xF) )
-        {
-          printf("xy2445Write: %s: NIBBLE value out of range = %ld\n", name, value);
-          return S_xy2445_writeError;
-        }
-        else if( (writeFlag == WORD) && (value < 0x0 || value > 0xFFFF) )
-        {
-          printf("xy2445Write: %s: WORD value out of range = %ld\n", name, value);
-          return S_xy2445_writeError;
-        }
-        else
-        {
-          /* Read all ports */
-          port0 = xy2445Input((unsigned *)&map_ptr->io_map[0].io_port);
-          port1 = xy2445Input((unsigned *)&map_ptr->io_map[1].io_port);
-          port2 = xy2445Input((unsigned *)&map_ptr->io_map[2].io_port);
-          port3 = xy2445Input((unsigned *)&map_ptr->io_map[3].io_port);
-
-          /* Combine into a 32-bit unsigned integer */
-          res = (port3<<24) + (port2<<16) + (port1<<8) + port0;
-
-          shift  = port*MAXBITS + bit;
-            
-          /* We need to only change the Nibble/Word of the 32-bits */
-          /* and leave the remaining bits unchanged                */
-          if( writeFlag == NIBBLE )
-            zeroMask = 0xF;
-          else if(  writeFlag == WORD )
-            zeroMask = 0xFFFF;
-
-          /* Zero-out the bits we want to change */
-          zeroOut = 0xFFFFFFFF & ~(zeroMask<<shift);
-
-          /* Current value AND zeroOut will zero-out the bits.   */
-          /* Now OR this with the new bit pattern shifted by the */
-          /* appropriate amount                                  */
-
-          if( debug )
-            printf("xy2445Write:  res (old) = 0x%x, zeroOut = 0x%x, value = 0x%lx, shift = %d\n", 
-                                  res, zeroOut, value, shift);
-
-          res = (res & zeroOut) | (value<<shift);
-
-          if( debug )
-            printf("xy2445Write:  res (new) = 0x%x\n", res);
-
-          /* Write new port values */
-          newport = res & 0xFF;
-          xy2445Output((unsigned *)&map_ptr->io_map[0].io_port, newport);
-          newport = (res>>8) & 0xFF;
-          xy2445Output((unsigned *)&map_ptr->io_map[1].io_port, newport);
-          newport = (res>>16) & 0xFF;
-          xy2445Output((unsigned *)&map_ptr->io_map[2].io_port, newport);
-          newport = (res>>24) & 0xFF;
-          xy2445Output((unsigned *)&map_ptr->io_map[3].io_port, newport);
-        }
+        printf("xy2445Write: %s: PORT value out of range = %ld\n", plist->pName, value);
+        return S_xy2445_writeError;
+      }
+      else
+        xy2445Output( (unsigned *)&map_ptr->io_map[port].io_port, (int)value );
+    }
+    else if( writeFlag == NIBBLE || writeFlag == WORD )
+    {
+      if( (writeFlag == NIBBLE) && (value < 0x0 || value > 0xF) )
+      {
+        printf("xy2445Write: %s: NIBBLE value out of range = %ld\n", plist->pName, value);
+        return S_xy2445_writeError;
+      }
+      else if( (writeFlag == WORD) && (value < 0x0 || value > 0xFFFF) )
+      {
+        printf("xy2445Write: %s: WORD value out of range = %ld\n", plist->pName, value);
+        return S_xy2445_writeError;
       }
       else
       {
-        printf("xy2445Write: %s: Data flag error (%d)\n", name, writeFlag );
-        return S_xy2445_dataFlagError;
+        shift  = port*MAXBITS + bit;
+          
+        /* We need to only change the Nibble/Word of the 32-bits */
+        /* and leave the remaining bits unchanged                */
+        if( writeFlag == NIBBLE )
+          zeroMask = 0xF;
+        else if(  writeFlag == WORD )
+          zeroMask = 0xFFFF;
+
+        /* Zero-out the bits we want to change */
+        zeroOut = 0xFFFFFFFF & ~(zeroMask<<shift);
+
+        key = xy2445LockOut();
+
+        /* Read all ports */
+        port0 = xy2445Input((unsigned *)&map_ptr->io_map[0].io_port);
+        port1 = xy2445Input((unsigned *)&map_ptr->io_map[1].io_port);
+        port2 = xy2445Input((unsigned *)&map_ptr->io_map[2].io_port);
+        port3 = xy2445Input((unsigned *)&map_ptr->io_map[3].io_port);
+
+        /* Combine into a 32-bit unsigned integer */
+        oldres = (port3<<24) + (port2<<16) + (port1<<8) + port0;
+
+        /* Current value AND zeroOut will zero-out the bits.   */
+        /* Now OR this with the new bit pattern shifted by the */
+        /* appropriate amount                                  */
+        res = (oldres & zeroOut) | (value<<shift);
+
+        /* Write new port values */
+        newport = res & 0xFF;
+        xy2445Output((unsigned *)&map_ptr->io_map[0].io_port, newport);
+        newport = (res>>8) & 0xFF;
+        xy2445Output((unsigned *)&map_ptr->io_map[1].io_port, newport);
+        newport = (res>>16) & 0xFF;
+        xy2445Output((unsigned *)&map_ptr->io_map[2].io_port, newport);
+        newport = (res>>24) & 0xFF;
+        xy2445Output((unsigned *)&map_ptr->io_map[3].io_port, newport);
+
+        xy2445UnlockOut(key);
+
+        if( debug )
+        {
+          printf("xy2445Write:  res (old) = 0x%x, zeroOut = 0x%x, value = 0x%lx, shift = %d\n", 
+                                oldres, zeroOut, value, shift);
+          printf("xy2445Write:  res (new) = 0x%x\n", res);
+        }
       }
     }
     else
     {
-      printf("xy2445Write: Card %s not found\n", name);
-      return S_xy2445_cardNotFound;
+      printf("xy2445Write: %s: Data flag error (%d)\n", plist->pName, writeFlag );
+      return S_xy2445_dataFlagError;
     }
   }
   return(OK);
@@ -419,24 +488,7 @@ long xy2445Write( char *name, short port, short bit, int writeFlag,
 
 void *xy2445FindCard( char *name )
 {
-  struct config2445 *plist;
-  int               foundCard = 0;
-
-  plist = ptrXy2445First;
-  while( plist )
-  {
-    if( !strcmp(plist->pName, name) )
-    {
-      foundCard = 1;
-      break;
-    }
-    plist = plist->pnext;
-  }
-
-  if( !foundCard )
-    return NULL;
-  else
-    return plist;
+  return ipacRegFindByName( xy2445RegType, name );
 }
 
 
@@ -486,6 +538,9 @@ static void xy2445CreateCallFunc(const iocshArgBuf *arg)
 LOCAL void drvXy2445Registrar(void) {
     iocshRegister(&xy2445ReportFuncDef,xy2445ReportCallFunc);
     iocshRegister(&xy2445CreateFuncDef,xy2445CreateCallFunc);
+    /* Lets other drivers (ip330InterlockOutput) write without linking to us */
+    registryFunctionAdd("xy2445FindCard",(REGISTRYFUNCTION)xy2445FindCard);
+    registryFunctionAdd("xy2445WriteCard",(REGISTRYFUNCTION)xy2445WriteCard);
 }
 epicsExportRegistrar(drvXy2445Registrar);
 
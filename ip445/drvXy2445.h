@@ -93,13 +93,17 @@ int           xy2445Report( int interest );
 int           xy2445Initialise( void );
 int           xy2445Create( char *pName, unsigned short card,
                             unsigned short slot );
-void          xy2445SetConfig( char *pName, unsigned short card,
+int           xy2445SetConfig( char *pName, unsigned short card,
                                unsigned short slot,
                                struct config2445 *pconfig );
 long          xy2445Read( char *name, short port, short bit, int readFlag,
                           unsigned short *pval, int debug );
+long          xy2445ReadCard( void *ptr, short port, short bit, int readFlag,
+                              unsigned short *pval, int debug );
 long          xy2445Write( char *name, short port, short bit, int writeFlag,
                            long value, int debug );
+long          xy2445WriteCard( void *ptr, short port, short bit, int writeFlag,
+                               long value, int debug );
 void          *xy2445FindCard( char *name );
 unsigned char xy2445Input( unsigned *addr );
 void          xy2445Output( unsigned *addr, int b );
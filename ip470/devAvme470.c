@@ -140,6 +140,7 @@ static long init_bi(struct biRecord *pbi)
           ptr = avme470FindCard(pxip->name);
           if( ptr )
           {
+            pxip->card = ptr;
             if( (pxip->port < 0) || (pxip->port >= MAXPORTS) )
             {
               handleError(pbi, &status, S_avme470_portError,
@@ -156,7 +157,7 @@ static long init_bi(struct biRecord *pbi)
               avme470WhichHandler( pxip->name, &handler );
               pxip->intHandler = handler;
               pbi->dpvt        = pxip;
-              status           = avme470Read(pxip->name, pxip->port, pxip->bit, BIT, &value, 0);
+              status           = avme470ReadCard(pxip->card, pxip->port, pxip->bit, BIT, &value, 0);
               if( status )
               {
                 handleError(pbi, &status, S_avme470_readError,
@@ -210,7 +211,7 @@ static long read_bi(struct biRecord *pbi)
   unsigned short value;
 	
   pxip   = (xipIo_t *)pbi->dpvt;
-  status = avme470Read(pxip->name, pxip->port, pxip->bit, BIT, &value, 0);
+  status = avme470ReadCard(pxip->card, pxip->port, pxip->bit, BIT, &value, 0);
   if( status )
   {
     handleError(pbi, &status, S_avme470_readError, "devBiAvme470 (read_bi) error", FALSE);
@@ -256,6 +257,7 @@ static long init_bo(struct boRecord *pbo)
           ptr = avme470FindCard(pxip->name);
           if( ptr )
           {
+            pxip->card = ptr;
             if( (pxip->port < 0) || (pxip->port >= MAXPORTS) )
             {
               handleError(pbo, &status, S_avme470_portError,
@@ -269,7 +271,7 @@ static long init_bo(struct boRecord *pbo)
             else
             {
               pbo->dpvt        = pxip;
-              status           = avme470Read(pxip->name, pxip->port, pxip->bit, BIT, &value, 0);
+              status           = avme470ReadCard(pxip->card, pxip->port, pxip->bit, BIT, &value, 0);
               if( status )
               {
                 handleError(pbo, &status, S_avme470_readError,
@@ -308,7 +310,7 @@ static long write_bo(struct boRecord *pbo)
   int		 debug = DEBUG;
 
   pxip   = (xipIo_t *)pbo->dpvt;
-  status = avme470Write( pxip->name, pxip->port, pxip->bit, BIT, pbo->rval, 1, debug );
+  status = avme470WriteCard( pxip->card, pxip->port, pxip->bit, BIT, pbo->rval, 1, debug );
   if( status )
   {
     handleError(pbo, &status, S_avme470_writeError, "devBoAvme470 (write_bo) error", FALSE);
@@ -316,7 +318,7 @@ static long write_bo(struct boRecord *pbo)
   }
   else
   {
-    status = avme470Read( pxip->name, pxip->port, pxip->bit, BIT, &value, debug );
+    status = avme470ReadCard( pxip->card, pxip->port, pxip->bit, BIT, &value, debug );
     if( status )
     {
       handleError(pbo, &status, S_avme470_readError, "devBoAvme470 (write_bo) error", FALSE);
@@ -360,6 +362,7 @@ static long init_mbbo(struct mbboRecord *pmbbo)
           ptr = avme470FindCard(pxip->name);
           if( ptr )
           {
+            pxip->card = ptr;
             if( (pxip->port < 0) || (pxip->port >= MAXPORTS) )
             {
               handleError(pmbbo, &status, S_avme470_portError,
@@ -373,7 +376,7 @@ static long init_mbbo(struct mbboRecord *pmbbo)
             else
             {
               pmbbo->dpvt = pxip;
-              status      = avme470Read( pxip->name, pxip->port, pxip->bit, NIBBLE, &value, debug );
+              status      = avme470ReadCard( pxip->card, pxip->port, pxip->bit, NIBBLE, &value, debug );
               if( status )
               {
                 handleError(pmbbo, &status, S_avme470_readError,
@@ -413,7 +416,7 @@ static long write_mbbo(struct mbboRecord *pmbbo)
   int            debug = DEBUG;
 
   pxip   = (xipIo_t *)pmbbo->dpvt;
-  status = avme470Write( pxip->name, pxip->port, pxip->bit, NIBBLE, (pmbbo->rval
+  status = avme470WriteCard( pxip->card, pxip->port, pxip->bit, NIBBLE, (pmbbo->rval
 & pmbbo->mask), 4, debug );
   if( status )
   {
@@ -422,7 +425,7 @@ static long write_mbbo(struct mbboRecord *pmbbo)
   }
   else
   {
-    status = avme470Read( pxip->name, pxip->port, pxip->bit, NIBBLE, &value, debug );
+    status = avme470ReadCard( pxip->card, pxip->port, pxip->bit, NIBBLE, &value, debug );
     if( status )
     {
       handleError(pmbbo, &status, S_avme470_readError,
@@ -467,6 +470,7 @@ static long init_mbboDirect(struct mbboDirectRecord *pmbboDirect)
           ptr = avme470FindCard(pxip->name);
           if( ptr )
           {
+            pxip->card = ptr;
             if( (pxip->port < 0) || (pxip->port >= MAXPORTS) )
             {
               handleError(pmbboDirect, &status, S_avme470_portError,
@@ -480,7 +484,7 @@ static long init_mbboDirect(struct mbboDirectRecord *pmbboDirect)
             else
             {
               pmbboDirect->dpvt = pxip;
-              status            = avme470Read( pxip->name, pxip->port, pxip->bit, WORD, &value, debug );
+              status            = avme470ReadCard( pxip->card, pxip->port, pxip->bit, WORD, &value, debug );
               if( status )
               {
                 handleError(pmbboDirect, &status, S_avme470_readError,
@@ -524,7 +528,7 @@ static long write_mbboDirect(struct mbboDirectRecord *pmbboDirect)
   int             debug = DEBUG;
 
   pxip   = (xipIo_t *)pmbboDirect->dpvt;
-  status = avme470Write( pxip->name, pxip->port, pxip->bit, WORD,
+  status = avme470WriteCard( pxip->card, pxip->port, pxip->bit, WORD,
                         (pmbboDirect->rval & pmbboDirect->mask), 
                         pmbboDirect->nobt, debug );
   if( status )
@@ -535,7 +539,7 @@ static long write_mbboDirect(struct mbboDirectRecord *pmbboDirect)
   }
   else
   {
-    status = avme470Read( pxip->name, pxip->port, pxip->bit, WORD, &value, debug );
+    status = avme470ReadCard( pxip->card, pxip->port, pxip->bit, WORD, &value, debug );
     if( status )
     {
       handleError(pmbboDirect, &status, S_avme470_readError,
@@ -580,6 +584,7 @@ static long init_mbbi(struct mbbiRecord *pmbbi)
           ptr = avme470FindCard(pxip->name);
           if( ptr )
           {
+            pxip->card = ptr;
             if( (pxip->port < 0) || (pxip->port >= MAXPORTS) )
             {
               handleError(pmbbi, &status, S_avme470_portError,
@@ -596,7 +601,7 @@ static long init_mbbi(struct mbbiRecord *pmbbi)
               avme470WhichHandler( pxip->name, &handler );
               pxip->intHandler = handler;
               pmbbi->dpvt      = pxip;
-              status           = avme470Read(pxip->name, pxip->port, pxip->bit, NIBBLE, &value, 0);
+              status           = avme470ReadCard(pxip->card, pxip->port, pxip->bit, NIBBLE, &value, 0);
               if( status )
               {
                 handleError(pmbbi, &status, S_avme470_readError,
@@ -650,7 +655,7 @@ static long read_mbbi(struct mbbiRecord	*pmbbi)
   unsigned short value;
 	
   pxip   = (xipIo_t *)pmbbi->dpvt;
-  status = avme470Read(pxip->name, pxip->port, pxip->bit, NIBBLE, &value, 0);
+  status = avme470ReadCard(pxip->card, pxip->port, pxip->bit, NIBBLE, &value, 0);
   if( status )
   {
     handleError(pmbbi, &status, S_avme470_readError, "devMbbiAvme470 (read_mbbi) error", FALSE);
@@ -697,6 +702,7 @@ static long init_mbbiDirect(struct mbbiDirectRecord *pmbbiDirect)
           ptr = avme470FindCard(pxip->name);
           if( ptr )
           {
+            pxip->card = ptr;
             if( (pxip->port < 0) || (pxip->port >= MAXPORTS) )
             {
               handleError(pmbbiDirect, &status, S_avme470_portError,
@@ -713,7 +719,7 @@ static long init_mbbiDirect(struct mbbiDirectRecord *pmbbiDirect)
               avme470WhichHandler( pxip->name, &handler );
               pxip->intHandler  = handler;
               pmbbiDirect->dpvt = pxip;
-              status            = avme470Read(pxip->name, pxip->port, pxip->bit, WORD, &value, 0);
+              status            = avme470ReadCard(pxip->card, pxip->port, pxip->bit, WORD, &value, 0);
               if( status )
               {
                 handleError(pmbbiDirect, &status, S_avme470_readError,
@@ -769,7 +775,7 @@ static long read_mbbiDirect( struct mbbiDirectRecord *pmbbiDirect )
   unsigned short value;
 	
   pxip   = (xipIo_t *)pmbbiDirect->dpvt;
-  status = avme470Read(pxip->name, pxip->port, pxip->bit, WORD, &value, 0);
+  status = avme470ReadCard(pxip->card, pxip->port, pxip->bit, WORD, &value, 0);
   if( status )
   {
     handleError(pmbbiDirect, &status, S_avme470_readError, 
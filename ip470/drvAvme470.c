@@ -119,6 +119,7 @@ Allison, Stephanie wrote:
 #define OUTPUT_MASK           0x3F   /* Mask writes to all outputs */
 
 static struct config470 *ptrAvme470First = NULL;
+static const char avme470RegType[] = "IP470";
 
 #ifndef NO_EPICS
 #include "devLib.h"
@@ -127,13 +128,24 @@ static struct config470 *ptrAvme470First = NULL;
 #include "epicsInterrupt.h"
 #include "epicsExport.h"
 #include "iocsh.h"
+#include "registryFunction.h"
 #endif
 
 #include "drvIpac.h"
 #include "drvAvme470.h"
+#include "ipacRegistry.h"
 
 #include "basicIoOps.h"
 
+/* Output read-modify-writes may come from an ISR too (ip330 interlock) */
+#ifdef NO_EPICS
+#define avme470LockOut()         intLock()
+#define avme470UnlockOut(key)    intUnlock(key)
+#else
+#define avme470LockOut()         epicsInterruptLock()
+#define avme470UnlockOut(key)    epicsInterruptUnlock(key)
+#endif
+
 
 #ifndef NO_EPICS
 /* EPICS Driver Support Entry Table */
@@ -202,7 +214,7 @@ int avme470Report( int interest )
         printf("Port %d:  ", i);
         for( j=0; j<MAXBITS; j++ )
         {
-          avme470Read( plist->pName, i, j, BIT, &val, 0 );
+          avme470ReadCard( plist, i, j, BIT, &val, 0 );
           printf("%d ", val);
         }
         printf("\n");
@@ -358,6 +370,12 @@ int avme470Create( char *pName, unsigned short card, unsigned short slot,
     return S_avme470_validateFailed;
   }
 
+  if( avme470FindCard( pName ) || ipacRegFindByLocation( NULL, card, slot ) )
+  {
+    printf("avme470Create: Duplicate device (%s, %d, %d)\n", pName, card, slot);
+    return S_avme470_duplicateDevice;
+  }
+
   if( !ptrAvme470First )
 
   {
@@ -369,8 +387,14 @@ int avme470Create( char *pName, unsigned short card, unsigned short slot,
     }
     else
     {
-      avme470SetConfig( pName, card, slot, mode, intHandler, usrFunc, vector, event, 
-                       debounce, ptrAvme470First );
+      status = avme470SetConfig( pName, card, slot, mode, intHandler, usrFunc, vector, event, 
+                                 debounce, ptrAvme470First );
+      if( status )
+      {
+        free(ptrAvme470First);
+        ptrAvme470First = NULL;
+        return status;
+      }
 
       /* Configure the new board based on above settings */
       avme470Config( ptrAvme470First );
@@ -378,16 +402,11 @@ int avme470Create( char *pName, unsigned short card, unsigned short slot,
   }
   else
   {
-    /* Check for unique card */
+    /* Find the end of the list */
 
     plist = ptrAvme470First;
     while( TRUE )
     {
-      if( !strcmp(plist->pName, pName) || ((plist->card == card) && (plist->slot == slot)) )
-      {
-        printf("avme470Create: Duplicate device (%s, %d, %d)\n", pName, card, slot);
-        return S_avme470_duplicateDevice;
-      }
       if( plist->pnext == NULL )
         break;
       else
@@ -404,8 +423,13 @@ int avme470Create( char *pName, unsigned short card, unsigned short slot,
     }
 
     /* pconfig is the configuration block for our new card */
-    avme470SetConfig( pName, card, slot, mode, intHandler, usrFunc, vector, event,
-                     debounce, pconfig );
+    status = avme470SetConfig( pName, card, slot, mode, intHandler, usrFunc, vector, event,
+                               debounce, pconfig );
+    if( status )
+    {
+      free(pconfig);
+      return status;
+    }
 
     /* Update linked-list */
     plist->pnext = pconfig;
@@ -417,7 +441,7 @@ int avme470Create( char *pName, unsigned short card, unsigned short slot,
 }
 
 
-void avme470SetConfig( char *pName, unsigned short card, unsigned short slot, 
+int avme470SetConfig( char *pName, unsigned short card, unsigned short slot, 
                        unsigned char mode, unsigned char intHandler,
                        char *usrFunc, unsigned short vector,
                        unsigned short event, unsigned short debounce, 
@@ -427,6 +451,14 @@ void avme470SetConfig( char *pName, unsigned short card, unsigned short slot,
   pconfig->pName      = pName;
   pconfig->card       = card;
   pconfig->slot       = slot;
+
+  /* Register for constant-time lookup by name and location */
+  if( ipacRegAdd( avme470RegType, pName, card, slot, pconfig ) )
+  {
+    printf("avme470SetConfig: Failed to register device (%s, %d, %d)\n", pName, card, slot);
+    return S_avme470_duplicateDevice;
+  }
+
   pconfig->brd_ptr    = (struct map470 *)ipmBaseAddr(card, slot, ipac_addrIO);
   pconfig->mask_reg   = OUTPUT_MASK;  /* Mask writes to all outputs */
   pconfig->mask_reg = 0;	/* CW to test interrupts */
@@ -592,75 +624,88 @@ long avme470Read( char *name, short port, short bit, int readFlag,
                       unsigned short *pval, int debug )
 {
   struct config470 *plist;
+
+  plist = avme470FindCard( name );
+  if( !plist )
+  {
+    printf("avme470Read: Card %s not found\n", name);
+    return S_avme470_cardNotFound;
+  }
+  return avme470ReadCard( plist, port, bit, readFlag, pval, debug );
+}
+
+
+long avme470ReadCard( void *ptr, short port, short bit, int readFlag,
+                      unsigned short *pval, int debug )
+{
+  struct config470 *plist;
   struct map470    *map_ptr;
   unsigned char     ports[3];
   unsigned int      res, n;
   int               shift;
 
+  plist = (struct config470 *)ptr;
+  if( !plist )
+  {
+    printf("avme470ReadCard: NULL card handle\n");
+    return S_avme470_cardNotFound;
+  }
+
   if( (port < 0) || (port >= MAXPORTS) )
   {
-    printf("avme470Read: %s: port number out of range %d\n", name, port );
+    printf("avme470Read: %s: port number out of range %d\n", plist->pName, port );
     return S_avme470_portError;
   }
   else if( (bit < 0) || (bit >= MAXBITS) )
   {
-    printf("avme470Read: %s: bit number out of range %d\n", name, bit );
+    printf("avme470Read: %s: bit number out of range %d\n", plist->pName, bit );
     return S_avme470_bitError;
   }
   else
   {
-    plist = avme470FindCard(name);
-    if( plist )
+    avme470SelectBank(BANK0, plist);      /* select I/O bank */
+    map_ptr = plist->brd_ptr;
+    if( readFlag == BIT || readFlag == PORT )
     {
-      avme470SelectBank(BANK0, plist);      /* select I/O bank */
-      map_ptr = plist->brd_ptr;
-      if( readFlag == BIT || readFlag == PORT )
+      *pval = avme470Input((unsigned *)&map_ptr->port[port].b_select);
+      if( readFlag == BIT )
       {
-        *pval = avme470Input((unsigned *)&map_ptr->port[port].b_select);
-        if( readFlag == BIT )
-        {
-          if( *pval & (1 << bit) )
-            *pval = 1;
-          else 
-            *pval = 0;
-        }
+        if( *pval & (1 << bit) )
+          *pval = 1;
+        else 
+          *pval = 0;
+      }
 
-        if( debug )
-          printf("avme470Read: name = %s, port = %d, bit = %d, pval = %d\n", 
-                  name, port, bit, *pval);
+      if( debug )
+        printf("avme470Read: name = %s, port = %d, bit = %d, pval = %d\n", 
+                plist->pName, port, bit, *pval);
+    }
+    else if( readFlag == NIBBLE || readFlag == WORD )
+    {
+      ports[2] = ports[1] = ports[0] = 0;
+      for ( n = 0; n < 3  &&  port < MAXPORTS; n++, port++ ) {
+        ports[n] = avme470Input((unsigned *)&map_ptr->port[port].b_select);
       }
-      else if( readFlag == NIBBLE || readFlag == WORD )
-      {
-        ports[2] = ports[1] = ports[0] = 0;
-        for ( n = 0; n < 3  &&  port < MAXPORTS; n++, port++ ) {
-          ports[n] = avme470Input((unsigned *)&map_ptr->port[port].b_select);
-        }
 
-        /* Combine into a 32-bit integer */
-        res   =  (ports[2]<<16) + (ports[1]<<8) + ports[0];
+      /* Combine into a 32-bit integer */
+      res   =  (ports[2]<<16) + (ports[1]<<8) + ports[0];
 
-        /* Calculate position in integer where we want to be */
-        shift = bit;
+      /* Calculate position in integer where we want to be */
+      shift = bit;
 
-        if( readFlag == NIBBLE )
-          *pval = (res >> shift) & 0xF;
-        else if( readFlag == WORD )
-          *pval = (res >> shift) & 0xFFFF;
+      if( readFlag == NIBBLE )
+        *pval = (res >> shift) & 0xF;
+      else if( readFlag == WORD )
+        *pval = (res >> shift) & 0xFFFF;
 
-        if( debug )
-          printf("avme470Read: name = %s, port = %d, bit = %d, pval = %d\n", 
-                  name, port, bit, *pval);
-      }
-      else
-      {
-        printf("avme470Read: %s: Data flag error (%d)\n", name, readFlag );
-        return S_avme470_dataFlagError;
-      }
+      if( debug )
+        printf("avme470Read: name = %s, port = %d, bit = %d, pval = %d\n", 
+                plist->pName, port, bit, *pval);
     }
     else
     {
-      printf("avme470Read: Card %s not found\n", name);
-      return S_avme470_cardNotFound;
+      printf("avme470Read: %s: Data flag error (%d)\n", plist->pName, readFlag );
+      return S_avme470_dataFlagError;
     }
   }
   return(OK);
@@ -671,119 +716,146 @@ long avme470Write( char *name, short port, short bit, int writeFlag,
                    long value, int nobt, int debug )
 {
   struct config470 *plist;
+
+  plist = avme470FindCard( name );
+  if( !plist )
+  {
+    printf("avme470Write: Card %s not found\n", name);
+    return S_avme470_cardNotFound;
+  }
+  return avme470WriteCard( plist, port, bit, writeFlag, value, nobt, debug );
+}
+
+
+long avme470WriteCard( void *ptr, short port, short bit, int writeFlag,
+                       long value, int nobt, int debug )
+{
+  struct config470 *plist;
   struct map470    *map_ptr;
-  unsigned char    bpos, oldport, newport;
+  unsigned char    bpos, oldport, newport, saved_bank;
   int              nBits = nobt;
-
+  int              key;
   unsigned long    zeroMask, zeroOut, uvalue = value;
 
+  plist = (struct config470 *)ptr;
+  if( !plist )
+  {
+    printf("avme470WriteCard: NULL card handle\n");
+    return S_avme470_cardNotFound;
+  }
+
   if( (port < 0) || (port >= MAXPORTS) )
   {
-    printf("avme470Write: %s: port numbver out of range %d\n", name, port );
+    printf("avme470Write: %s: port numbver out of range %d\n", plist->pName, port );
     return S_avme470_portError;
   }
   else if( (bit < 0) || (bit >= MAXBITS) )
   {
-    printf("avme470Write: %s: bit number out of range %d\n", name, bit );
+    printf("avme470Write: %s: bit number out of range %d\n", plist->pName, bit );
     return S_avme470_bitError;
   }
   else
   {
-    plist = avme470FindCard( name );
-    if( plist )
+    if( debug )
+      printf("avme470Write: name = %s, port = %d, bit = %d, writeFlag = %d, value = 0x%lx\n",
+                            plist->pName, port, bit, writeFlag, value);
+    map_ptr = plist->brd_ptr;
+    if( writeFlag == BIT )
     {
-      if( debug )
-        printf("avme470Write: name = %s, port = %d, bit = %d, writeFlag = %d, value = 0x%lx\n",
-                              name, port, bit, writeFlag, value);
-      map_ptr = plist->brd_ptr;
-      if( writeFlag == BIT )
+      if( value < 0 || value > 1 )
       {
-        if( value < 0 || value > 1 )
-        {
-          printf("avme470Write: %s: BIT value out of range = %ld\n", name, value);
-          return S_avme470_writeError;
-        }
-        else
-        {
-          bpos  = 1 << bit;
-          value = value << bit;
-          avme470Output( (unsigned *)&map_ptr->port[port].b_select,
-                         (int)((avme470Input((unsigned *)&map_ptr->port[port].b_select) & ~bpos) | value));
-        }
+        printf("avme470Write: %s: BIT value out of range = %ld\n", plist->pName, value);
+        return S_avme470_writeError;
       }
-      else if( writeFlag == PORT )
+      else
       {
-        if( value < 0 || value > 0xFF )
-        {
-          printf("avme470Write: %s: PORT value out of range = %ld\n", name, value);
-          return S_avme470_writeError;
-        }
-        else
-          avme470Output( (unsigned *)&map_ptr->port[port].b_select, (int)value);
+        bpos  = 1 << bit;
+        value = value << bit;
+        key = avme470LockOut();
+        saved_bank = avme470SelectBank(BANK0, plist);  /* I/O ports are in bank 0 */
+        avme470Output( (unsigned *)&map_ptr->port[port].b_select,
+                       (int)((avme470Input((unsigned *)&map_ptr->port[port].b_select) & ~bpos) | value));
+        avme470SelectBank(saved_bank, plist);
+        avme470UnlockOut(key);
       }
-      else if( writeFlag == NIBBLE || writeFlag == WORD )
+    }
+    else if( writeFlag == PORT )
+    {
+      if( value < 0 || value > 0xFF )
       {
-        if( (writeFlag == NIBBLE) && (uvalue > 0xF) )
-        {
-          printf("avme470Write: %s: NIBBLE value out of range = %ld\n", name, value);
-          return S_avme470_writeError;
-        }
-        else if( (writeFlag == WORD) && (uvalue > 0xFFFF) )
-        {
-          printf("avme470Write: %s: WORD value out of range = %ld\n", name, value);
-          return S_avme470_writeError;
-        }
-        else
-        {
-          if ( nBits > 16 ) nBits = 16;
-          if( writeFlag == NIBBLE  &&  nBits > 4 ) nBits = 4;
-          zeroMask = (1<<nBits) - 1;
-
-                                                /* get new data port aligned */
-          zeroMask = zeroMask << bit;
-          uvalue   = uvalue   << bit;
-
-          for ( ; nBits > 0  &&  port < MAXPORTS; ) {
+        printf("avme470Write: %s: PORT value out of range = %ld\n", plist->pName, value);
+        return S_avme470_writeError;
+      }
+      else
+      {
+        key = avme470LockOut();
+        saved_bank = avme470SelectBank(BANK0, plist);
+        avme470Output( (unsigned *)&map_ptr->port[port].b_select, (int)value);
+        avme470SelectBank(saved_bank, plist);
+        avme470UnlockOut(key);
+      }
+    }
+    else if( writeFlag == NIBBLE || writeFlag == WORD )
+    {
+      if( (writeFlag == NIBBLE) && (uvalue > 0xF) )
+      {
+        printf("avme470Write: %s: NIBBLE value out of range = %ld\n", plist->pName, value);
+        return S_avme470_writeError;
+      }
+      else if( (writeFlag == WORD) && (uvalue > 0xFFFF) )
+      {
+        printf("avme470Write: %s: WORD value out of range = %ld\n", plist->pName, value);
+        return S_avme470_writeError;
+      }
+      else
+      {
+        if ( nBits > 16 ) nBits = 16;
+        if( writeFlag == NIBBLE  &&  nBits > 4 ) nBits = 4;
+        zeroMask = (1<<nBits) - 1;
 
-            /* Zero-out the bits we want to change */
-            zeroOut = ~zeroMask;
+                                              /* get new data port aligned */
+        zeroMask = zeroMask << bit;
+        uvalue   = uvalue   << bit;
 
-            /* Current value AND zeroOut will zero-out the bits.   */
-            /* Now OR this with the new bit pattern shifted by the */
-            /* appropriate amount                                  */
+        for ( ; nBits > 0  &&  port < MAXPORTS; ) {
 
-            oldport = avme470Input((unsigned *)&map_ptr->port[port].b_select);
-            newport = ( (oldport & zeroOut) | uvalue ) & 0xFF;
+          /* Zero-out the bits we want to change */
+          zeroOut = ~zeroMask;
 
-            if ( debug ) { 
-              printf("avme470Write: port=%d, nBits=%d, zeroMask=0x%04lx, uvalue=0x%04lx\n",
-                port, nBits, zeroMask, uvalue);
-              printf("              oldport=0x%04x, newport=0x%04x\n", oldport, newport);
-            } 
+          /* Current value AND zeroOut will zero-out the bits.   */
+          /* Now OR this with the new bit pattern shifted by the */
+          /* appropriate amount                                  */
 
-            if ( newport != oldport ) {
-                                          /* Write new port value */
-              avme470Output((unsigned *)&map_ptr->port[port].b_select, newport);
-            }
+          key = avme470LockOut();
+          saved_bank = avme470SelectBank(BANK0, plist);
+          oldport = avme470Input((unsigned *)&map_ptr->port[port].b_select);
+          newport = ( (oldport & zeroOut) | uvalue ) & 0xFF;
 
-            nBits    = nBits - (8-bit);
-            uvalue   = uvalue >> (8-bit);
-            zeroMask = zeroMask >> (8-bit);
-            bit = 0;
-            port++;
+          if ( newport != oldport ) {
+                                        /* Write new port value */
+            avme470Output((unsigned *)&map_ptr->port[port].b_select, newport);
           }
+          avme470SelectBank(saved_bank, plist);
+          avme470UnlockOut(key);
+
+          if ( debug ) { 
+            printf("avme470Write: port=%d, nBits=%d, zeroMask=0x%04lx, uvalue=0x%04lx\n",
+              port, nBits, zeroMask, uvalue);
+            printf("              oldport=0x%04x, newport=0x%04x\n", oldport, newport);
+          } 
+
+          nBits    = nBits - (8-bit);
+          uvalue   = uvalue >> (8-bit);
+          zeroMask = zeroMask >> (8-bit);
+          bit = 0;
+          port++;
         }
       }
-      else
-      {
-        printf("avme470Write: %s: Data flag error (%d)\n", name, writeFlag );
-        return S_avme470_dataFlagError;
-      }
     }
     else
     {
-      printf("avme470Write: Card %s not found\n", name);
-      return S_avme470_cardNotFound;
+      printf("avme470Write: %s: Data flag error (%d)\n", plist->pName, writeFlag );
+      return S_avme470_dataFlagError;
     }
   }
   return(OK);
@@ -1125,24 +1197,7 @@ void avme470WhichHandler( char *name, unsigned char *handler )
 
 void *avme470FindCard( char *name )
 {
-  struct config470 *plist;
-  int               foundCard = 0;
-
-  plist = ptrAvme470First;
-  while( plist )
-  {
-    if( !strcmp(plist->pName, name) )
-    {
-      foundCard = 1;
-      break;
-    }
-    plist = plist->pnext;
-  }
-
-  if( !foundCard )
-    return NULL;
-  else
-    return plist;
+  return ipacRegFindByName( avme470RegType, name );
 }
 
 
@@ -1191,6 +1246,9 @@ static void avme470CreateCallFunc(const iocshArgBuf *arg)
 LOCAL void drvAvme470Registrar(void) {
     iocshRegister(&avme470ReportFuncDef,avme470ReportCallFunc);
     iocshRegister(&avme470CreateFuncDef,avme470CreateCallFunc);
+    /* Lets other drivers (ip330InterlockOutput) write without linking to us */
+    registryFunctionAdd("avme470FindCard",(REGISTRYFUNCTION)avme470FindCard);
+    registryFunctionAdd("avme470WriteCard",(REGISTRYFUNCTION)avme470WriteCard);
 }
 epicsExportRegistrar(drvAvme470Registrar);
 
@@ -166,7 +166,7 @@ int           avme470Create( char *pName, unsigned short card,
                              unsigned short slot, char *modeName,
                              char *intHandlerName, char *usrFunc, 
                              short vector, short event, short debounce );
-void          avme470SetConfig( char *pName, unsigned short card, 
+int           avme470SetConfig( char *pName, unsigned short card, 
                                 unsigned short slot, unsigned char mode,
                                 unsigned char intHandler, char *usrFunc, 
                                 unsigned short vector, 
@@ -176,8 +176,12 @@ void          avme470Config( struct config470 *pconfig );
 unsigned char avme470SelectBank( unsigned char newBank, struct config470 *pconfig );
 long          avme470Read( char *name, short port, short bit, int readFlag,
                            unsigned short *pval, int debug );
+long          avme470ReadCard( void *ptr, short port, short bit, int readFlag,
+                               unsigned short *pval, int debug );
 long          avme470Write( char *name, short port, short bit, int writeFlag,
                             long value, int nobt, int debug );
+long          avme470WriteCard( void *ptr, short port, short bit, int writeFlag,
+                                long value, int nobt, int debug );
 unsigned char avme470Input( unsigned int *addr );
 void          avme470Output( unsigned int *addr, int b );
 void          avme470COS( struct config470 *pconfig );